@@ -0,0 +1,84 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace gps {
+
+    namespace {
+
+        std::atomic<bool> counting(false);
+        std::atomic<size_t> allocationCount(0);
+        std::atomic<size_t> allocatedBytes(0);
+    }
+
+#ifdef GPS_ALLOCATION_COUNTER
+    namespace {
+
+        void* CountedAllocate(size_t size) {
+            if (counting.load(std::memory_order_relaxed)) {
+                allocationCount.fetch_add(1, std::memory_order_relaxed);
+                allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+            }
+            void* memory = std::malloc(size == 0 ? 1 : size);
+            if (!memory) {
+                throw std::bad_alloc();
+            }
+            return memory;
+        }
+    }
+#endif
+
+    bool AllocationCounter::isEnabled() {
+#ifdef GPS_ALLOCATION_COUNTER
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void AllocationCounter::Start() {
+        allocationCount = 0;
+        allocatedBytes = 0;
+        counting = true;
+    }
+
+    void AllocationCounter::Stop() {
+        counting = false;
+    }
+
+    size_t AllocationCounter::getAllocationCount() {
+        return allocationCount;
+    }
+
+    size_t AllocationCounter::getAllocatedBytes() {
+        return allocatedBytes;
+    }
+}
+
+#ifdef GPS_ALLOCATION_COUNTER
+void* operator new(size_t size) {
+    return gps::CountedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return gps::CountedAllocate(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    std::free(memory);
+}
+#endif
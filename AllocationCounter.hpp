@@ -0,0 +1,24 @@
+#ifndef AllocationCounter_hpp
+#define AllocationCounter_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    //counts calls to the global operator new between Start and Stop.
+    //AllocationCounter.cpp replaces the global allocation functions, so it covers every container.
+    //The replacement is only compiled with GPS_ALLOCATION_COUNTER defined (the benchmark build),
+    //otherwise nothing is counted and isEnabled returns false
+    class AllocationCounter {
+
+    public:
+        static bool isEnabled();
+        static void Start();
+        static void Stop();
+        static size_t getAllocationCount();
+        static size_t getAllocatedBytes();
+    };
+
+}
+
+#endif
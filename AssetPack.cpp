@@ -0,0 +1,364 @@
+#include "AssetPack.hpp"
+#include "Lz4Codec.hpp"
+#include "VirtualFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        const char PACK_MAGIC[4] = { 'G', 'P', 'S', 'P' };
+        const uint32_t PACK_VERSION = 1;
+        //entries start on this boundary inside the pack
+        const uint64_t PACK_ALIGNMENT = 16;
+
+        struct PackHeader {
+            char magic[4];
+            uint32_t version;
+            uint32_t entryCount;
+            uint32_t reserved;
+            uint64_t tocOffset;
+        };
+
+        //followed by pathLength bytes of path
+        struct PackRecord {
+            uint64_t offset;
+            uint64_t storedSize;
+            uint64_t size;
+            uint64_t contentHash;
+            int64_t sourceTime;
+            uint32_t codec;
+            uint32_t pathLength;
+        };
+
+        std::string Trim(const std::string& value) {
+            size_t begin = value.find_first_not_of(" \t\r\n");
+            if (begin == std::string::npos) {
+                return "";
+            }
+            size_t end = value.find_last_not_of(" \t\r\n");
+            return value.substr(begin, end - begin + 1);
+        }
+
+        std::string GetDirectory(const std::string& path) {
+            size_t slash = path.find_last_of('/');
+            return slash == std::string::npos ? "" : path.substr(0, slash + 1);
+        }
+
+        void AddFile(std::vector<std::string>& files, std::string path) {
+            path = AssetPack::NormalizePath(path);
+            if (std::find(files.begin(), files.end(), path) == files.end()) {
+                files.push_back(path);
+            }
+        }
+    }
+
+    AssetPack& AssetPack::Get() {
+        static AssetPack pack;
+        return pack;
+    }
+
+    AssetPack::AssetPack() {
+    }
+
+    bool AssetPack::Mount(std::string packPath) {
+        entries.clear();
+        entriesByPath.clear();
+        if (!file.Open(packPath)) {
+            return false;
+        }
+
+        const unsigned char* data = file.getData();
+        size_t size = file.getSize();
+        PackHeader header;
+        if (size < sizeof(header)) {
+            file.Close();
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, PACK_MAGIC, sizeof(header.magic)) != 0 || header.version != PACK_VERSION ||
+            header.tocOffset < sizeof(header) || header.tocOffset > size) {
+            std::cerr << "ERROR: " << packPath << " is not a version " << PACK_VERSION << " asset pack" << std::endl;
+            file.Close();
+            return false;
+        }
+
+        size_t position = (size_t)header.tocOffset;
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            PackRecord record;
+            if (sizeof(record) > size - position) {
+                break;
+            }
+            memcpy(&record, data + position, sizeof(record));
+            position += sizeof(record);
+            if (record.pathLength > size - position || record.offset > header.tocOffset ||
+                record.storedSize > header.tocOffset - record.offset || record.codec > PACK_LZ4 ||
+                (record.codec == PACK_STORED && record.storedSize != record.size)) {
+                break;
+            }
+            PackEntry entry;
+            entry.path.assign((const char*)data + position, record.pathLength);
+            position += record.pathLength;
+            entry.offset = record.offset;
+            entry.storedSize = record.storedSize;
+            entry.size = record.size;
+            entry.contentHash = record.contentHash;
+            entry.sourceTime = record.sourceTime;
+            entry.codec = (PackCodec)record.codec;
+            entriesByPath[entry.path] = entries.size();
+            entries.push_back(entry);
+        }
+        if (entries.size() != header.entryCount) {
+            std::cerr << "ERROR: the table of contents of " << packPath << " is damaged" << std::endl;
+            entries.clear();
+            entriesByPath.clear();
+            file.Close();
+            return false;
+        }
+
+        std::cout << "Mounted asset pack : " << packPath << ", " << entries.size() << " entries" << std::endl;
+        return true;
+    }
+
+    bool AssetPack::isMounted() {
+        return file.getData() != nullptr;
+    }
+
+    const PackEntry* AssetPack::Find(std::string path) {
+        if (entries.empty()) {
+            return nullptr;
+        }
+        auto found = entriesByPath.find(NormalizePath(path));
+        return found != entriesByPath.end() ? &entries[found->second] : nullptr;
+    }
+
+    bool AssetPack::Read(const PackEntry& entry, std::vector<unsigned char>& buffer, const unsigned char*& data) {
+        const unsigned char* stored = file.getData() + entry.offset;
+        if (entry.codec == PACK_STORED) {
+            data = stored;
+            return true;
+        }
+        buffer.resize((size_t)entry.size);
+        if (!gps::Lz4Codec::Decompress(stored, (size_t)entry.storedSize, buffer.data(), buffer.size())) {
+            std::cerr << "ERROR: corrupt pack entry " << entry.path << std::endl;
+            return false;
+        }
+        data = buffer.data();
+        return true;
+    }
+
+    std::string AssetPack::NormalizePath(std::string path) {
+        std::replace(path.begin(), path.end(), '\\', '/');
+        std::vector<std::string> parts;
+        size_t begin = 0;
+        while (begin <= path.size()) {
+            size_t end = path.find('/', begin);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            std::string part = path.substr(begin, end - begin);
+            if (part == "..") {
+                if (!parts.empty() && parts.back() != "..") {
+                    parts.pop_back();
+                }
+                else {
+                    parts.push_back(part);
+                }
+            }
+            else if (!part.empty() && part != ".") {
+                parts.push_back(part);
+            }
+            begin = end + 1;
+        }
+        std::string normalized;
+        for (size_t i = 0; i < parts.size(); i++) {
+            normalized += (i > 0 ? "/" : "") + parts[i];
+        }
+        return normalized;
+    }
+
+    void AssetPack::CollectObjDependencies(std::string objPath, std::vector<std::string>& files) {
+        gps::MappedFile obj;
+        if (!obj.Open(objPath)) {
+            return;
+        }
+        std::string basePath = GetDirectory(objPath);
+        const char* data = (const char*)obj.getData();
+        size_t size = obj.getSize();
+        std::vector<std::string> libraries;
+        for (size_t line = 0; line < size;) {
+            const char* newline = (const char*)memchr(data + line, '\n', size - line);
+            size_t lineEnd = newline ? (size_t)(newline - data) : size;
+            if (lineEnd - line > 7 && strncmp(data + line, "mtllib", 6) == 0) {
+                libraries.push_back(basePath + Trim(std::string(data + line + 7, lineEnd - line - 7)));
+            }
+            line = lineEnd + 1;
+        }
+
+        const char* textureKeys[] = { "map_Ka", "map_Kd", "map_Ks", "map_Ns", "map_d", "map_bump", "bump", "disp" };
+        for (size_t i = 0; i < libraries.size(); i++) {
+            AddFile(files, libraries[i]);
+            //texture paths are relative to the library, which can sit in another directory than the obj
+            std::string libraryPath = GetDirectory(libraries[i]);
+            std::ifstream mtl(libraries[i]);
+            std::string line;
+            while (std::getline(mtl, line)) {
+                line = Trim(line);
+                for (size_t k = 0; k < sizeof(textureKeys) / sizeof(textureKeys[0]); k++) {
+                    size_t keyLength = strlen(textureKeys[k]);
+                    if (line.compare(0, keyLength, textureKeys[k]) != 0 || line.size() <= keyLength || (line[keyLength] != ' ' && line[keyLength] != '\t')) {
+                        continue;
+                    }
+                    //options such as -bm come first, the file name is the last token
+                    std::string texture = Trim(line.substr(line.find_last_of(" \t") + 1));
+                    AddFile(files, libraryPath + texture);
+                    uint64_t cookedSize;
+                    int64_t cookedTime;
+                    if (gps::VirtualFile::GetDiskStamp(libraryPath + texture + ".dds", cookedSize, cookedTime)) {
+                        AddFile(files, libraryPath + texture + ".dds");
+                    }
+                }
+            }
+        }
+    }
+
+    bool AssetPack::Build(std::string packPath, std::vector<std::string> files) {
+        std::vector<std::string> packFiles;
+        for (size_t i = 0; i < files.size(); i++) {
+            AddFile(packFiles, files[i]);
+            std::string extension = files[i].substr(files[i].find_last_of('.') + 1);
+            if (extension == "obj" || extension == "OBJ") {
+                CollectObjDependencies(files[i], packFiles);
+            }
+        }
+
+        std::ofstream out(packPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "ERROR: could not write " << packPath << std::endl;
+            return false;
+        }
+        PackHeader header;
+        memcpy(header.magic, PACK_MAGIC, sizeof(header.magic));
+        header.version = PACK_VERSION;
+        header.entryCount = 0;
+        header.reserved = 0;
+        header.tocOffset = 0;
+        out.write((const char*)&header, sizeof(header));
+        uint64_t position = sizeof(header);
+
+        std::vector<PackEntry> written;
+        std::vector<unsigned char> compressed;
+        uint64_t totalSize = 0;
+        for (size_t i = 0; i < packFiles.size(); i++) {
+            gps::MappedFile source;
+            uint64_t sourceSize;
+            int64_t sourceTime;
+            if (!source.Open(packFiles[i]) || !gps::VirtualFile::GetDiskStamp(packFiles[i], sourceSize, sourceTime)) {
+                std::cerr << "WARNING: skipping " << packFiles[i] << ", it is missing or empty" << std::endl;
+                continue;
+            }
+
+            PackEntry entry;
+            entry.path = packFiles[i];
+            entry.size = source.getSize();
+            entry.contentHash = source.Hash();
+            entry.sourceTime = sourceTime;
+            compressed.resize(gps::Lz4Codec::GetMaxCompressedSize(source.getSize()));
+            size_t compressedSize = gps::Lz4Codec::Compress(source.getData(), source.getSize(), compressed.data());
+            //already compressed formats (png, jpg) are kept as they are so they can be read in place
+            entry.codec = compressedSize < source.getSize() - source.getSize() / 10 ? PACK_LZ4 : PACK_STORED;
+            entry.storedSize = entry.codec == PACK_LZ4 ? compressedSize : source.getSize();
+
+            static const char padding[PACK_ALIGNMENT] = {};
+            uint64_t aligned = (position + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+            out.write(padding, (std::streamsize)(aligned - position));
+            entry.offset = aligned;
+            out.write(entry.codec == PACK_LZ4 ? (const char*)compressed.data() : (const char*)source.getData(), (std::streamsize)entry.storedSize);
+            position = aligned + entry.storedSize;
+
+            printf("%-60s %10llu -> %10llu %s\n", entry.path.c_str(), (unsigned long long)entry.size,
+                (unsigned long long)entry.storedSize, entry.codec == PACK_LZ4 ? "lz4" : "stored");
+            totalSize += entry.size;
+            written.push_back(entry);
+        }
+
+        header.entryCount = (uint32_t)written.size();
+        header.tocOffset = position;
+        for (size_t i = 0; i < written.size(); i++) {
+            PackRecord record;
+            record.offset = written[i].offset;
+            record.storedSize = written[i].storedSize;
+            record.size = written[i].size;
+            record.contentHash = written[i].contentHash;
+            record.sourceTime = written[i].sourceTime;
+            record.codec = (uint32_t)written[i].codec;
+            record.pathLength = (uint32_t)written[i].path.size();
+            out.write((const char*)&record, sizeof(record));
+            out.write(written[i].path.data(), record.pathLength);
+        }
+        out.seekp(0);
+        out.write((const char*)&header, sizeof(header));
+        if (!out) {
+            std::cerr << "ERROR: could not write " << packPath << std::endl;
+            return false;
+        }
+        printf("%s: %u entries, %.1f MB of files in a %.1f MB pack\n", packPath.c_str(), header.entryCount,
+            totalSize / (1024.0 * 1024.0), header.tocOffset / (1024.0 * 1024.0));
+        return true;
+    }
+
+    void AssetPack::Benchmark(std::string packPath) {
+        AssetPack& pack = Get();
+        if (!pack.Mount(packPath)) {
+            std::cerr << "ERROR: could not mount " << packPath << std::endl;
+            return;
+        }
+
+        //the first pass pays for whatever the OS has not cached yet, the second one is warm
+        std::vector<unsigned char> buffer;
+        for (int pass = 0; pass < 2; pass++) {
+            double looseMilliseconds = 0.0;
+            double packMilliseconds = 0.0;
+            size_t looseFiles = 0;
+            size_t stale = 0;
+            size_t corrupt = 0;
+            uint64_t bytes = 0;
+            uint64_t checksum = 0;
+            for (size_t i = 0; i < pack.entries.size(); i++) {
+                const PackEntry& entry = pack.entries[i];
+
+                auto start = std::chrono::high_resolution_clock::now();
+                gps::MappedFile loose;
+                if (loose.Open(entry.path)) {
+                    uint64_t looseHash = loose.Hash();
+                    checksum ^= looseHash;
+                    stale += looseHash != entry.contentHash ? 1 : 0;
+                    looseFiles++;
+                }
+                loose.Close();
+                auto middle = std::chrono::high_resolution_clock::now();
+                const unsigned char* data = nullptr;
+                if (!pack.Read(entry, buffer, data) || gps::MappedFile::HashBytes(data, (size_t)entry.size) != entry.contentHash) {
+                    corrupt++;
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+
+                looseMilliseconds += std::chrono::duration<double, std::milli>(middle - start).count();
+                packMilliseconds += std::chrono::duration<double, std::milli>(end - middle).count();
+                bytes += entry.size;
+            }
+            printf("pass %d (%s): %zu entries, %.1f MB, loose files %.2f ms (%zu opened), pack %.2f ms [%llx]\n",
+                pass + 1, pass == 0 ? "cold" : "warm", pack.entries.size(), bytes / (1024.0 * 1024.0), looseMilliseconds, looseFiles,
+                packMilliseconds, (unsigned long long)checksum);
+            if (stale > 0 || corrupt > 0) {
+                printf("%zu loose files changed since packing, %zu entries failed their hash check\n", stale, corrupt);
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef AssetPack_hpp
+#define AssetPack_hpp
+
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    enum PackCodec {
+        PACK_STORED,
+        PACK_LZ4
+    };
+
+    struct PackEntry {
+        std::string path;
+        uint64_t offset;
+        uint64_t storedSize;
+        uint64_t size;
+        //FNV-1a 64 of the uncompressed bytes, the same value MappedFile::Hash gives for the loose file
+        uint64_t contentHash;
+        int64_t sourceTime;
+        PackCodec codec;
+    };
+
+    //single archive holding the viewer's models, materials, textures and shaders.
+    //the whole pack is one read-only mapping; entries that do not shrink by LZ4 are stored
+    //as is and read in place, the rest are decompressed on demand. See VirtualFile.
+    class AssetPack {
+
+    public:
+        static AssetPack& Get();
+
+        //must happen before any loader threads start, lookups are not synchronized
+        bool Mount(std::string packPath);
+        bool isMounted();
+        const PackEntry* Find(std::string path);
+        //points data at the entry bytes: inside the mapping for stored entries, otherwise in buffer
+        bool Read(const PackEntry& entry, std::vector<unsigned char>& buffer, const unsigned char*& data);
+
+        //writes the listed files plus, for OBJ files, their material libraries and textures
+        static bool Build(std::string packPath, std::vector<std::string> files);
+        //reads every entry loose and from the pack, twice, and prints the timings
+        static void Benchmark(std::string packPath);
+        //forward slashes, no "." or ".." components, so equal paths find the same entry
+        static std::string NormalizePath(std::string path);
+
+    private:
+        gps::MappedFile file;
+        std::vector<PackEntry> entries;
+        std::unordered_map<std::string, size_t> entriesByPath;
+
+        AssetPack();
+        AssetPack(const AssetPack&);
+        AssetPack& operator=(const AssetPack&);
+
+        static void CollectObjDependencies(std::string objPath, std::vector<std::string>& files);
+    };
+
+}
+
+#endif
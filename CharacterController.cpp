@@ -0,0 +1,260 @@
+#include "CharacterController.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+
+        //gap kept between the capsule and what it touches
+        const float CONTACT_SKIN = 0.005f;
+        const float EPSILON = 1e-8f;
+
+        //Ericson, Real-Time Collision Detection 5.1.5
+        glm::vec3 ClosestPointTriangle(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+            glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+            float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+            if (d1 <= 0.0f && d2 <= 0.0f) {
+                return a;
+            }
+            glm::vec3 bp = p - b;
+            float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+            if (d3 >= 0.0f && d4 <= d3) {
+                return b;
+            }
+            float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+                return a + ab * (d1 / (d1 - d3));
+            }
+            glm::vec3 cp = p - c;
+            float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+            if (d6 >= 0.0f && d5 <= d6) {
+                return c;
+            }
+            float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+                return a + ac * (d2 / (d2 - d6));
+            }
+            float va = d3 * d6 - d5 * d4;
+            if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+                return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+            }
+            float denominator = 1.0f / (va + vb + vc);
+            return a + ab * (vb * denominator) + ac * (vc * denominator);
+        }
+
+        //Ericson 5.1.9
+        void ClosestSegmentSegment(glm::vec3 p1, glm::vec3 q1, glm::vec3 p2, glm::vec3 q2, glm::vec3& c1, glm::vec3& c2) {
+            glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+            float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+            float s = 0.0f, t = 0.0f;
+            if (a <= EPSILON && e <= EPSILON) {
+                c1 = p1;
+                c2 = p2;
+                return;
+            }
+            if (a <= EPSILON) {
+                t = glm::clamp(f / e, 0.0f, 1.0f);
+            }
+            else {
+                float c = glm::dot(d1, r);
+                if (e <= EPSILON) {
+                    s = glm::clamp(-c / a, 0.0f, 1.0f);
+                }
+                else {
+                    float b = glm::dot(d1, d2);
+                    float denominator = a * e - b * b;
+                    s = denominator != 0.0f ? glm::clamp((b * f - c * e) / denominator, 0.0f, 1.0f) : 0.0f;
+                    t = (b * s + f) / e;
+                    if (t < 0.0f) {
+                        t = 0.0f;
+                        s = glm::clamp(-c / a, 0.0f, 1.0f);
+                    }
+                    else if (t > 1.0f) {
+                        t = 1.0f;
+                        s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+                    }
+                }
+            }
+            c1 = p1 + d1 * s;
+            c2 = p2 + d2 * t;
+        }
+
+        //closest points between segment p-q and triangle v, returns their squared distance
+        float ClosestSegmentTriangle(glm::vec3 p, glm::vec3 q, const glm::vec3* v, glm::vec3& onSegment, glm::vec3& onTriangle) {
+            //a segment through the face touches it (Moller-Trumbore)
+            glm::vec3 direction = q - p;
+            glm::vec3 e1 = v[1] - v[0], e2 = v[2] - v[0];
+            glm::vec3 h = glm::cross(direction, e2);
+            float determinant = glm::dot(e1, h);
+            if (std::fabs(determinant) > EPSILON) {
+                float inverse = 1.0f / determinant;
+                glm::vec3 s = p - v[0];
+                float u = inverse * glm::dot(s, h);
+                glm::vec3 k = glm::cross(s, e1);
+                float w = inverse * glm::dot(direction, k);
+                float t = inverse * glm::dot(e2, k);
+                if (u >= 0.0f && w >= 0.0f && u + w <= 1.0f && t >= 0.0f && t <= 1.0f) {
+                    onSegment = onTriangle = p + direction * t;
+                    return 0.0f;
+                }
+            }
+
+            //otherwise the closest pair has a segment end or lies on a triangle edge
+            float best = 3.4e38f;
+            glm::vec3 ends[2] = { p, q };
+            for (int i = 0; i < 2; i++) {
+                glm::vec3 closest = ClosestPointTriangle(ends[i], v[0], v[1], v[2]);
+                float distance = glm::dot(ends[i] - closest, ends[i] - closest);
+                if (distance < best) {
+                    best = distance;
+                    onSegment = ends[i];
+                    onTriangle = closest;
+                }
+            }
+            for (int i = 0; i < 3; i++) {
+                glm::vec3 c1, c2;
+                ClosestSegmentSegment(p, q, v[i], v[(i + 1) % 3], c1, c2);
+                float distance = glm::dot(c1 - c2, c1 - c2);
+                if (distance < best) {
+                    best = distance;
+                    onSegment = c1;
+                    onTriangle = c2;
+                }
+            }
+            return best;
+        }
+    }
+
+    CharacterController::CharacterController() {
+        radius = 0.25f;
+        height = 0.5f;
+        maxSlides = 4;
+        lastSlideCount = 0;
+    }
+
+    void CharacterController::setShape(float radius, float height) {
+        this->radius = radius;
+        this->height = height;
+    }
+
+    void CharacterController::setMaxSlides(int maxSlides) {
+        this->maxSlides = maxSlides;
+    }
+
+    void CharacterController::GetBounds(glm::vec3 position, glm::vec3& boxMin, glm::vec3& boxMax) const {
+        boxMin = position - glm::vec3(radius, height + radius, radius);
+        boxMax = position + glm::vec3(radius);
+    }
+
+    void CharacterController::GetSweptBounds(glm::vec3 position, glm::vec3 motion, glm::vec3& boxMin, glm::vec3& boxMax) const {
+        //slides only shorten the motion, so no part of the move gets further than |motion| from the start
+        glm::vec3 extent(radius + glm::length(motion) + CONTACT_SKIN);
+        boxMin = position - glm::vec3(0.0f, height, 0.0f) - extent;
+        boxMax = position + extent;
+    }
+
+    glm::vec3 CharacterController::Move(glm::vec3 position, glm::vec3 motion, const std::vector<glm::vec3>& triangles) {
+        lastSlideCount = 0;
+        glm::vec3 boxMin, boxMax;
+        GetSweptBounds(position, motion, boxMin, boxMax);
+        blocks.Assign(triangles);
+        gps::TriangleKernels::OverlapBox(blocks, boxMin, boxMax, hits);
+        nearby.clear();
+        for (size_t i = 0; i < hits.size(); i++) {
+            nearby.insert(nearby.end(), triangles.begin() + (size_t)hits[i] * 3, triangles.begin() + (size_t)hits[i] * 3 + 3);
+        }
+
+        glm::vec3 remaining = motion;
+        glm::vec3 previousNormal(0.0f);
+        for (int slide = 0; slide < maxSlides; slide++) {
+            if (glm::dot(remaining, remaining) <= EPSILON) {
+                break;
+            }
+            lastSlideCount++;
+            float t;
+            glm::vec3 normal;
+            if (!Sweep(position, remaining, t, normal)) {
+                return position + remaining;
+            }
+            position += remaining * t;
+            remaining = remaining * (1.0f - t);
+            remaining -= normal * glm::dot(remaining, normal);
+            //in a crease between two surfaces only the direction along both of them is free
+            if (slide > 0 && glm::dot(remaining, previousNormal) < 0.0f) {
+                glm::vec3 crease = glm::cross(previousNormal, normal);
+                float creaseLength = glm::dot(crease, crease);
+                remaining = creaseLength > EPSILON ? crease * (glm::dot(remaining, crease) / creaseLength) : glm::vec3(0.0f);
+            }
+            previousNormal = normal;
+        }
+        return position;
+    }
+
+    bool CharacterController::Sweep(glm::vec3 position, glm::vec3 motion, float& t, glm::vec3& normal) const {
+        float length = glm::length(motion);
+        glm::vec3 bottom = position - glm::vec3(0.0f, height, 0.0f);
+        bool found = false;
+        t = 1.0f;
+        for (size_t i = 0; i < nearby.size(); i += 3) {
+            //conservative advancement: the capsule can move the current gap without touching
+            //the triangle, so step by it until the gap is within the skin
+            const glm::vec3* v = &nearby[i];
+            float travelled = 0.0f;
+            for (int step = 0; step < MAX_ADVANCE_STEPS; step++) {
+                glm::vec3 offset = motion * travelled;
+                glm::vec3 onSegment, onTriangle;
+                float gap = std::sqrt(ClosestSegmentTriangle(bottom + offset, position + offset, v, onSegment, onTriangle)) - radius;
+                bool touching = gap <= CONTACT_SKIN;
+                //out of steps: stop short of the triangle rather than risk passing it
+                if (touching || step == MAX_ADVANCE_STEPS - 1) {
+                    glm::vec3 away = onSegment - onTriangle;
+                    float awayLength = glm::length(away);
+                    if (awayLength > EPSILON) {
+                        away /= awayLength;
+                    }
+                    else {
+                        away = glm::normalize(glm::cross(v[1] - v[0], v[2] - v[0]));
+                        if (glm::dot(away, motion) > 0.0f) {
+                            away = -away;
+                        }
+                    }
+                    //already in contact: only moves into the triangle are blocked, so the
+                    //capsule can always back out or slide off
+                    if (!(step == 0 && glm::dot(away, motion) >= -EPSILON * length)) {
+                        if (travelled < t) {
+                            t = travelled;
+                            normal = away;
+                            found = true;
+                        }
+                    }
+                    break;
+                }
+                travelled += (gap - 0.5f * CONTACT_SKIN) / length;
+                if (travelled >= t) {
+                    break;
+                }
+            }
+        }
+        return found;
+    }
+
+    float CharacterController::GetClearance(glm::vec3 position, const std::vector<glm::vec3>& triangles) const {
+        float best = 3.4e38f;
+        glm::vec3 bottom = position - glm::vec3(0.0f, height, 0.0f);
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            glm::vec3 onSegment, onTriangle;
+            best = std::min(best, ClosestSegmentTriangle(bottom, position, &triangles[i], onSegment, onTriangle));
+        }
+        return std::sqrt(best) - radius;
+    }
+
+    int CharacterController::getLastSlideCount() const {
+        return lastSlideCount;
+    }
+
+    size_t CharacterController::getLastTriangleCount() const {
+        return nearby.size() / 3;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef CharacterController_hpp
+#define CharacterController_hpp
+
+#include "TriangleKernels.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    //swept capsule controller over the collision triangles. The capsule hangs below the eye:
+    //its axis runs from position - height to position and is rounded by radius. A move is
+    //swept continuously, so it can't skip through thin geometry; on contact the rest of the
+    //motion slides along the surface, for at most maxSlides sweeps. Every sweep advances each
+    //triangle at most MAX_ADVANCE_STEPS times, which bounds the cost of a move.
+    class CharacterController {
+
+    public:
+        static const int MAX_ADVANCE_STEPS = 16;
+
+        CharacterController();
+
+        void setShape(float radius, float height);
+        void setMaxSlides(int maxSlides);
+
+        //the box around the capsule at position, e.g. for VoxelGrid::MoveBox
+        void GetBounds(glm::vec3 position, glm::vec3& boxMin, glm::vec3& boxMax) const;
+        //everything a move of up to |motion| from position can reach, for the broad phase query
+        void GetSweptBounds(glm::vec3 position, glm::vec3 motion, glm::vec3& boxMin, glm::vec3& boxMax) const;
+        //where the capsule at position ends up when moved by motion. triangles are consecutive
+        //vertex triples, those outside GetSweptBounds are skipped
+        glm::vec3 Move(glm::vec3 position, glm::vec3 motion, const std::vector<glm::vec3>& triangles);
+        //distance between the capsule surface and the nearest triangle, negative when they overlap
+        float GetClearance(glm::vec3 position, const std::vector<glm::vec3>& triangles) const;
+
+        int getLastSlideCount() const;
+        size_t getLastTriangleCount() const;
+
+    private:
+        float radius;
+        float height;
+        int maxSlides;
+        int lastSlideCount;
+        //triangles near the current move, filtered with TriangleKernels::OverlapBox
+        gps::TriangleBlocks blocks;
+        std::vector<uint32_t> hits;
+        std::vector<glm::vec3> nearby;
+
+        bool Sweep(glm::vec3 position, glm::vec3 motion, float& t, glm::vec3& normal) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include "ClusterCulling.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    ClusterCulling::ClusterCulling(glm::mat4 modelViewProjection, glm::vec3 cameraPosition) {
+        this->cameraPosition = cameraPosition;
+        //Gribb/Hartmann: rows of the matrix combined give the six clip planes
+        glm::vec4 row0(modelViewProjection[0][0], modelViewProjection[1][0], modelViewProjection[2][0], modelViewProjection[3][0]);
+        glm::vec4 row1(modelViewProjection[0][1], modelViewProjection[1][1], modelViewProjection[2][1], modelViewProjection[3][1]);
+        glm::vec4 row2(modelViewProjection[0][2], modelViewProjection[1][2], modelViewProjection[2][2], modelViewProjection[3][2]);
+        glm::vec4 row3(modelViewProjection[0][3], modelViewProjection[1][3], modelViewProjection[2][3], modelViewProjection[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+    }
+
+    bool ClusterCulling::IsVisible(const MeshCluster& cluster) const {
+        return IsInsideFrustum(cluster.minPoint, cluster.maxPoint) && !IsBackFacing(cluster);
+    }
+
+    bool ClusterCulling::IsInsideFrustum(glm::vec3 minPoint, glm::vec3 maxPoint) const {
+        for (int i = 0; i < 6; i++) {
+            //the box corner furthest along the plane normal
+            glm::vec3 corner(planes[i].x >= 0.0f ? maxPoint.x : minPoint.x,
+                planes[i].y >= 0.0f ? maxPoint.y : minPoint.y,
+                planes[i].z >= 0.0f ? maxPoint.z : minPoint.z);
+            if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ClusterCulling::IsBackFacing(const MeshCluster& cluster) const {
+        if (cluster.coneCutoff <= 0.0f) {
+            return false;
+        }
+        //every face is back facing when the view direction to the bounding sphere stays
+        //more than 90 degrees away from every normal in the cone, sphere radius included
+        glm::vec3 toCenter = cluster.sphereCenter - cameraPosition;
+        float distance = glm::length(toCenter);
+        if (distance <= cluster.sphereRadius) {
+            return false;
+        }
+        float cosTheta = glm::dot(toCenter, cluster.coneAxis) / distance;
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        float sinCone = std::sqrt(std::max(0.0f, 1.0f - cluster.coneCutoff * cluster.coneCutoff));
+        float cosSum = cosTheta * cluster.coneCutoff - sinTheta * sinCone;
+        return distance * cosSum >= cluster.sphereRadius;
+    }
+}
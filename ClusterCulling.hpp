@@ -0,0 +1,28 @@
+#ifndef ClusterCulling_hpp
+#define ClusterCulling_hpp
+
+#include "Mesh.hpp"
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    //frustum and normal cone tests for MeshCluster bounds. Both the matrix and the
+    //camera position are in the model's object space.
+    class ClusterCulling {
+
+    public:
+        ClusterCulling(glm::mat4 modelViewProjection, glm::vec3 cameraPosition);
+
+        bool IsVisible(const MeshCluster& cluster) const;
+        bool IsInsideFrustum(glm::vec3 minPoint, glm::vec3 maxPoint) const;
+        bool IsBackFacing(const MeshCluster& cluster) const;
+
+    private:
+        glm::vec4 planes[6];
+        glm::vec3 cameraPosition;
+    };
+
+}
+
+#endif
@@ -0,0 +1,373 @@
+#include "CollisionBenchmark.hpp"
+#include "CharacterController.hpp"
+#include "CollisionWorld.hpp"
+#include "VoxelGrid.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+namespace gps {
+
+    namespace {
+
+        const size_t QUERY_COUNT = 20000;
+        //the scan is linear in the map size, so it gets fewer queries
+        const size_t SCAN_QUERY_COUNT = 200;
+
+        //query centres on the geometry, deterministic so runs can be compared
+        std::vector<glm::vec3> MakeQueryCentres(const std::vector<glm::vec3>& triangles, size_t triangleCount, float reach) {
+            std::vector<glm::vec3> centres(QUERY_COUNT);
+            uint32_t state = 12345;
+            for (size_t i = 0; i < QUERY_COUNT; i++) {
+                state = state * 1664525u + 1013904223u;
+                size_t triangle = (size_t)(state >> 8) % triangleCount;
+                glm::vec3 jitter;
+                for (int axis = 0; axis < 3; axis++) {
+                    state = state * 1664525u + 1013904223u;
+                    jitter[axis] = ((state >> 8) / 16777215.0f * 2.0f - 1.0f) * reach;
+                }
+                centres[i] = (triangles[triangle * 3] + triangles[triangle * 3 + 1] + triangles[triangle * 3 + 2]) / 3.0f + jitter;
+            }
+            return centres;
+        }
+
+        size_t ScanQuery(const std::vector<glm::vec3>& triangles, size_t triangleCount, glm::vec3 boxMin, glm::vec3 boxMax) {
+            size_t hits = 0;
+            for (size_t i = 0; i < triangleCount; i++) {
+                const glm::vec3* v = &triangles[i * 3];
+                glm::vec3 minPoint = glm::min(v[0], glm::min(v[1], v[2]));
+                glm::vec3 maxPoint = glm::max(v[0], glm::max(v[1], v[2]));
+                if (minPoint.x <= boxMax.x && maxPoint.x >= boxMin.x && minPoint.y <= boxMax.y && maxPoint.y >= boxMin.y &&
+                    minPoint.z <= boxMax.z && maxPoint.z >= boxMin.z) {
+                    hits++;
+                }
+            }
+            return hits;
+        }
+
+        //nearest hit over every triangle, the reference for the ray queries
+        float ScanRay(const std::vector<glm::vec3>& triangles, const Ray& ray) {
+            glm::vec3 direction = glm::normalize(ray.direction);
+            float best = ray.maxDistance;
+            bool found = false;
+            for (size_t i = 0; i < triangles.size(); i += 3) {
+                float t;
+                if (IntersectRayTriangle(ray.origin, direction, &triangles[i], t) && t <= best) {
+                    best = t;
+                    found = true;
+                }
+            }
+            return found ? best : -1.0f;
+        }
+
+        double Microseconds(std::chrono::high_resolution_clock::time_point start) {
+            return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+    }
+
+    void CollisionBenchmark::Run(const std::vector<glm::vec3>& triangles, float reach) {
+        size_t totalTriangles = triangles.size() / 3;
+        if (totalTriangles == 0) {
+            printf("no triangles to collide with\n");
+            return;
+        }
+        glm::vec3 extent(reach);
+
+        //growing prefixes of the triangle list show how the query cost scales with map size
+        const CollisionBackend backends[] = { COLLISION_BVH, COLLISION_HASH };
+        for (size_t fraction = 4; fraction >= 1; fraction /= 2) {
+            size_t triangleCount = std::max((size_t)1, totalTriangles / fraction);
+            std::vector<glm::vec3> subset(triangles.begin(), triangles.begin() + triangleCount * 3);
+            std::vector<glm::vec3> centres = MakeQueryCentres(subset, triangleCount, reach);
+
+            std::vector<size_t> scanHits(SCAN_QUERY_COUNT);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < SCAN_QUERY_COUNT; i++) {
+                scanHits[i] = ScanQuery(subset, triangleCount, centres[i] - extent, centres[i] + extent);
+            }
+            double scanTime = Microseconds(start) / SCAN_QUERY_COUNT;
+            printf("%zu triangles, scan %.2f us/query\n", triangleCount, scanTime);
+
+            for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+                gps::CollisionWorld world;
+                world.setBackend(backends[b]);
+                start = std::chrono::high_resolution_clock::now();
+                world.Build(subset);
+                double buildTime = Microseconds(start) / 1000.0;
+
+                std::vector<glm::vec3> candidates;
+                size_t candidateTotal = 0;
+                size_t mismatches = 0;
+                start = std::chrono::high_resolution_clock::now();
+                for (size_t i = 0; i < QUERY_COUNT; i++) {
+                    candidates.clear();
+                    world.Query(centres[i] - extent, centres[i] + extent, candidates);
+                    candidateTotal += candidates.size() / 3;
+                    if (i < SCAN_QUERY_COUNT && candidates.size() / 3 != scanHits[i]) {
+                        mismatches++;
+                    }
+                }
+                double queryTime = Microseconds(start) / QUERY_COUNT;
+
+                printf("  %-5s build %9.2f ms   %8zu KB   %8.3f us/query   %7.1f candidates   %zu mismatches\n",
+                    gps::CollisionWorld::GetBackendName(backends[b]), buildTime, world.getMemoryBytes() / 1024, queryTime,
+                    (double)candidateTotal / QUERY_COUNT, mismatches);
+            }
+            if (fraction == 1) {
+                break;
+            }
+        }
+    }
+
+    void CollisionBenchmark::RunController(const std::vector<glm::vec3>& triangles, float frameMotion) {
+        size_t triangleCount = triangles.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+        gps::CollisionWorld world;
+        world.Build(triangles);
+        gps::CharacterController controller;
+        std::vector<glm::vec3> starts = MakeQueryCentres(triangles, triangleCount, 1.0f);
+
+        printf("controller, %zu triangles\n", triangleCount);
+        printf("   motion   us/step   max us/step   slides/step   triangles/step   clear starts   penetrations\n");
+        const float scales[] = { 1.0f, 10.0f };
+        for (int s = 0; s < 2; s++) {
+            float length = frameMotion * scales[s];
+            uint32_t state = 777;
+            std::vector<glm::vec3> candidates;
+            double total = 0.0;
+            double worst = 0.0;
+            size_t slides = 0;
+            size_t nearby = 0;
+            size_t clearStarts = 0;
+            size_t penetrations = 0;
+            for (size_t i = 0; i < starts.size(); i++) {
+                glm::vec3 direction;
+                do {
+                    for (int axis = 0; axis < 3; axis++) {
+                        state = state * 1664525u + 1013904223u;
+                        direction[axis] = (state >> 8) / 16777215.0f * 2.0f - 1.0f;
+                    }
+                } while (glm::dot(direction, direction) < 0.01f);
+                glm::vec3 motion = glm::normalize(direction) * length;
+
+                auto start = std::chrono::high_resolution_clock::now();
+                glm::vec3 boxMin, boxMax;
+                controller.GetSweptBounds(starts[i], motion, boxMin, boxMax);
+                candidates.clear();
+                world.Query(boxMin, boxMax, candidates);
+                glm::vec3 end = controller.Move(starts[i], motion, candidates);
+                double elapsed = Microseconds(start);
+                total += elapsed;
+                worst = std::max(worst, elapsed);
+                slides += controller.getLastSlideCount();
+                nearby += controller.getLastTriangleCount();
+
+                //checked against every triangle the move could reach, outside the timing
+                if (controller.GetClearance(starts[i], candidates) > 0.0f) {
+                    clearStarts++;
+                    if (controller.GetClearance(end, candidates) < -1e-3f) {
+                        penetrations++;
+                    }
+                }
+            }
+            printf("%9.2f   %7.2f   %11.2f   %11.2f   %14.1f   %12zu   %12zu\n", length, total / starts.size(), worst,
+                (double)slides / starts.size(), (double)nearby / starts.size(), clearStarts, penetrations);
+        }
+    }
+
+    void CollisionBenchmark::RunRays(const std::vector<glm::vec3>& triangles) {
+        size_t triangleCount = triangles.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+        //rays from near the geometry in random directions, up to the distance a mob could see
+        const size_t rayCount = 200000;
+        const size_t checkedRays = 100;
+        const float rayLength = 64.0f;
+        std::vector<glm::vec3> origins = MakeQueryCentres(triangles, triangleCount, 2.0f);
+        std::vector<Ray> rays(rayCount);
+        std::vector<glm::vec3> segments(rayCount * 2);
+        uint32_t state = 4242;
+        for (size_t i = 0; i < rayCount; i++) {
+            glm::vec3 direction;
+            do {
+                for (int axis = 0; axis < 3; axis++) {
+                    state = state * 1664525u + 1013904223u;
+                    direction[axis] = (state >> 8) / 16777215.0f * 2.0f - 1.0f;
+                }
+            } while (glm::dot(direction, direction) < 0.01f);
+            rays[i].origin = origins[i % origins.size()];
+            rays[i].direction = glm::normalize(direction);
+            rays[i].maxDistance = rayLength;
+            segments[i * 2] = rays[i].origin;
+            segments[i * 2 + 1] = rays[i].origin + rays[i].direction * (rayLength * 0.25f);
+        }
+        std::vector<float> expected(checkedRays);
+        for (size_t i = 0; i < checkedRays; i++) {
+            expected[i] = ScanRay(triangles, rays[i]);
+        }
+
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        printf("rays, %zu triangles, %zu rays of up to %.0f units, %u threads\n", triangleCount, rayCount, rayLength, threadCount);
+        printf("  backend   1 thread Mrays/s   batch Mrays/s   segment batch Mrays/s   hits   mismatches\n");
+        const CollisionBackend backends[] = { COLLISION_BVH, COLLISION_HASH };
+        for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+            gps::CollisionWorld world;
+            world.setBackend(backends[b]);
+            world.Build(triangles);
+
+            size_t mismatches = 0;
+            size_t hitCount = 0;
+            RayHit hit;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < rayCount; i++) {
+                bool found = world.RayCast(rays[i].origin, rays[i].direction, rays[i].maxDistance, hit);
+                hitCount += found ? 1 : 0;
+                if (i < checkedRays && (found != (expected[i] >= 0.0f) || (found && std::fabs(hit.distance - expected[i]) > 1e-3f))) {
+                    mismatches++;
+                }
+            }
+            double single = rayCount / (Microseconds(start) / 1e6) / 1e6;
+
+            std::vector<RayHit> hits;
+            start = std::chrono::high_resolution_clock::now();
+            world.RayCastBatch(rays, hits, threadCount);
+            double batch = rayCount / (Microseconds(start) / 1e6) / 1e6;
+
+            std::vector<uint8_t> blocked;
+            start = std::chrono::high_resolution_clock::now();
+            world.SegmentBlockedBatch(segments, blocked, threadCount);
+            double segment = rayCount / (Microseconds(start) / 1e6) / 1e6;
+
+            printf("  %-7s   %16.2f   %13.2f   %21.2f   %3.0f%%   %10zu\n", gps::CollisionWorld::GetBackendName(backends[b]),
+                single, batch, segment, 100.0 * hitCount / rayCount, mismatches);
+        }
+    }
+
+    void CollisionBenchmark::RunVoxels(const std::vector<glm::vec3>& triangles, float frameMotion) {
+        size_t triangleCount = triangles.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+        auto buildStart = std::chrono::high_resolution_clock::now();
+        gps::VoxelGrid grid;
+        grid.Build(triangles);
+        double buildTime = Microseconds(buildStart) / 1000.0;
+        printf("voxel grid, %zu triangles, built in %.1f ms\n", triangleCount, buildTime);
+        grid.PrintSummary();
+        if (grid.isEmpty()) {
+            return;
+        }
+
+        gps::CollisionWorld world;
+        world.Build(triangles);
+        gps::CollisionWorld fallback;
+        fallback.Build(grid.getFallbackTriangles());
+        printf("triangle structure %.1f KB, over the fallback triangles %.1f KB\n", world.getMemoryBytes() / 1024.0, fallback.getMemoryBytes() / 1024.0);
+        gps::CharacterController controller;
+        std::vector<glm::vec3> starts = MakeQueryCentres(triangles, triangleCount, 1.0f);
+
+        printf("   motion   triangles us/step   grid us/step   grid + fallback us/step   clear starts   penetrations\n");
+        const float scales[] = { 1.0f, 10.0f };
+        for (int s = 0; s < 2; s++) {
+            float length = frameMotion * scales[s];
+            uint32_t state = 777;
+            std::vector<glm::vec3> candidates;
+            double trianglesTotal = 0.0;
+            double gridTotal = 0.0;
+            double combinedTotal = 0.0;
+            size_t clearStarts = 0;
+            size_t penetrations = 0;
+            for (size_t i = 0; i < starts.size(); i++) {
+                glm::vec3 direction;
+                do {
+                    for (int axis = 0; axis < 3; axis++) {
+                        state = state * 1664525u + 1013904223u;
+                        direction[axis] = (state >> 8) / 16777215.0f * 2.0f - 1.0f;
+                    }
+                } while (glm::dot(direction, direction) < 0.01f);
+                glm::vec3 motion = glm::normalize(direction) * length;
+
+                auto start = std::chrono::high_resolution_clock::now();
+                glm::vec3 boxMin, boxMax;
+                controller.GetSweptBounds(starts[i], motion, boxMin, boxMax);
+                candidates.clear();
+                world.Query(boxMin, boxMax, candidates);
+                controller.Move(starts[i], motion, candidates);
+                trianglesTotal += Microseconds(start);
+
+                start = std::chrono::high_resolution_clock::now();
+                glm::vec3 playerMin, playerMax;
+                controller.GetBounds(starts[i], playerMin, playerMax);
+                glm::vec3 clipped = grid.MoveBox(playerMin, playerMax, motion);
+                gridTotal += Microseconds(start);
+
+                start = std::chrono::high_resolution_clock::now();
+                clipped = grid.MoveBox(playerMin, playerMax, motion);
+                controller.GetSweptBounds(starts[i], clipped, boxMin, boxMax);
+                candidates.clear();
+                fallback.Query(boxMin, boxMax, candidates);
+                controller.Move(starts[i], clipped, candidates);
+                combinedTotal += Microseconds(start);
+
+                if (!grid.OverlapsBox(playerMin, playerMax)) {
+                    clearStarts++;
+                    if (grid.OverlapsBox(playerMin + clipped, playerMax + clipped)) {
+                        penetrations++;
+                    }
+                }
+            }
+            printf("%9.2f   %17.2f   %12.2f   %23.2f   %12zu   %12zu\n", length, trianglesTotal / starts.size(), gridTotal / starts.size(),
+                combinedTotal / starts.size(), clearStarts, penetrations);
+        }
+
+        //rays from just in front of the faces, against every triangle and against the blocks plus
+        //the fallback triangles, which must agree
+        fallback.setBlocks(&grid);
+        const size_t rayCount = 20000;
+        const float rayLength = 16.0f;
+        uint32_t state = 4242;
+        size_t rayTested = 0;
+        size_t rayHits = 0;
+        size_t rayMismatches = 0;
+        double trianglesTime = 0.0;
+        double blocksTime = 0.0;
+        for (size_t i = 0; i < rayCount; i++) {
+            state = state * 1664525u + 1013904223u;
+            const glm::vec3* v = &triangles[(size_t)(state >> 8) % triangleCount * 3];
+            glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+            if (!(glm::length(normal) > 0.0f)) {
+                continue;
+            }
+            glm::vec3 origin = (v[0] + v[1] + v[2]) / 3.0f + glm::normalize(normal) * 0.25f;
+            glm::vec3 direction;
+            do {
+                for (int axis = 0; axis < 3; axis++) {
+                    state = state * 1664525u + 1013904223u;
+                    direction[axis] = (state >> 8) / 16777215.0f * 2.0f - 1.0f;
+                }
+            } while (glm::dot(direction, direction) < 0.01f);
+
+            RayHit expected, actual;
+            auto start = std::chrono::high_resolution_clock::now();
+            bool expectedHit = world.RayCast(origin, direction, rayLength, expected);
+            trianglesTime += Microseconds(start);
+            start = std::chrono::high_resolution_clock::now();
+            bool actualHit = fallback.RayCast(origin, direction, rayLength, actual);
+            blocksTime += Microseconds(start);
+            rayTested++;
+            rayHits += expectedHit ? 1 : 0;
+            if (expectedHit != actualHit || std::fabs(expected.distance - actual.distance) > 1e-3f) {
+                rayMismatches++;
+            }
+        }
+        printf("rays of up to %.0f units: every triangle %.2f Mrays/s, blocks + fallback triangles %.2f Mrays/s, %zu of %zu hit, %zu mismatches\n",
+            rayLength, rayTested / trianglesTime, rayTested / blocksTime, rayHits, rayTested, rayMismatches);
+    }
+}
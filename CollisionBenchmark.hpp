@@ -0,0 +1,33 @@
+#ifndef CollisionBenchmark_hpp
+#define CollisionBenchmark_hpp
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    //compares the collision backends on one triangle set: build time, memory and the latency of
+    //candidate queries around points on the geometry, against scanning every triangle's bounds.
+    //reach is the half extent of the query box, the same one processMovement uses
+    class CollisionBenchmark {
+
+    public:
+        static void Run(const std::vector<glm::vec3>& triangles, float reach);
+        //per step cost of the swept capsule controller (broad phase query included) for random
+        //moves of frameMotion and of 10 x frameMotion, and how many moves that started clear
+        //of the geometry ended inside it
+        static void RunController(const std::vector<glm::vec3>& triangles, float frameMotion);
+        //rays per second of RayCast on one thread, of RayCastBatch and SegmentBlockedBatch on
+        //every core, for each backend, and the rays whose hit differs from testing every triangle
+        static void RunRays(const std::vector<glm::vec3>& triangles);
+        //voxel grid build time and footprint, then the per step cost of random moves of
+        //frameMotion and 10 x frameMotion clipped against the blocks, alone and with the capsule
+        //swept over the fallback triangles, next to the capsule over every triangle, and how many
+        //moves that started clear of the blocks ended in one
+        static void RunVoxels(const std::vector<glm::vec3>& triangles, float frameMotion);
+    };
+
+}
+
+#endif
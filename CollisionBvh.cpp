@@ -0,0 +1,303 @@
+#include "CollisionBvh.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+
+        const int BVH_BIN_COUNT = 16;
+        //ranges this small become leaves without evaluating a split
+        const size_t BVH_MIN_LEAF_SIZE = 2;
+        //a leaf is kept over a split that costs more, up to this many triangles
+        const size_t BVH_MAX_LEAF_SIZE = 8;
+        //the traversal stack in Query holds at most one entry per level
+        const int BVH_MAX_DEPTH = 60;
+
+        float SurfaceArea(glm::vec3 minPoint, glm::vec3 maxPoint) {
+            glm::vec3 extent = glm::max(maxPoint - minPoint, glm::vec3(0.0f));
+            return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+        }
+
+        //entry distance of the ray into the box, false when it misses it within maxDistance
+        inline bool RayEntersBox(glm::vec3 origin, glm::vec3 inverseDirection, glm::vec3 minPoint, glm::vec3 maxPoint, float maxDistance, float& entry) {
+            glm::vec3 t1 = (minPoint - origin) * inverseDirection;
+            glm::vec3 t2 = (maxPoint - origin) * inverseDirection;
+            glm::vec3 nearest = glm::min(t1, t2);
+            glm::vec3 farthest = glm::max(t1, t2);
+            entry = std::max(std::max(nearest.x, nearest.y), std::max(nearest.z, 0.0f));
+            float exit = std::min(std::min(farthest.x, farthest.y), std::min(farthest.z, maxDistance));
+            return entry <= exit;
+        }
+
+        inline bool Overlaps(glm::vec3 minA, glm::vec3 maxA, glm::vec3 minB, glm::vec3 maxB) {
+            return minA.x <= maxB.x && maxA.x >= minB.x && minA.y <= maxB.y && maxA.y >= minB.y && minA.z <= maxB.z && maxA.z >= minB.z;
+        }
+
+        struct Bin {
+            glm::vec3 minPoint;
+            glm::vec3 maxPoint;
+            size_t count;
+        };
+    }
+
+    void CollisionBvh::Build(const std::vector<glm::vec3>& triangles) {
+        Clear();
+        size_t triangleCount = triangles.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        std::vector<BuildTriangle> build(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++) {
+            const glm::vec3* v = &triangles[i * 3];
+            build[i].minPoint = glm::min(v[0], glm::min(v[1], v[2]));
+            build[i].maxPoint = glm::max(v[0], glm::max(v[1], v[2]));
+            build[i].centroid = (build[i].minPoint + build[i].maxPoint) * 0.5f;
+            build[i].index = (uint32_t)i;
+        }
+
+        nodes.reserve(triangleCount * 2 / BVH_MIN_LEAF_SIZE);
+        nodes.push_back(Node());
+        BuildNode(build, 0, 0, triangleCount, 0);
+        nodes.shrink_to_fit();
+
+        vertices.resize(triangleCount * 3);
+        triangleIds.resize(triangleCount);
+        for (size_t i = 0; i < triangleCount; i++) {
+            triangleIds[i] = build[i].index;
+            const glm::vec3* v = &triangles[(size_t)build[i].index * 3];
+            vertices[i * 3] = v[0];
+            vertices[i * 3 + 1] = v[1];
+            vertices[i * 3 + 2] = v[2];
+        }
+    }
+
+    void CollisionBvh::BuildNode(std::vector<BuildTriangle>& build, uint32_t nodeIndex, size_t begin, size_t end, int depth) {
+        glm::vec3 minPoint(FLT_MAX);
+        glm::vec3 maxPoint(-FLT_MAX);
+        glm::vec3 centroidMin(FLT_MAX);
+        glm::vec3 centroidMax(-FLT_MAX);
+        for (size_t i = begin; i < end; i++) {
+            minPoint = glm::min(minPoint, build[i].minPoint);
+            maxPoint = glm::max(maxPoint, build[i].maxPoint);
+            centroidMin = glm::min(centroidMin, build[i].centroid);
+            centroidMax = glm::max(centroidMax, build[i].centroid);
+        }
+        nodes[nodeIndex].minPoint = minPoint;
+        nodes[nodeIndex].maxPoint = maxPoint;
+        nodes[nodeIndex].first = (uint32_t)begin;
+        nodes[nodeIndex].count = (uint32_t)(end - begin);
+
+        size_t count = end - begin;
+        if (count <= BVH_MIN_LEAF_SIZE || depth >= BVH_MAX_DEPTH) {
+            return;
+        }
+
+        //cheapest split plane between bins over all three axes
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f) {
+                continue;
+            }
+            float scale = BVH_BIN_COUNT / extent;
+            Bin bins[BVH_BIN_COUNT];
+            for (int b = 0; b < BVH_BIN_COUNT; b++) {
+                bins[b].minPoint = glm::vec3(FLT_MAX);
+                bins[b].maxPoint = glm::vec3(-FLT_MAX);
+                bins[b].count = 0;
+            }
+            for (size_t i = begin; i < end; i++) {
+                int b = std::min(BVH_BIN_COUNT - 1, (int)((build[i].centroid[axis] - centroidMin[axis]) * scale));
+                bins[b].minPoint = glm::min(bins[b].minPoint, build[i].minPoint);
+                bins[b].maxPoint = glm::max(bins[b].maxPoint, build[i].maxPoint);
+                bins[b].count++;
+            }
+
+            //areas and counts left of each plane, then swept from the right
+            float leftArea[BVH_BIN_COUNT - 1];
+            size_t leftCount[BVH_BIN_COUNT - 1];
+            glm::vec3 sweepMin(FLT_MAX);
+            glm::vec3 sweepMax(-FLT_MAX);
+            size_t sweepCount = 0;
+            for (int b = 0; b < BVH_BIN_COUNT - 1; b++) {
+                sweepMin = glm::min(sweepMin, bins[b].minPoint);
+                sweepMax = glm::max(sweepMax, bins[b].maxPoint);
+                sweepCount += bins[b].count;
+                leftArea[b] = sweepCount > 0 ? SurfaceArea(sweepMin, sweepMax) : 0.0f;
+                leftCount[b] = sweepCount;
+            }
+            sweepMin = glm::vec3(FLT_MAX);
+            sweepMax = glm::vec3(-FLT_MAX);
+            sweepCount = 0;
+            for (int b = BVH_BIN_COUNT - 1; b > 0; b--) {
+                sweepMin = glm::min(sweepMin, bins[b].minPoint);
+                sweepMax = glm::max(sweepMax, bins[b].maxPoint);
+                sweepCount += bins[b].count;
+                if (sweepCount == 0 || leftCount[b - 1] == 0) {
+                    continue;
+                }
+                float cost = leftArea[b - 1] * leftCount[b - 1] + SurfaceArea(sweepMin, sweepMax) * sweepCount;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        //splitting pays for itself when the children cost less than testing every triangle here
+        float leafCost = SurfaceArea(minPoint, maxPoint) * count;
+        if (count <= BVH_MAX_LEAF_SIZE && (bestAxis < 0 || bestCost >= leafCost)) {
+            return;
+        }
+
+        size_t middle = begin;
+        if (bestAxis >= 0) {
+            float scale = BVH_BIN_COUNT / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+            float axisMin = centroidMin[bestAxis];
+            middle = std::partition(build.begin() + begin, build.begin() + end, [&](const BuildTriangle& triangle) {
+                return std::min(BVH_BIN_COUNT - 1, (int)((triangle.centroid[bestAxis] - axisMin) * scale)) < bestSplit;
+            }) - build.begin();
+        }
+        if (middle == begin || middle == end) {
+            //all centroids coincide, halve the range so the leaves stay small
+            int axis = std::max(bestAxis, 0);
+            middle = begin + count / 2;
+            std::nth_element(build.begin() + begin, build.begin() + middle, build.begin() + end,
+                [axis](const BuildTriangle& a, const BuildTriangle& b) { return a.centroid[axis] < b.centroid[axis]; });
+        }
+
+        uint32_t left = (uint32_t)nodes.size();
+        nodes.push_back(Node());
+        BuildNode(build, left, begin, middle, depth + 1);
+        uint32_t right = (uint32_t)nodes.size();
+        nodes.push_back(Node());
+        BuildNode(build, right, middle, end, depth + 1);
+        nodes[nodeIndex].first = right;
+        nodes[nodeIndex].count = 0;
+    }
+
+    void CollisionBvh::Clear() {
+        std::vector<Node>().swap(nodes);
+        std::vector<glm::vec3>().swap(vertices);
+        std::vector<uint32_t>().swap(triangleIds);
+    }
+
+    void CollisionBvh::Query(glm::vec3 boxMin, glm::vec3 boxMax, std::vector<glm::vec3>& candidates) const {
+        if (nodes.empty()) {
+            return;
+        }
+        uint32_t stack[BVH_MAX_DEPTH + 2];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            uint32_t nodeIndex = stack[--top];
+            const Node& node = nodes[nodeIndex];
+            if (!Overlaps(node.minPoint, node.maxPoint, boxMin, boxMax)) {
+                continue;
+            }
+            if (node.count == 0) {
+                stack[top++] = node.first;
+                stack[top++] = nodeIndex + 1;
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                const glm::vec3* v = &vertices[(size_t)i * 3];
+                if (Overlaps(glm::min(v[0], glm::min(v[1], v[2])), glm::max(v[0], glm::max(v[1], v[2])), boxMin, boxMax)) {
+                    candidates.insert(candidates.end(), v, v + 3);
+                }
+            }
+        }
+    }
+
+    bool CollisionBvh::RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, bool anyHit, RayHit& hit) const {
+        if (nodes.empty()) {
+            return false;
+        }
+        //a zero component gets a huge finite inverse, so the slab test never sees 0 * inf
+        glm::vec3 inverseDirection;
+        for (int axis = 0; axis < 3; axis++) {
+            float component = std::fabs(direction[axis]) < 1e-20f ? 1e-20f : direction[axis];
+            inverseDirection[axis] = 1.0f / component;
+        }
+
+        float best = maxDistance;
+        uint32_t bestTriangle = RAY_MISS;
+        //nodes wait with their entry distance, those beyond a hit found meanwhile are skipped
+        struct Pending {
+            uint32_t node;
+            float entry;
+        };
+        Pending stack[BVH_MAX_DEPTH + 2];
+        int top = 0;
+        float entry;
+        if (!RayEntersBox(origin, inverseDirection, nodes[0].minPoint, nodes[0].maxPoint, best, entry)) {
+            return false;
+        }
+        stack[top].node = 0;
+        stack[top++].entry = entry;
+        while (top > 0) {
+            Pending pending = stack[--top];
+            if (pending.entry > best) {
+                continue;
+            }
+            const Node& node = nodes[pending.node];
+            if (node.count == 0) {
+                //nearer child on top, so a hit in it can cull the farther one
+                uint32_t children[2] = { pending.node + 1, node.first };
+                float entries[2];
+                bool hits[2];
+                for (int c = 0; c < 2; c++) {
+                    hits[c] = RayEntersBox(origin, inverseDirection, nodes[children[c]].minPoint, nodes[children[c]].maxPoint, best, entries[c]);
+                }
+                int nearer = entries[1] < entries[0] ? 1 : 0;
+                int order[2] = { 1 - nearer, nearer };
+                for (int c = 0; c < 2; c++) {
+                    if (hits[order[c]]) {
+                        stack[top].node = children[order[c]];
+                        stack[top++].entry = entries[order[c]];
+                    }
+                }
+                continue;
+            }
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                float t;
+                if (IntersectRayTriangle(origin, direction, &vertices[(size_t)i * 3], t) && t <= best) {
+                    best = t;
+                    bestTriangle = i;
+                    if (anyHit) {
+                        top = 0;
+                        break;
+                    }
+                }
+            }
+        }
+        if (bestTriangle == RAY_MISS) {
+            return false;
+        }
+        FillRayHit(origin, direction, &vertices[(size_t)bestTriangle * 3], best, triangleIds[bestTriangle], hit);
+        return true;
+    }
+
+    bool CollisionBvh::isEmpty() const {
+        return nodes.empty();
+    }
+
+    size_t CollisionBvh::getTriangleCount() const {
+        return vertices.size() / 3;
+    }
+
+    size_t CollisionBvh::getNodeCount() const {
+        return nodes.size();
+    }
+
+    size_t CollisionBvh::getMemoryBytes() const {
+        return nodes.capacity() * sizeof(Node) + vertices.capacity() * sizeof(glm::vec3) + triangleIds.capacity() * sizeof(uint32_t);
+    }
+}
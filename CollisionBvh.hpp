@@ -0,0 +1,61 @@
+#ifndef CollisionBvh_hpp
+#define CollisionBvh_hpp
+
+#include "CollisionRay.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    //bounding volume hierarchy over the collision triangles, built top down with the surface
+    //area heuristic over binned centroids. Triangles are stored in leaf order, so a query copies
+    //short contiguous runs into the candidate list that Camera::move tests.
+    class CollisionBvh {
+
+    public:
+        //triangles are consecutive vertex triples, as returned by Model3D::GetTriangles
+        void Build(const std::vector<glm::vec3>& triangles);
+        void Clear();
+        //appends the three vertices of every triangle whose bounds overlap the box
+        void Query(glm::vec3 boxMin, glm::vec3 boxMax, std::vector<glm::vec3>& candidates) const;
+        //nearest triangle along a normalized direction within maxDistance. With anyHit the
+        //first triangle found is returned instead, which is all a visibility test needs
+        bool RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, bool anyHit, RayHit& hit) const;
+
+        bool isEmpty() const;
+        size_t getTriangleCount() const;
+        size_t getNodeCount() const;
+        size_t getMemoryBytes() const;
+
+    private:
+        struct Node {
+            glm::vec3 minPoint;
+            //leaves: first triangle. Interior nodes: right child, the left one is the next node
+            uint32_t first;
+            glm::vec3 maxPoint;
+            //0 for interior nodes
+            uint32_t count;
+        };
+
+        struct BuildTriangle {
+            glm::vec3 minPoint;
+            glm::vec3 maxPoint;
+            glm::vec3 centroid;
+            uint32_t index;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<glm::vec3> vertices;
+        //index in the Build input of each triangle in leaf order
+        std::vector<uint32_t> triangleIds;
+
+        void BuildNode(std::vector<BuildTriangle>& build, uint32_t nodeIndex, size_t begin, size_t end, int depth);
+    };
+
+}
+
+#endif
@@ -0,0 +1,242 @@
+#include "CollisionHash.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+
+        //triangles covering more cells than this go to the oversized list (e.g. large ground quads)
+        const int64_t HASH_MAX_CELLS_PER_TRIANGLE = 64;
+
+        inline bool Overlaps(glm::vec3 minA, glm::vec3 maxA, glm::vec3 minB, glm::vec3 maxB) {
+            return minA.x <= maxB.x && maxA.x >= minB.x && minA.y <= maxB.y && maxA.y >= minB.y && minA.z <= maxB.z && maxA.z >= minB.z;
+        }
+
+        int64_t CellCount(glm::ivec3 minCell, glm::ivec3 maxCell) {
+            return (int64_t)(maxCell.x - minCell.x + 1) * (maxCell.y - minCell.y + 1) * (maxCell.z - minCell.z + 1);
+        }
+    }
+
+    CollisionHash::CollisionHash() {
+        setCellSize(COLLISION_HASH_CELL_SIZE);
+        bucketMask = 0;
+    }
+
+    void CollisionHash::setCellSize(float cellSize) {
+        this->cellSize = cellSize;
+        this->inverseCellSize = 1.0f / cellSize;
+    }
+
+    glm::ivec3 CollisionHash::CellOf(glm::vec3 point) const {
+        return glm::ivec3((int)std::floor(point.x * inverseCellSize), (int)std::floor(point.y * inverseCellSize), (int)std::floor(point.z * inverseCellSize));
+    }
+
+    uint32_t CollisionHash::BucketOf(glm::ivec3 cell) const {
+        uint32_t hash = (uint32_t)cell.x * 73856093u ^ (uint32_t)cell.y * 19349663u ^ (uint32_t)cell.z * 83492791u;
+        return hash & bucketMask;
+    }
+
+    void CollisionHash::Build(const std::vector<glm::vec3>& triangles) {
+        Clear();
+        size_t triangleCount = triangles.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+        vertices = triangles;
+        boundsMin = glm::vec3(FLT_MAX);
+        boundsMax = glm::vec3(-FLT_MAX);
+        for (size_t i = 0; i < vertices.size(); i++) {
+            boundsMin = glm::min(boundsMin, vertices[i]);
+            boundsMax = glm::max(boundsMax, vertices[i]);
+        }
+
+        //about one bucket per triangle keeps the chains short without sizing to the occupied cells
+        uint32_t bucketCount = 1024;
+        while (bucketCount < triangleCount && bucketCount < (1u << 30)) {
+            bucketCount <<= 1;
+        }
+        bucketMask = bucketCount - 1;
+        bucketStart.assign((size_t)bucketCount + 1, 0);
+
+        //counting pass, then a prefix sum turns the counts into list offsets
+        std::vector<glm::ivec3> cellRanges(triangleCount * 2);
+        for (size_t i = 0; i < triangleCount; i++) {
+            const glm::vec3* v = &vertices[i * 3];
+            glm::ivec3 minCell = CellOf(glm::min(v[0], glm::min(v[1], v[2])));
+            glm::ivec3 maxCell = CellOf(glm::max(v[0], glm::max(v[1], v[2])));
+            cellRanges[i * 2] = minCell;
+            cellRanges[i * 2 + 1] = maxCell;
+            if (CellCount(minCell, maxCell) > HASH_MAX_CELLS_PER_TRIANGLE) {
+                oversizedTriangles.push_back((uint32_t)i);
+                continue;
+            }
+            for (int z = minCell.z; z <= maxCell.z; z++) {
+                for (int y = minCell.y; y <= maxCell.y; y++) {
+                    for (int x = minCell.x; x <= maxCell.x; x++) {
+                        bucketStart[BucketOf(glm::ivec3(x, y, z)) + 1]++;
+                    }
+                }
+            }
+        }
+        for (uint32_t b = 0; b < bucketCount; b++) {
+            bucketStart[b + 1] += bucketStart[b];
+        }
+
+        bucketTriangles.resize(bucketStart[bucketCount]);
+        std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+        size_t oversized = 0;
+        for (size_t i = 0; i < triangleCount; i++) {
+            if (oversized < oversizedTriangles.size() && oversizedTriangles[oversized] == i) {
+                oversized++;
+                continue;
+            }
+            glm::ivec3 minCell = cellRanges[i * 2];
+            glm::ivec3 maxCell = cellRanges[i * 2 + 1];
+            for (int z = minCell.z; z <= maxCell.z; z++) {
+                for (int y = minCell.y; y <= maxCell.y; y++) {
+                    for (int x = minCell.x; x <= maxCell.x; x++) {
+                        bucketTriangles[fill[BucketOf(glm::ivec3(x, y, z))]++] = (uint32_t)i;
+                    }
+                }
+            }
+        }
+    }
+
+    void CollisionHash::Clear() {
+        bucketMask = 0;
+        std::vector<uint32_t>().swap(bucketStart);
+        std::vector<uint32_t>().swap(bucketTriangles);
+        std::vector<uint32_t>().swap(oversizedTriangles);
+        std::vector<glm::vec3>().swap(vertices);
+    }
+
+    void CollisionHash::Query(glm::vec3 boxMin, glm::vec3 boxMax, std::vector<glm::vec3>& candidates) const {
+        if (vertices.empty()) {
+            return;
+        }
+        glm::ivec3 minCell = CellOf(boxMin);
+        glm::ivec3 maxCell = CellOf(boxMax);
+        for (int z = minCell.z; z <= maxCell.z; z++) {
+            for (int y = minCell.y; y <= maxCell.y; y++) {
+                for (int x = minCell.x; x <= maxCell.x; x++) {
+                    glm::ivec3 cell(x, y, z);
+                    uint32_t bucket = BucketOf(cell);
+                    for (uint32_t entry = bucketStart[bucket]; entry < bucketStart[bucket + 1]; entry++) {
+                        const glm::vec3* v = &vertices[(size_t)bucketTriangles[entry] * 3];
+                        glm::vec3 triangleMin = glm::min(v[0], glm::min(v[1], v[2]));
+                        glm::vec3 triangleMax = glm::max(v[0], glm::max(v[1], v[2]));
+                        if (!Overlaps(triangleMin, triangleMax, boxMin, boxMax)) {
+                            continue;
+                        }
+                        //a triangle in several queried cells (or in a bucket shared by another
+                        //cell) is reported only from the first cell it shares with the box
+                        if (glm::max(CellOf(triangleMin), minCell) != cell) {
+                            continue;
+                        }
+                        candidates.insert(candidates.end(), v, v + 3);
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < oversizedTriangles.size(); i++) {
+            const glm::vec3* v = &vertices[(size_t)oversizedTriangles[i] * 3];
+            if (Overlaps(glm::min(v[0], glm::min(v[1], v[2])), glm::max(v[0], glm::max(v[1], v[2])), boxMin, boxMax)) {
+                candidates.insert(candidates.end(), v, v + 3);
+            }
+        }
+    }
+
+    bool CollisionHash::RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, bool anyHit, RayHit& hit) const {
+        if (vertices.empty()) {
+            return false;
+        }
+        float best = maxDistance;
+        uint32_t bestTriangle = RAY_MISS;
+        for (size_t i = 0; i < oversizedTriangles.size() && !(anyHit && bestTriangle != RAY_MISS); i++) {
+            float t;
+            if (IntersectRayTriangle(origin, direction, &vertices[(size_t)oversizedTriangles[i] * 3], t) && t <= best) {
+                best = t;
+                bestTriangle = oversizedTriangles[i];
+            }
+        }
+
+        //the part of the ray inside the triangles' bounds
+        float enter = 0.0f;
+        float exit = best;
+        glm::vec3 inverseDirection;
+        for (int axis = 0; axis < 3; axis++) {
+            float component = std::fabs(direction[axis]) < 1e-20f ? 1e-20f : direction[axis];
+            inverseDirection[axis] = 1.0f / component;
+            float t1 = (boundsMin[axis] - origin[axis]) * inverseDirection[axis];
+            float t2 = (boundsMax[axis] - origin[axis]) * inverseDirection[axis];
+            enter = std::max(enter, std::min(t1, t2));
+            exit = std::min(exit, std::max(t1, t2));
+        }
+
+        if (enter <= exit && !(anyHit && bestTriangle != RAY_MISS)) {
+            glm::ivec3 cell = CellOf(origin + direction * enter);
+            glm::ivec3 firstCell = CellOf(boundsMin);
+            glm::ivec3 lastCell = CellOf(boundsMax);
+            glm::ivec3 step;
+            glm::vec3 nextBoundary;
+            glm::vec3 cellDistance;
+            for (int axis = 0; axis < 3; axis++) {
+                step[axis] = direction[axis] > 0.0f ? 1 : (direction[axis] < 0.0f ? -1 : 0);
+                if (step[axis] == 0) {
+                    nextBoundary[axis] = FLT_MAX;
+                    cellDistance[axis] = FLT_MAX;
+                    continue;
+                }
+                float boundary = (cell[axis] + (step[axis] > 0 ? 1 : 0)) * cellSize;
+                nextBoundary[axis] = (boundary - origin[axis]) * inverseDirection[axis];
+                cellDistance[axis] = cellSize * std::fabs(inverseDirection[axis]);
+            }
+
+            //a triangle hit at t lies in a cell the ray enters before t, so the walk can stop
+            //at the first cell starting beyond the nearest hit
+            float cellEnter = enter;
+            while (cellEnter <= best && cellEnter <= exit) {
+                uint32_t bucket = BucketOf(cell);
+                for (uint32_t entry = bucketStart[bucket]; entry < bucketStart[bucket + 1]; entry++) {
+                    float t;
+                    if (IntersectRayTriangle(origin, direction, &vertices[(size_t)bucketTriangles[entry] * 3], t) && t <= best) {
+                        best = t;
+                        bestTriangle = bucketTriangles[entry];
+                    }
+                }
+                if (anyHit && bestTriangle != RAY_MISS) {
+                    break;
+                }
+                int axis = nextBoundary.x < nextBoundary.y ? (nextBoundary.x < nextBoundary.z ? 0 : 2) : (nextBoundary.y < nextBoundary.z ? 1 : 2);
+                cellEnter = nextBoundary[axis];
+                nextBoundary[axis] += cellDistance[axis];
+                cell[axis] += step[axis];
+                if (cell[axis] < firstCell[axis] || cell[axis] > lastCell[axis]) {
+                    break;
+                }
+            }
+        }
+
+        if (bestTriangle == RAY_MISS) {
+            return false;
+        }
+        FillRayHit(origin, direction, &vertices[(size_t)bestTriangle * 3], best, bestTriangle, hit);
+        return true;
+    }
+
+    bool CollisionHash::isEmpty() const {
+        return vertices.empty();
+    }
+
+    size_t CollisionHash::getTriangleCount() const {
+        return vertices.size() / 3;
+    }
+
+    size_t CollisionHash::getMemoryBytes() const {
+        return (bucketStart.capacity() + bucketTriangles.capacity() + oversizedTriangles.capacity()) * sizeof(uint32_t) +
+            vertices.capacity() * sizeof(glm::vec3);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef CollisionHash_hpp
+#define CollisionHash_hpp
+
+#include "CollisionRay.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    //two map blocks per cell: the camera's per-frame reach then touches 2-3 cells per axis
+    const float COLLISION_HASH_CELL_SIZE = 2.0f;
+
+    //uniform grid over the collision triangles, hashed into a fixed bucket table stored as
+    //offsets + triangle lists. A triangle is listed in every cell its bounds touch; triangles
+    //spanning too many cells are kept apart and tested by every query instead.
+    class CollisionHash {
+
+    public:
+        CollisionHash();
+
+        void setCellSize(float cellSize);
+        //triangles are consecutive vertex triples, as returned by Model3D::GetTriangles
+        void Build(const std::vector<glm::vec3>& triangles);
+        void Clear();
+        //appends the three vertices of every triangle whose bounds overlap the box, once each
+        void Query(glm::vec3 boxMin, glm::vec3 boxMax, std::vector<glm::vec3>& candidates) const;
+        //walks the cells along the ray (Amanatides-Woo) inside the bounds of the triangles,
+        //same contract as CollisionBvh::RayCast
+        bool RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, bool anyHit, RayHit& hit) const;
+
+        bool isEmpty() const;
+        size_t getTriangleCount() const;
+        size_t getMemoryBytes() const;
+
+    private:
+        float cellSize;
+        float inverseCellSize;
+        uint32_t bucketMask;
+        //bucketStart[b]..bucketStart[b + 1] index into bucketTriangles
+        std::vector<uint32_t> bucketStart;
+        std::vector<uint32_t> bucketTriangles;
+        std::vector<uint32_t> oversizedTriangles;
+        std::vector<glm::vec3> vertices;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+
+        glm::ivec3 CellOf(glm::vec3 point) const;
+        uint32_t BucketOf(glm::ivec3 cell) const;
+    };
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef CollisionRay_hpp
+#define CollisionRay_hpp
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+namespace gps {
+
+    //triangle of a RayHit that hit nothing
+    const uint32_t RAY_MISS = 0xFFFFFFFFu;
+    //triangle of a RayHit on a block of a VoxelGrid
+    const uint32_t RAY_BLOCK = 0xFFFFFFFEu;
+
+    struct Ray {
+        glm::vec3 origin;
+        //need not be normalized, distances are in world units either way
+        glm::vec3 direction;
+        float maxDistance;
+    };
+
+    struct RayHit {
+        float distance;
+        //index into the triangles the collision structure was built from, RAY_MISS for none,
+        //RAY_BLOCK for a voxel grid block
+        uint32_t triangle;
+        glm::vec3 position;
+        //geometric normal of the triangle, facing the ray
+        glm::vec3 normal;
+    };
+
+    //Moller-Trumbore against both faces, t along a normalized direction
+    inline bool IntersectRayTriangle(glm::vec3 origin, glm::vec3 direction, const glm::vec3* v, float& t) {
+        glm::vec3 e1 = v[1] - v[0];
+        glm::vec3 e2 = v[2] - v[0];
+        glm::vec3 h = glm::cross(direction, e2);
+        float determinant = glm::dot(e1, h);
+        if (std::fabs(determinant) < 1e-12f) {
+            return false;
+        }
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = origin - v[0];
+        float u = inverse * glm::dot(s, h);
+        if (u < 0.0f || u > 1.0f) {
+            return false;
+        }
+        glm::vec3 q = glm::cross(s, e1);
+        float w = inverse * glm::dot(direction, q);
+        if (w < 0.0f || u + w > 1.0f) {
+            return false;
+        }
+        t = inverse * glm::dot(e2, q);
+        return t >= 0.0f;
+    }
+
+    //what a ray that hit nothing reports: its end, no triangle, no normal
+    inline void FillRayMiss(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) {
+        hit.distance = maxDistance;
+        hit.triangle = RAY_MISS;
+        hit.position = origin + direction * maxDistance;
+        hit.normal = glm::vec3(0.0f);
+    }
+
+    inline void FillRayHit(glm::vec3 origin, glm::vec3 direction, const glm::vec3* v, float t, uint32_t triangle, RayHit& hit) {
+        hit.distance = t;
+        hit.triangle = triangle;
+        hit.position = origin + direction * t;
+        glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+        float length = glm::length(normal);
+        hit.normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        if (glm::dot(hit.normal, direction) > 0.0f) {
+            hit.normal = -hit.normal;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include "CollisionWorld.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace gps {
+
+    namespace {
+
+        //rays handed to a thread at a time, their cost varies too much for a static split
+        const size_t RAY_BATCH_CHUNK = 256;
+        //kept out of segment ends so the surfaces they lie on don't block them
+        const float SEGMENT_END_EPSILON = 1e-3f;
+
+        template <class Function>
+        void ParallelFor(size_t count, unsigned int threadCount, Function function) {
+            if (threadCount == 0) {
+                threadCount = std::max(1u, std::thread::hardware_concurrency());
+            }
+            size_t chunkCount = (count + RAY_BATCH_CHUNK - 1) / RAY_BATCH_CHUNK;
+            threadCount = (unsigned int)std::min((size_t)threadCount, chunkCount);
+            std::atomic<size_t> nextChunk(0);
+            auto worker = [&]() {
+                for (size_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) {
+                    function(chunk * RAY_BATCH_CHUNK, std::min(count, (chunk + 1) * RAY_BATCH_CHUNK));
+                }
+            };
+            std::vector<std::thread> threads;
+            for (unsigned int i = 1; i < threadCount; i++) {
+                threads.push_back(std::thread(worker));
+            }
+            worker();
+            for (size_t i = 0; i < threads.size(); i++) {
+                threads[i].join();
+            }
+        }
+    }
+
+    CollisionWorld::CollisionWorld() {
+        backend = COLLISION_BVH;
+        blocks = nullptr;
+    }
+
+    void CollisionWorld::setBlocks(const gps::VoxelGrid* blocks) {
+        this->blocks = blocks;
+    }
+
+    void CollisionWorld::setBackend(CollisionBackend backend) {
+        this->backend = backend;
+    }
+
+    CollisionBackend CollisionWorld::getBackend() const {
+        return backend;
+    }
+
+    const char* CollisionWorld::GetBackendName(CollisionBackend backend) {
+        return backend == COLLISION_HASH ? "hash" : "bvh";
+    }
+
+    bool CollisionWorld::ParseBackend(std::string name, CollisionBackend& backend) {
+        if (name == "bvh") {
+            backend = COLLISION_BVH;
+            return true;
+        }
+        if (name == "hash") {
+            backend = COLLISION_HASH;
+            return true;
+        }
+        return false;
+    }
+
+    void CollisionWorld::Build(const std::vector<glm::vec3>& triangles) {
+        Clear();
+        if (backend == COLLISION_HASH) {
+            hash.Build(triangles);
+        }
+        else {
+            bvh.Build(triangles);
+        }
+    }
+
+    void CollisionWorld::Clear() {
+        bvh.Clear();
+        hash.Clear();
+    }
+
+    void CollisionWorld::Query(glm::vec3 boxMin, glm::vec3 boxMax, std::vector<glm::vec3>& candidates) const {
+        if (backend == COLLISION_HASH) {
+            hash.Query(boxMin, boxMax, candidates);
+        }
+        else {
+            bvh.Query(boxMin, boxMax, candidates);
+        }
+    }
+
+    bool CollisionWorld::RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) const {
+        float length = glm::length(direction);
+        if (length <= 0.0f) {
+            FillRayMiss(origin, glm::vec3(0.0f), maxDistance, hit);
+            return false;
+        }
+        direction /= length;
+        bool found = backend == COLLISION_HASH ? hash.RayCast(origin, direction, maxDistance, false, hit) :
+            bvh.RayCast(origin, direction, maxDistance, false, hit);
+        RayHit blockHit;
+        if (blocks && blocks->RayCast(origin, direction, found ? hit.distance : maxDistance, blockHit)) {
+            hit = blockHit;
+            found = true;
+        }
+        if (!found) {
+            FillRayMiss(origin, direction, maxDistance, hit);
+        }
+        return found;
+    }
+
+    bool CollisionWorld::SegmentBlocked(glm::vec3 a, glm::vec3 b) const {
+        glm::vec3 direction = b - a;
+        float length = glm::length(direction);
+        if (length <= 2.0f * SEGMENT_END_EPSILON) {
+            return false;
+        }
+        direction /= length;
+        glm::vec3 origin = a + direction * SEGMENT_END_EPSILON;
+        float maxDistance = length - 2.0f * SEGMENT_END_EPSILON;
+        RayHit hit;
+        if (blocks && blocks->RayCast(origin, direction, maxDistance, hit)) {
+            return true;
+        }
+        if (backend == COLLISION_HASH) {
+            return hash.RayCast(origin, direction, maxDistance, true, hit);
+        }
+        return bvh.RayCast(origin, direction, maxDistance, true, hit);
+    }
+
+    void CollisionWorld::RayCastBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits, unsigned int threadCount) const {
+        hits.resize(rays.size());
+        ParallelFor(rays.size(), threadCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                RayCast(rays[i].origin, rays[i].direction, rays[i].maxDistance, hits[i]);
+            }
+        });
+    }
+
+    void CollisionWorld::SegmentBlockedBatch(const std::vector<glm::vec3>& segments, std::vector<uint8_t>& blocked, unsigned int threadCount) const {
+        blocked.resize(segments.size() / 2);
+        ParallelFor(blocked.size(), threadCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                blocked[i] = SegmentBlocked(segments[i * 2], segments[i * 2 + 1]) ? 1 : 0;
+            }
+        });
+    }
+
+    bool CollisionWorld::isEmpty() const {
+        return backend == COLLISION_HASH ? hash.isEmpty() : bvh.isEmpty();
+    }
+
+    size_t CollisionWorld::getMemoryBytes() const {
+        return bvh.getMemoryBytes() + hash.getMemoryBytes();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef CollisionWorld_hpp
+#define CollisionWorld_hpp
+
+#include "CollisionBvh.hpp"
+#include "CollisionHash.hpp"
+#include "VoxelGrid.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    enum CollisionBackend {
+        COLLISION_BVH,
+        COLLISION_HASH
+    };
+
+    //the map's collision triangles behind the broad phase picked at startup. When the map's
+    //blocks are kept in a VoxelGrid and only the rest is built here, setBlocks makes the ray
+    //queries see the blocks too
+    class CollisionWorld {
+
+    public:
+        CollisionWorld();
+
+        //takes effect on the next Build
+        void setBackend(CollisionBackend backend);
+        CollisionBackend getBackend() const;
+        static const char* GetBackendName(CollisionBackend backend);
+        //"bvh" or "hash", false for anything else
+        static bool ParseBackend(std::string name, CollisionBackend& backend);
+
+        void Build(const std::vector<glm::vec3>& triangles);
+        //the grid must outlive the world, nullptr for none
+        void setBlocks(const gps::VoxelGrid* blocks);
+        void Clear();
+        //appends the three vertices of every triangle whose bounds overlap the box
+        void Query(glm::vec3 boxMin, glm::vec3 boxMax, std::vector<glm::vec3>& candidates) const;
+
+        //nearest triangle or block the ray hits within maxDistance (block picking). On a miss hit is
+        //filled in with FillRayMiss
+        bool RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) const;
+        //true when a triangle or block lies between a and b (line of sight, light visibility).
+        //Triangles touching either end don't count, so a point on a surface can still see out
+        bool SegmentBlocked(glm::vec3 a, glm::vec3 b) const;
+        //the same for many queries at once, spread over threadCount threads (0 for every core).
+        //misses are filled in like RayCast's; segments are consecutive a, b pairs
+        void RayCastBatch(const std::vector<Ray>& rays, std::vector<RayHit>& hits, unsigned int threadCount) const;
+        void SegmentBlockedBatch(const std::vector<glm::vec3>& segments, std::vector<uint8_t>& blocked, unsigned int threadCount) const;
+
+        bool isEmpty() const;
+        size_t getMemoryBytes() const;
+
+    private:
+        CollisionBackend backend;
+        gps::CollisionBvh bvh;
+        gps::CollisionHash hash;
+        const gps::VoxelGrid* blocks;
+    };
+
+}
+
+#endif
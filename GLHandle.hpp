@@ -0,0 +1,106 @@
+#ifndef GLHandle_hpp
+#define GLHandle_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+namespace gps {
+
+    inline void DeleteGLBuffer(GLuint name) {
+        glDeleteBuffers(1, &name);
+    }
+
+    inline void DeleteGLVertexArray(GLuint name) {
+        glDeleteVertexArrays(1, &name);
+    }
+
+    inline void DeleteGLTexture(GLuint name) {
+        glDeleteTextures(1, &name);
+    }
+
+    inline void DeleteGLProgram(GLuint name) {
+        glDeleteProgram(name);
+    }
+
+    //sole owner of one GL object name, deleted when the handle goes out of scope.
+    //handles can only be moved; they convert to GLuint so they can be passed to gl* calls directly
+    template <void (*Delete)(GLuint)>
+    class GLHandle {
+
+    public:
+        GLHandle() : name(0) {
+        }
+
+        explicit GLHandle(GLuint name) : name(name) {
+        }
+
+        GLHandle(GLHandle&& other) noexcept : name(other.name) {
+            other.name = 0;
+        }
+
+        GLHandle& operator=(GLHandle&& other) noexcept {
+            if (this != &other) {
+                reset(other.name);
+                other.name = 0;
+            }
+            return *this;
+        }
+
+        ~GLHandle() {
+            reset(0);
+        }
+
+        operator GLuint() const {
+            return name;
+        }
+
+        GLuint get() const {
+            return name;
+        }
+
+        //deletes the owned object and takes ownership of newName
+        void reset(GLuint newName) {
+            if (name != 0) {
+                Delete(name);
+            }
+            name = newName;
+        }
+
+    private:
+        GLuint name;
+
+        GLHandle(const GLHandle&);
+        GLHandle& operator=(const GLHandle&);
+    };
+
+    typedef GLHandle<DeleteGLBuffer> GLBuffer;
+    typedef GLHandle<DeleteGLVertexArray> GLVertexArray;
+    typedef GLHandle<DeleteGLTexture> GLTexture;
+    typedef GLHandle<DeleteGLProgram> GLProgram;
+
+    inline GLBuffer CreateGLBuffer() {
+        GLuint name;
+        glGenBuffers(1, &name);
+        return GLBuffer(name);
+    }
+
+    inline GLVertexArray CreateGLVertexArray() {
+        GLuint name;
+        glGenVertexArrays(1, &name);
+        return GLVertexArray(name);
+    }
+
+    inline GLTexture CreateGLTexture() {
+        GLuint name;
+        glGenTextures(1, &name);
+        return GLTexture(name);
+    }
+
+}
+
+#endif
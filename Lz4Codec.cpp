@@ -0,0 +1,161 @@
+#include "Lz4Codec.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        const size_t MIN_MATCH = 4;
+        //the format requires the last 5 bytes to be literals and the last match to start 12 bytes before the end
+        const size_t LAST_LITERALS = 5;
+        const size_t MATCH_FIND_LIMIT = 12;
+        const size_t MAX_OFFSET = 65535;
+        const int HASH_BITS = 16;
+        const uint32_t NO_POSITION = 0xFFFFFFFF;
+
+        uint32_t Read32(const unsigned char* p) {
+            uint32_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        uint32_t HashSequence(uint32_t sequence) {
+            return (sequence * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        unsigned char* WriteLength(unsigned char* out, size_t length) {
+            while (length >= 255) {
+                *out++ = 255;
+                length -= 255;
+            }
+            *out++ = (unsigned char)length;
+            return out;
+        }
+
+        unsigned char* WriteSequence(unsigned char* out, const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength) {
+            unsigned char* token = out++;
+            *token = (unsigned char)((literalLength >= 15 ? 15 : literalLength) << 4);
+            if (literalLength >= 15) {
+                out = WriteLength(out, literalLength - 15);
+            }
+            if (literalLength > 0) {
+                memcpy(out, literals, literalLength);
+            }
+            out += literalLength;
+            if (matchLength == 0) {
+                return out;
+            }
+            *out++ = (unsigned char)(offset & 0xFF);
+            *out++ = (unsigned char)(offset >> 8);
+            size_t extra = matchLength - MIN_MATCH;
+            *token |= (unsigned char)(extra >= 15 ? 15 : extra);
+            if (extra >= 15) {
+                out = WriteLength(out, extra - 15);
+            }
+            return out;
+        }
+
+        bool ReadLength(const unsigned char* source, size_t sourceSize, size_t& position, size_t& length) {
+            unsigned char value;
+            do {
+                if (position >= sourceSize) {
+                    return false;
+                }
+                value = source[position++];
+                length += value;
+            } while (value == 255);
+            return true;
+        }
+    }
+
+    size_t Lz4Codec::GetMaxCompressedSize(size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    size_t Lz4Codec::Compress(const unsigned char* source, size_t size, unsigned char* destination) {
+        unsigned char* out = destination;
+        size_t anchor = 0;
+
+        if (size > MATCH_FIND_LIMIT) {
+            std::vector<uint32_t> table((size_t)1 << HASH_BITS, NO_POSITION);
+            size_t matchEnd = size - LAST_LITERALS;
+            size_t position = 0;
+            while (position + MATCH_FIND_LIMIT < size) {
+                uint32_t sequence = Read32(source + position);
+                uint32_t hash = HashSequence(sequence);
+                uint32_t candidate = table[hash];
+                table[hash] = (uint32_t)position;
+                if (candidate == NO_POSITION || position - candidate > MAX_OFFSET || Read32(source + candidate) != sequence) {
+                    position++;
+                    continue;
+                }
+                size_t length = MIN_MATCH;
+                while (position + length < matchEnd && source[candidate + length] == source[position + length]) {
+                    length++;
+                }
+                out = WriteSequence(out, source + anchor, position - anchor, position - candidate, length);
+                position += length;
+                anchor = position;
+            }
+        }
+
+        out = WriteSequence(out, source + anchor, size - anchor, 0, 0);
+        return (size_t)(out - destination);
+    }
+
+    bool Lz4Codec::Decompress(const unsigned char* source, size_t sourceSize, unsigned char* destination, size_t destinationSize) {
+        size_t in = 0;
+        size_t out = 0;
+        while (in < sourceSize) {
+            unsigned char token = source[in++];
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !ReadLength(source, sourceSize, in, literalLength)) {
+                return false;
+            }
+            if (literalLength > sourceSize - in || literalLength > destinationSize - out) {
+                return false;
+            }
+            if (literalLength > 0) {
+                memcpy(destination + out, source + in, literalLength);
+            }
+            in += literalLength;
+            out += literalLength;
+            if (in == sourceSize) {
+                break;
+            }
+
+            if (sourceSize - in < 2) {
+                return false;
+            }
+            size_t offset = (size_t)source[in] | ((size_t)source[in + 1] << 8);
+            in += 2;
+            if (offset == 0 || offset > out) {
+                return false;
+            }
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !ReadLength(source, sourceSize, in, matchLength)) {
+                return false;
+            }
+            matchLength += MIN_MATCH;
+            if (matchLength > destinationSize - out) {
+                return false;
+            }
+            //a match may overlap its own output, then it has to be copied forwards byte by byte
+            const unsigned char* match = destination + out - offset;
+            if (offset >= matchLength) {
+                memcpy(destination + out, match, matchLength);
+            }
+            else {
+                for (size_t i = 0; i < matchLength; i++) {
+                    destination[out + i] = match[i];
+                }
+            }
+            out += matchLength;
+        }
+        return out == destinationSize;
+    }
+}
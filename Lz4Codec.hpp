@@ -0,0 +1,22 @@
+#ifndef Lz4Codec_hpp
+#define Lz4Codec_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    //greedy compressor and bounds checked decompressor for the LZ4 block format
+    //(no frame header, the caller stores both sizes), used for AssetPack entries
+    class Lz4Codec {
+
+    public:
+        static size_t GetMaxCompressedSize(size_t size);
+        //destination must hold GetMaxCompressedSize(size) bytes, returns the compressed size
+        static size_t Compress(const unsigned char* source, size_t size, unsigned char* destination);
+        //false for corrupt input or when it does not expand to exactly destinationSize bytes
+        static bool Decompress(const unsigned char* source, size_t sourceSize, unsigned char* destination, size_t destinationSize);
+    };
+
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    //read-only memory mapping of a whole file
+    class MappedFile {
+
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        bool Open(std::string fileName);
+        void Close();
+
+        const unsigned char* getData() const;
+        size_t getSize() const;
+        //FNV-1a 64 over the mapped bytes
+        uint64_t Hash() const;
+        static uint64_t HashBytes(const unsigned char* bytes, size_t count);
+
+    private:
+        const unsigned char* data;
+        size_t size;
+
+#if defined (_WIN32)
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
+
+}
+
+#endif
@@ -1,33 +1,246 @@
 #include "Mesh.hpp"
+#include "VertexFormat.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
 namespace gps {
 
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	namespace {
+
+		const GLint UNRESOLVED_LOCATION = -2;
+
+		//locations of the uniforms a mesh draw sets, looked up on a program's first draw.
+		//programs live as long as the viewer, so their names are never reused
+		struct DrawUniforms {
+			GLint compactVertices;
+			GLint positionMin;
+			GLint positionExtent;
+			GLint instanced;
+			//every ivec2 <sampler>Layer of the program
+			std::vector<GLint> layers;
+			//indexed by TextureRegistry sampler, UNRESOLVED_LOCATION until first used
+			std::vector<GLint> samplers;
+			std::vector<GLint> samplerLayers;
+		};
+
+		//only touched on the GL thread
+		std::unordered_map<GLuint, DrawUniforms> drawUniforms;
+
+		DrawUniforms& GetDrawUniforms(GLuint program) {
+			auto found = drawUniforms.find(program);
+			if (found != drawUniforms.end()) {
+				return found->second;
+			}
+			DrawUniforms& uniforms = drawUniforms[program];
+			uniforms.compactVertices = glGetUniformLocation(program, "compactVertices");
+			uniforms.positionMin = glGetUniformLocation(program, "positionMin");
+			uniforms.positionExtent = glGetUniformLocation(program, "positionExtent");
+			uniforms.instanced = glGetUniformLocation(program, "instanced");
+			GLint count = 0;
+			glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+			for (GLint i = 0; i < count; i++) {
+				char name[256];
+				GLsizei length = 0;
+				GLint size = 0;
+				GLenum type = 0;
+				glGetActiveUniform(program, (GLuint)i, sizeof(name), &length, &size, &type, name);
+				std::string uniformName(name, length);
+				if (type == GL_INT_VEC2 && uniformName.size() > 5 && uniformName.compare(uniformName.size() - 5, 5, "Layer") == 0) {
+					uniforms.layers.push_back(glGetUniformLocation(program, name));
+				}
+			}
+			return uniforms;
+		}
+
+		//the sampler's own uniform, or its <sampler>Layer when layer is set
+		GLint GetSamplerLocation(DrawUniforms& uniforms, GLuint program, uint32_t sampler, bool layer) {
+			std::vector<GLint>& locations = layer ? uniforms.samplerLayers : uniforms.samplers;
+			if (sampler >= locations.size()) {
+				locations.resize(sampler + 1, UNRESOLVED_LOCATION);
+			}
+			if (locations[sampler] == UNRESOLVED_LOCATION) {
+				std::string name = TextureRegistry::Get().getSamplerName(sampler);
+				locations[sampler] = glGetUniformLocation(program, (layer ? name + "Layer" : name).c_str());
+			}
+			return locations[sampler];
+		}
+	}
+
+	bool Mesh::useCompactLayout = false;
 
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, bool deferUpload,
+		std::vector<GLuint> lodIndices, MeshResidency residency, glm::vec3 quantizationMin, glm::vec3 quantizationExtent) {
 
-		this->setupMesh();
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->lodIndices = std::move(lodIndices);
+		this->textures = std::move(textures);
+		this->residency = residency;
+		this->quantizationMin = quantizationMin;
+		this->quantizationExtent = quantizationExtent;
+		//a handle keeps its GL name for as long as the mesh holds it
+		for (size_t i = 0; i < this->textures.size(); i++) {
+			this->textures[i].textureId = TextureRegistry::Get().getTextureId(this->textures[i].handle);
+		}
+
+		this->setupMesh(deferUpload);
 	}
 
 	Buffers Mesh::getBuffers() {
-	    return this->buffers;
+	    Buffers names = { this->vao, this->vbo, this->ebo, this->instanceVbo };
+	    return names;
+	}
+
+	bool Mesh::UploadSlice(size_t maxBytes) {
+
+		if (this->uploaded) {
+			return true;
+		}
+
+		glBindVertexArray(this->vao);
+
+		//slices are whole vertices/indices, at least one per call so every call makes progress
+		if (this->uploadedVertices < this->vertices.size()) {
+			size_t count = std::min(std::max(maxBytes / getVertexSize(), (size_t)1), this->vertices.size() - this->uploadedVertices);
+			glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+			fillBuffer(GL_ARRAY_BUFFER, true, this->uploadedVertices, count);
+			this->uploadedVertices += count;
+			maxBytes -= std::min(maxBytes, count * getVertexSize());
+		}
+
+		if (maxBytes > 0 && this->uploadedIndices < getIndexCount()) {
+			size_t count = std::min(std::max(maxBytes / getIndexSize(), (size_t)1), getIndexCount() - this->uploadedIndices);
+			fillBuffer(GL_ELEMENT_ARRAY_BUFFER, false, this->uploadedIndices, count);
+			this->uploadedIndices += count;
+		}
+
+		glBindVertexArray(0);
+
+		this->uploaded = this->uploadedVertices == this->vertices.size() && this->uploadedIndices == getIndexCount();
+		if (this->uploaded) {
+			applyResidency();
+		}
+		return this->uploaded;
+	}
+
+	bool Mesh::isUploaded() {
+	    return this->uploaded;
 	}
 
-	void Mesh::Draw(gps::Shader shader)	{
+	void Mesh::SetInstances(std::vector<glm::mat4> instances) {
+
+		this->instances = std::move(instances);
+		if (this->instances.empty()) {
+			return;
+		}
+
+		glBindVertexArray(this->vao);
+
+		if (this->instanceVbo == 0) {
+			this->instanceVbo = CreateGLBuffer();
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, this->instanceVbo);
+		glBufferData(GL_ARRAY_BUFFER, this->instances.size() * sizeof(glm::mat4), this->instances.data(), GL_STATIC_DRAW);
+
+		//a mat4 attribute takes four consecutive locations, one per column
+		for (GLuint column = 0; column < 4; column++) {
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(3 + column, 1);
+		}
+
+		glBindVertexArray(0);
+	}
+
+	bool Mesh::isInstanced() {
+	    return !this->instances.empty();
+	}
+
+	void Mesh::Draw(gps::Shader& shader)	{
+
+		//streamed meshes stay invisible until all of their data is on the GPU
+		if (!this->uploaded) {
+			return;
+		}
+
+		bindDrawState(shader);
+		if (isInstanced()) {
+			glDrawElementsInstanced(GL_TRIANGLES, this->elementCount, this->indexType, 0, (GLsizei)this->instances.size());
+		}
+		else {
+			glDrawElements(GL_TRIANGLES, this->elementCount, this->indexType, 0);
+		}
+		unbindDrawState();
+	}
+
+	void Mesh::DrawClusters(gps::Shader& shader, const std::vector<GLuint>& clusterIds, const std::vector<GLuint>& lodLevels) {
+
+		if (!this->uploaded || clusterIds.empty()) {
+			return;
+		}
+
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+		std::vector<GLsizei> counts(clusterIds.size());
+		std::vector<const GLvoid*> offsets(clusterIds.size());
+		for (size_t i = 0; i < clusterIds.size(); i++) {
+			const MeshCluster& cluster = this->clusters[clusterIds[i]];
+			GLuint level = lodLevels.empty() ? 0 : std::min(lodLevels[i], cluster.lodCount);
+			GLuint firstIndex = level == 0 ? cluster.firstIndex : cluster.lodFirstIndex[level - 1];
+			counts[i] = (GLsizei)(level == 0 ? cluster.indexCount : cluster.lodIndexCount[level - 1]);
+			offsets[i] = (const GLvoid*)(firstIndex * indexSize);
+		}
+
+		bindDrawState(shader);
+		if (isInstanced()) {
+			//there is no instanced multi draw in GL 4.1
+			for (size_t i = 0; i < clusterIds.size(); i++) {
+				glDrawElementsInstanced(GL_TRIANGLES, counts[i], this->indexType, offsets[i], (GLsizei)this->instances.size());
+			}
+		}
+		else {
+			glMultiDrawElements(GL_TRIANGLES, counts.data(), this->indexType, offsets.data(), (GLsizei)clusterIds.size());
+		}
+		unbindDrawState();
+	}
+
+	void Mesh::bindDrawState(gps::Shader& shader) {
 
 		shader.useShaderProgram();
+		DrawUniforms& uniforms = GetDrawUniforms(shader.shaderProgram);
+
+		//<sampler>Layer selects the array and layer, x < 0 samples the 2D texture instead. Every
+		//one is reset first, so a sampler this mesh lacks doesn't keep the previous mesh's layer
+		for (size_t i = 0; i < uniforms.layers.size(); i++) {
+			glUniform2i(uniforms.layers[i], -1, -1);
+		}
 
 		//set textures
 		for (GLuint i = 0; i < textures.size(); i++) {
 
 			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			glUniform1i(GetSamplerLocation(uniforms, shader.shaderProgram, this->textures[i].sampler, false), i);
+			glBindTexture(GL_TEXTURE_2D, this->textures[i].textureId);
+		}
+		for (size_t i = 0; i < this->textureLayers.size(); i++) {
+			glUniform2i(GetSamplerLocation(uniforms, shader.shaderProgram, this->textureLayers[i].sampler, true),
+				(GLint)this->textureLayers[i].array, (GLint)this->textureLayers[i].layer);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
+		//compact meshes are decoded in the vertex shader
+		glUniform1i(uniforms.compactVertices, this->compact ? 1 : 0);
+		if (this->compact) {
+			glUniform3fv(uniforms.positionMin, 1, &this->quantizationMin[0]);
+			glUniform3fv(uniforms.positionExtent, 1, &this->quantizationExtent[0]);
+		}
+		glUniform1i(uniforms.instanced, isInstanced() ? 1 : 0);
+
+		glBindVertexArray(this->vao);
+	}
+
+	void Mesh::unbindDrawState() {
+
 		glBindVertexArray(0);
 
         for(GLuint i = 0; i < this->textures.size(); i++) {
@@ -35,34 +248,187 @@ namespace gps {
             glActiveTexture(GL_TEXTURE0 + i);
             glBindTexture(GL_TEXTURE_2D, 0);
         }
+	}
+
+	void Mesh::setupMesh(bool deferUpload) {
+
+		this->compact = useCompactLayout;
+		this->elementCount = (GLsizei)this->indices.size();
+		this->indexType = GL_UNSIGNED_INT;
+		if (this->compact) {
+			if (this->quantizationExtent.x <= 0.0f || this->quantizationExtent.y <= 0.0f || this->quantizationExtent.z <= 0.0f) {
+				VertexFormat::GetQuantizationBounds(this->vertices, this->quantizationMin, this->quantizationExtent);
+			}
+			if (VertexFormat::CanUseShortIndices(this->vertices.size())) {
+				this->indexType = GL_UNSIGNED_SHORT;
+			}
+		}
+
+		this->vao = CreateGLVertexArray();
+		this->vbo = CreateGLBuffer();
+		this->ebo = CreateGLBuffer();
 
-    }
+		glBindVertexArray(this->vao);
 
-	void Mesh::setupMesh() {
+		//storage is sized first, the data is then converted straight into the mapped buffers
+		glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+		glBufferData(GL_ARRAY_BUFFER, getVertexBufferSize(), NULL, GL_STATIC_DRAW);
 
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, getIndexBufferSize(), NULL, GL_STATIC_DRAW);
 
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
+		if (!deferUpload) {
+			fillBuffer(GL_ARRAY_BUFFER, true, 0, this->vertices.size());
+			fillBuffer(GL_ELEMENT_ARRAY_BUFFER, false, 0, getIndexCount());
+		}
+		this->uploadedVertices = deferUpload ? 0 : this->vertices.size();
+		this->uploadedIndices = deferUpload ? 0 : getIndexCount();
+		this->uploaded = !deferUpload;
 
-		glBindVertexArray(this->buffers.VAO);
+		if (this->compact) {
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, Position));
 
-		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, Normal));
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (GLvoid*)offsetof(CompactVertex, TexCoords));
+		}
+		else {
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
 
-	
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-	
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
 
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		}
 
 		glBindVertexArray(0);
+
+		if (this->uploaded) {
+			applyResidency();
+		}
+	}
+
+	size_t Mesh::getVertexBufferSize() {
+		return this->vertices.size() * getVertexSize();
 	}
+
+	size_t Mesh::getIndexBufferSize() {
+		return getIndexCount() * getIndexSize();
+	}
+
+	size_t Mesh::getVertexSize() {
+		return this->compact ? sizeof(CompactVertex) : sizeof(Vertex);
+	}
+
+	size_t Mesh::getIndexSize() {
+		return this->indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+	}
+
+	size_t Mesh::getIndexCount() {
+		//the index buffer holds the full detail indices followed by the simplified levels
+		return this->indices.size() + this->lodIndices.size();
+	}
+
+	void Mesh::writeVertices(unsigned char* destination, size_t first, size_t count) {
+		if (!this->compact) {
+			std::memcpy(destination, this->vertices.data() + first, count * sizeof(Vertex));
+			return;
+		}
+		CompactVertex* packed = (CompactVertex*)destination;
+		for (size_t i = 0; i < count; i++) {
+			CompactVertex vertex;
+			VertexFormat::PackVertex(this->vertices[first + i], this->quantizationMin, this->quantizationExtent, vertex);
+			std::memcpy(packed + i, &vertex, sizeof(vertex));
+		}
+	}
+
+	void Mesh::writeIndices(unsigned char* destination, size_t first, size_t count) {
+		size_t baseCount = this->indices.size();
+		if (this->indexType == GL_UNSIGNED_INT) {
+			size_t fromBase = first < baseCount ? std::min(count, baseCount - first) : 0;
+			if (fromBase > 0) {
+				std::memcpy(destination, this->indices.data() + first, fromBase * sizeof(GLuint));
+			}
+			if (count > fromBase) {
+				std::memcpy(destination + fromBase * sizeof(GLuint), this->lodIndices.data() + (first + fromBase - baseCount), (count - fromBase) * sizeof(GLuint));
+			}
+			return;
+		}
+		for (size_t i = 0; i < count; i++) {
+			size_t index = first + i;
+			uint16_t value = (uint16_t)(index < baseCount ? this->indices[index] : this->lodIndices[index - baseCount]);
+			std::memcpy(destination + i * sizeof(uint16_t), &value, sizeof(value));
+		}
+	}
+
+	void Mesh::fillBuffer(GLenum target, bool vertexData, size_t first, size_t count) {
+		size_t elementSize = vertexData ? getVertexSize() : getIndexSize();
+		GLintptr offset = (GLintptr)(first * elementSize);
+		GLsizeiptr bytes = (GLsizeiptr)(count * elementSize);
+		if (bytes == 0) {
+			return;
+		}
+		//the range has never been drawn from, so there is nothing to synchronize with
+		void* mapped = glMapBufferRange(target, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (mapped) {
+			if (vertexData) {
+				writeVertices((unsigned char*)mapped, first, count);
+			}
+			else {
+				writeIndices((unsigned char*)mapped, first, count);
+			}
+			if (glUnmapBuffer(target) == GL_TRUE) {
+				return;
+			}
+		}
+		//the mapping failed or its contents were lost, go through a staging copy instead
+		std::vector<unsigned char> staging((size_t)bytes);
+		if (vertexData) {
+			writeVertices(staging.data(), first, count);
+		}
+		else {
+			writeIndices(staging.data(), first, count);
+		}
+		glBufferSubData(target, offset, bytes, staging.data());
+	}
+
+	void Mesh::applyResidency() {
+
+		if (this->residency == RESIDENCY_FULL) {
+			return;
+		}
+		if (this->residency == RESIDENCY_POSITIONS) {
+			this->positions.resize(this->vertices.size());
+			for (size_t i = 0; i < this->vertices.size(); i++) {
+				this->positions[i] = this->vertices[i].Position;
+			}
+		}
+		else {
+			std::vector<GLuint>().swap(this->indices);
+		}
+		std::vector<Vertex>().swap(this->vertices);
+		std::vector<GLuint>().swap(this->lodIndices);
+	}
+
+	size_t Mesh::getResidentBytes() {
+		return this->vertices.capacity() * sizeof(Vertex) + this->positions.capacity() * sizeof(glm::vec3) +
+			(this->indices.capacity() + this->lodIndices.capacity()) * sizeof(GLuint);
+	}
+
+	size_t Mesh::GetResidentBytes(size_t vertexCount, size_t indexCount, size_t lodIndexCount, MeshResidency residency) {
+		switch (residency) {
+		case RESIDENCY_NONE:
+			return 0;
+		case RESIDENCY_POSITIONS:
+			return vertexCount * sizeof(glm::vec3) + indexCount * sizeof(GLuint);
+		default:
+			return vertexCount * sizeof(Vertex) + (indexCount + lodIndexCount) * sizeof(GLuint);
+		}
+	}
+
 }
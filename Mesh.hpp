@@ -11,7 +11,9 @@
 
 #include <glm/glm.hpp>
 
+#include "GLHandle.hpp"
 #include "Shader.hpp"
+#include "TextureRegistry.hpp"
 
 #include <string>
 #include <vector>
@@ -26,10 +28,25 @@ namespace gps {
         glm::vec2 TexCoords;
     };
 
+    //a registry texture bound to a sampler uniform, see TextureRegistry
     struct Texture {
 
-        GLuint id;
-       
+        TextureHandle handle;
+        uint32_t sampler;
+        //the handle's GL name, resolved when the mesh is created so draws don't lock the registry
+        GLuint textureId;
+    };
+
+    //a layer of one of the model's texture arrays bound to a sampler uniform, see TextureArraySet
+    struct TextureArrayLayer {
+
+        uint32_t array;
+        uint32_t layer;
+        uint32_t sampler;
+    };
+
+    struct TextureInfo {
+
         std::string type;
         std::string path;
     };
@@ -39,31 +56,143 @@ namespace gps {
         glm::vec3 ambient;
         glm::vec3 diffuse;
         glm::vec3 specular;
+        std::vector<TextureInfo> textures;
+    };
+
+    //detail levels per cluster, level 0 being the cluster's own index range
+    const int MESH_LOD_COUNT = 4;
+
+    //contiguous, spatially coherent range of a mesh's index buffer, see MeshOptimizer::BuildClusters
+    struct MeshCluster {
+
+        GLuint firstIndex;
+        GLuint indexCount;
+        glm::vec3 minPoint;
+        glm::vec3 maxPoint;
+        glm::vec3 sphereCenter;
+        float sphereRadius;
+        glm::vec3 coneAxis;
+        //cosine of the normal cone half angle, <= 0 when the cone is too wide to cull with
+        float coneCutoff;
+        //simplified levels 1..lodCount, their indices follow MeshData::indices in the index buffer.
+        //lodError bounds the object space distance of the level from level 0, see MeshSimplifier
+        GLuint lodCount;
+        GLuint lodFirstIndex[MESH_LOD_COUNT - 1];
+        GLuint lodIndexCount[MESH_LOD_COUNT - 1];
+        float lodError[MESH_LOD_COUNT - 1];
+    };
+
+    //cpu side geometry of a mesh, before it is uploaded
+    struct MeshData {
+
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+        std::vector<GLuint> lodIndices;
+        std::vector<MeshCluster> clusters;
+        //node transforms of a mesh referenced by several FBX nodes, empty when it is drawn once
+        std::vector<glm::mat4> instances;
+        int materialId;
+        glm::vec3 minPoint;
+        glm::vec3 maxPoint;
+    };
+
+    //what a mesh keeps on the CPU once its buffers are filled
+    enum MeshResidency {
+        RESIDENCY_NONE,
+        //positions and indices, enough for GetTriangles
+        RESIDENCY_POSITIONS,
+        RESIDENCY_FULL
     };
 
+    //names of a mesh's GL objects, owned by the mesh
     struct Buffers {
         GLuint VAO;
         GLuint VBO;
         GLuint EBO;
+        //per instance model matrices, 0 for meshes drawn once
+        GLuint instanceVBO;
     };
 
     class Mesh {
 
     public:
+        //emptied after the upload unless the residency keeps them, see MeshResidency
         std::vector<Vertex> vertices;
+        std::vector<glm::vec3> positions;
         std::vector<GLuint> indices;
+        std::vector<GLuint> lodIndices;
         std::vector<Texture> textures;
-
-	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+        //the arrays themselves are bound once per model draw
+        std::vector<TextureArrayLayer> textureLayers;
+        std::vector<MeshCluster> clusters;
+        std::vector<glm::mat4> instances;
+        glm::vec3 minPoint;
+        glm::vec3 maxPoint;
+
+        //meshes created while this is set use the 16 byte CompactVertex layout
+        //and 16-bit indices when they have fewer than 65536 vertices
+        static bool useCompactLayout;
+
+	    //compact meshes quantize their positions inside quantizationMin + [0, quantizationExtent], a zero
+	    //extent means the mesh's own bounds. Meshes that share edges must share the bounds
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, bool deferUpload = false,
+	        std::vector<GLuint> lodIndices = std::vector<GLuint>(), MeshResidency residency = RESIDENCY_FULL,
+	        glm::vec3 quantizationMin = glm::vec3(0.0f), glm::vec3 quantizationExtent = glm::vec3(0.0f));
+	    //meshes own their buffers, so they can be moved but not copied
+	    Mesh(Mesh&& other) = default;
+	    Mesh& operator=(Mesh&& other) = default;
 
 	    Buffers getBuffers();
 
-	    void Draw(gps::Shader shader);
+	    //writes at most maxBytes of the deferred vertex/index data into the buffers, returns true once complete
+	    bool UploadSlice(size_t maxBytes);
+	    bool isUploaded();
 
-    private:
-        Buffers buffers;
+	    //uploads one model matrix per instance, after this every draw call is instanced
+	    void SetInstances(std::vector<glm::mat4> instances);
+	    bool isInstanced();
+
+	    //bytes of geometry held on the CPU right now
+	    size_t getResidentBytes();
+	    //bytes a mesh of this size keeps after its upload under the given policy
+	    static size_t GetResidentBytes(size_t vertexCount, size_t indexCount, size_t lodIndexCount, MeshResidency residency);
 
-	    void setupMesh();
+	    void Draw(gps::Shader& shader);
+	    //draws only the listed entries of clusters with a single glMultiDrawElements,
+	    //lodLevels holds the detail level of every listed cluster or is empty for full detail
+	    void DrawClusters(gps::Shader& shader, const std::vector<GLuint>& clusterIds, const std::vector<GLuint>& lodLevels);
+
+    private:
+        GLVertexArray vao;
+        GLBuffer vbo;
+        GLBuffer ebo;
+        GLBuffer instanceVbo;
+        size_t uploadedVertices;
+        size_t uploadedIndices;
+        bool uploaded;
+        bool compact;
+        MeshResidency residency;
+        GLsizei elementCount;
+        GLenum indexType;
+        glm::vec3 quantizationMin;
+        glm::vec3 quantizationExtent;
+
+	    void setupMesh(bool deferUpload);
+	    void bindDrawState(gps::Shader& shader);
+	    void unbindDrawState();
+	    size_t getVertexBufferSize();
+	    size_t getIndexBufferSize();
+	    size_t getVertexSize();
+	    size_t getIndexSize();
+	    size_t getIndexCount();
+	    //converts vertices/indices [first, first + count) to the GPU layout straight into destination
+	    void writeVertices(unsigned char* destination, size_t first, size_t count);
+	    void writeIndices(unsigned char* destination, size_t first, size_t count);
+	    void fillBuffer(GLenum target, bool vertexData, size_t first, size_t count);
+	    void applyResidency();
+
+	    Mesh(const Mesh&);
+	    Mesh& operator=(const Mesh&);
 
     };
 
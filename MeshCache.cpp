@@ -0,0 +1,313 @@
+#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+#include "VirtualFile.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        const char MESH_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+        const uint32_t MESH_CACHE_VERSION = 11;
+        //stamp size of a dependency that did not exist when the cache was written
+        const uint64_t MISSING_DEPENDENCY = ~0ULL;
+
+        struct CacheHeader {
+            char magic[4];
+            uint32_t version;
+            uint64_t sourceSize;
+            int64_t sourceTime;
+            uint64_t sourceHash;
+            uint32_t materialCount;
+            uint32_t meshCount;
+            uint32_t dependencyCount;
+        };
+
+        //a file the parse read besides the source, such as an obj's material library
+        struct CacheDependency {
+            uint64_t size;
+            int64_t time;
+            uint64_t hash;
+        };
+
+        struct CacheMesh {
+            int32_t materialId;
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t lodIndexCount;
+            uint32_t clusterCount;
+            uint32_t instanceCount;
+            float minPoint[3];
+            float maxPoint[3];
+        };
+
+        //bounds checked cursor over the mapped cache
+        struct CacheReader {
+            const unsigned char* data;
+            size_t size;
+            size_t offset;
+
+            bool Read(void* destination, size_t bytes) {
+                if (bytes > size - offset) {
+                    return false;
+                }
+                memcpy(destination, data + offset, bytes);
+                offset += bytes;
+                return true;
+            }
+
+            bool ReadString(std::string& value) {
+                uint32_t length;
+                if (!Read(&length, sizeof(length)) || length > size - offset) {
+                    return false;
+                }
+                value.assign((const char*)data + offset, length);
+                offset += length;
+                return true;
+            }
+        };
+
+        //a corrupt index would make every later pass read past the vertices
+        bool IndicesInRange(const std::vector<GLuint>& indices, uint32_t vertexCount) {
+            for (size_t i = 0; i < indices.size(); i++) {
+                if (indices[i] >= vertexCount) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void WriteString(std::ofstream& out, const std::string& value) {
+            uint32_t length = (uint32_t)value.size();
+            out.write((const char*)&length, sizeof(length));
+            out.write(value.data(), length);
+        }
+    }
+
+    std::string MeshCache::GetCachePath(std::string sourceFile) {
+        return sourceFile + ".cache";
+    }
+
+    bool MeshCache::GetSourceStamp(std::string sourceFile, uint64_t& size, int64_t& time) {
+        return gps::VirtualFile::GetStamp(sourceFile, size, time);
+    }
+
+    uint64_t MeshCache::HashFile(std::string sourceFile) {
+        uint64_t hash;
+        if (!gps::VirtualFile::GetHash(sourceFile, hash)) {
+            return 0;
+        }
+        return hash;
+    }
+
+    bool MeshCache::Load(std::string sourceFile, std::vector<gps::MeshData>& meshes, std::vector<gps::Material>& materials) {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!GetSourceStamp(sourceFile, sourceSize, sourceTime)) {
+            return false;
+        }
+
+        std::string cachePath = GetCachePath(sourceFile);
+        gps::MappedFile cacheFile;
+        if (!cacheFile.Open(cachePath)) {
+            return false;
+        }
+
+        CacheReader reader = { cacheFile.getData(), cacheFile.getSize(), 0 };
+        CacheHeader header;
+        if (!reader.Read(&header, sizeof(header)) ||
+            memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MESH_CACHE_VERSION ||
+            header.sourceSize != sourceSize ||
+            header.materialCount > cacheFile.getSize() ||
+            header.meshCount > cacheFile.getSize() ||
+            header.dependencyCount > cacheFile.getSize()) {
+            return false;
+        }
+
+        bool touched = false;
+        if (header.sourceTime != sourceTime) {
+            //the timestamp moved, only the contents decide if the cache is stale
+            if (HashFile(sourceFile) != header.sourceHash) {
+                return false;
+            }
+            touched = true;
+        }
+
+        //same checks as the source. A moved timestamp with unchanged contents is not written
+        //back here, material libraries are small enough to hash again on the next load
+        for (uint32_t i = 0; i < header.dependencyCount; i++) {
+            std::string path;
+            CacheDependency dependency;
+            if (!reader.ReadString(path) || !reader.Read(&dependency, sizeof(dependency))) {
+                return false;
+            }
+            uint64_t size;
+            int64_t time;
+            if (!GetSourceStamp(path, size, time)) {
+                if (dependency.size != MISSING_DEPENDENCY) {
+                    return false;
+                }
+                continue;
+            }
+            if (size != dependency.size || (time != dependency.time && HashFile(path) != dependency.hash)) {
+                return false;
+            }
+        }
+
+        std::vector<gps::Material> cachedMaterials(header.materialCount);
+        for (uint32_t i = 0; i < header.materialCount; i++) {
+            gps::Material& material = cachedMaterials[i];
+            uint32_t textureCount;
+            if (!reader.Read(&material.ambient, sizeof(glm::vec3)) ||
+                !reader.Read(&material.diffuse, sizeof(glm::vec3)) ||
+                !reader.Read(&material.specular, sizeof(glm::vec3)) ||
+                !reader.Read(&textureCount, sizeof(textureCount))) {
+                return false;
+            }
+            material.textures.resize(textureCount);
+            for (uint32_t t = 0; t < textureCount; t++) {
+                if (!reader.ReadString(material.textures[t].type) || !reader.ReadString(material.textures[t].path)) {
+                    return false;
+                }
+            }
+        }
+
+        std::vector<gps::MeshData> cachedMeshes(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            gps::MeshData& mesh = cachedMeshes[i];
+            CacheMesh info;
+            if (!reader.Read(&info, sizeof(info)) ||
+                info.vertexCount > (reader.size - reader.offset) / sizeof(gps::Vertex) ||
+                info.indexCount > (reader.size - reader.offset) / sizeof(GLuint) ||
+                info.lodIndexCount > (reader.size - reader.offset) / sizeof(GLuint) ||
+                info.clusterCount > (reader.size - reader.offset) / sizeof(gps::MeshCluster) ||
+                info.instanceCount > (reader.size - reader.offset) / sizeof(glm::mat4) ||
+                info.materialId < -1 || info.materialId >= (int32_t)header.materialCount) {
+                return false;
+            }
+            mesh.materialId = info.materialId;
+            mesh.minPoint = glm::vec3(info.minPoint[0], info.minPoint[1], info.minPoint[2]);
+            mesh.maxPoint = glm::vec3(info.maxPoint[0], info.maxPoint[1], info.maxPoint[2]);
+            mesh.vertices.resize(info.vertexCount);
+            mesh.indices.resize(info.indexCount);
+            mesh.lodIndices.resize(info.lodIndexCount);
+            mesh.clusters.resize(info.clusterCount);
+            mesh.instances.resize(info.instanceCount);
+            if (!reader.Read(mesh.vertices.data(), info.vertexCount * sizeof(gps::Vertex)) ||
+                !reader.Read(mesh.indices.data(), info.indexCount * sizeof(GLuint)) ||
+                !reader.Read(mesh.lodIndices.data(), info.lodIndexCount * sizeof(GLuint)) ||
+                !reader.Read(mesh.clusters.data(), info.clusterCount * sizeof(gps::MeshCluster)) ||
+                !reader.Read(mesh.instances.data(), info.instanceCount * sizeof(glm::mat4)) ||
+                !IndicesInRange(mesh.indices, info.vertexCount) ||
+                !IndicesInRange(mesh.lodIndices, info.vertexCount)) {
+                return false;
+            }
+            uint32_t totalIndices = info.indexCount + info.lodIndexCount;
+            for (uint32_t c = 0; c < info.clusterCount; c++) {
+                const gps::MeshCluster& cluster = mesh.clusters[c];
+                if (cluster.firstIndex > info.indexCount || cluster.indexCount > info.indexCount - cluster.firstIndex ||
+                    cluster.lodCount >= (GLuint)gps::MESH_LOD_COUNT) {
+                    return false;
+                }
+                for (GLuint level = 0; level < cluster.lodCount; level++) {
+                    if (cluster.lodFirstIndex[level] > totalIndices || cluster.lodIndexCount[level] > totalIndices - cluster.lodFirstIndex[level]) {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        cacheFile.Close();
+        if (touched) {
+            std::fstream out(cachePath, std::ios::in | std::ios::out | std::ios::binary);
+            out.seekp(offsetof(CacheHeader, sourceTime));
+            out.write((const char*)&sourceTime, sizeof(sourceTime));
+        }
+
+        meshes.swap(cachedMeshes);
+        materials.swap(cachedMaterials);
+        std::cout << "Loaded mesh cache : " << cachePath << std::endl;
+        return true;
+    }
+
+    bool MeshCache::Save(std::string sourceFile, const std::vector<gps::MeshData>& meshes, const std::vector<gps::Material>& materials,
+        const std::vector<std::string>& dependencies) {
+        CacheHeader header;
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        if (!GetSourceStamp(sourceFile, header.sourceSize, header.sourceTime)) {
+            return false;
+        }
+        header.sourceHash = HashFile(sourceFile);
+        header.materialCount = (uint32_t)materials.size();
+        header.meshCount = (uint32_t)meshes.size();
+        header.dependencyCount = (uint32_t)dependencies.size();
+
+        std::string cachePath = GetCachePath(sourceFile);
+        std::ofstream out(cachePath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "WARNING: could not write mesh cache " << cachePath << std::endl;
+            return false;
+        }
+        out.write((const char*)&header, sizeof(header));
+
+        for (size_t i = 0; i < dependencies.size(); i++) {
+            CacheDependency dependency;
+            if (GetSourceStamp(dependencies[i], dependency.size, dependency.time)) {
+                dependency.hash = HashFile(dependencies[i]);
+            }
+            else {
+                dependency.size = MISSING_DEPENDENCY;
+                dependency.time = 0;
+                dependency.hash = 0;
+            }
+            WriteString(out, dependencies[i]);
+            out.write((const char*)&dependency, sizeof(dependency));
+        }
+
+        for (size_t i = 0; i < materials.size(); i++) {
+            const gps::Material& material = materials[i];
+            uint32_t textureCount = (uint32_t)material.textures.size();
+            out.write((const char*)&material.ambient, sizeof(glm::vec3));
+            out.write((const char*)&material.diffuse, sizeof(glm::vec3));
+            out.write((const char*)&material.specular, sizeof(glm::vec3));
+            out.write((const char*)&textureCount, sizeof(textureCount));
+            for (size_t t = 0; t < material.textures.size(); t++) {
+                WriteString(out, material.textures[t].type);
+                WriteString(out, material.textures[t].path);
+            }
+        }
+
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const gps::MeshData& mesh = meshes[i];
+            CacheMesh info;
+            info.materialId = mesh.materialId;
+            info.vertexCount = (uint32_t)mesh.vertices.size();
+            info.indexCount = (uint32_t)mesh.indices.size();
+            info.lodIndexCount = (uint32_t)mesh.lodIndices.size();
+            info.clusterCount = (uint32_t)mesh.clusters.size();
+            info.instanceCount = (uint32_t)mesh.instances.size();
+            for (int c = 0; c < 3; c++) {
+                info.minPoint[c] = mesh.minPoint[c];
+                info.maxPoint[c] = mesh.maxPoint[c];
+            }
+            out.write((const char*)&info, sizeof(info));
+            out.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(gps::Vertex));
+            out.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+            out.write((const char*)mesh.lodIndices.data(), mesh.lodIndices.size() * sizeof(GLuint));
+            out.write((const char*)mesh.clusters.data(), mesh.clusters.size() * sizeof(gps::MeshCluster));
+            out.write((const char*)mesh.instances.data(), mesh.instances.size() * sizeof(glm::mat4));
+        }
+
+        if (!out) {
+            std::cerr << "WARNING: could not write mesh cache " << cachePath << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
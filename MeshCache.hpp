@@ -0,0 +1,31 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    //versioned binary copy of a parsed model, stored next to the source file
+    //as <source>.cache and invalidated when the source size, timestamp or hash changes.
+    //dependencies are the other files the parse read (an obj's material libraries), they are
+    //stamped the same way so editing one invalidates the cache too
+    class MeshCache {
+
+    public:
+        static std::string GetCachePath(std::string sourceFile);
+        static bool Load(std::string sourceFile, std::vector<gps::MeshData>& meshes, std::vector<gps::Material>& materials);
+        static bool Save(std::string sourceFile, const std::vector<gps::MeshData>& meshes, const std::vector<gps::Material>& materials,
+            const std::vector<std::string>& dependencies);
+
+    private:
+        static bool GetSourceStamp(std::string sourceFile, uint64_t& size, int64_t& time);
+        static uint64_t HashFile(std::string sourceFile);
+    };
+
+}
+
+#endif
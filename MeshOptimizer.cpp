@@ -0,0 +1,581 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        //Forsyth, "Linear-Speed Vertex Cache Optimisation"
+        const int FORSYTH_CACHE_SIZE = 32;
+        const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+        const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+        const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+        const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+        //FIFO size used to find cluster boundaries and for the default statistics
+        const int SIMULATED_CACHE_SIZE = 16;
+        const int OVERDRAW_GRID_SIZE = 256;
+
+        float ForsythVertexScore(int cachePosition, unsigned int remainingTriangles) {
+            if (remainingTriangles == 0) {
+                return -1.0f;
+            }
+            float score = 0.0f;
+            if (cachePosition >= 0) {
+                if (cachePosition < 3) {
+                    //the vertices of the last triangle get a fixed score so it is not reused right away
+                    score = FORSYTH_LAST_TRIANGLE_SCORE;
+                }
+                else {
+                    float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                    score = std::pow(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+                }
+            }
+            score += FORSYTH_VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -FORSYTH_VALENCE_BOOST_POWER);
+            return score;
+        }
+
+        struct TriangleCluster {
+            size_t firstTriangle;
+            size_t triangleCount;
+            float sortKey;
+        };
+    }
+
+    void MeshOptimizer::Optimize(MeshData& mesh) {
+        if (mesh.indices.size() < 3) {
+            mesh.clusters.clear();
+            return;
+        }
+        BuildClusters(mesh);
+        OptimizeVertexFetch(mesh.vertices, mesh.indices);
+        ComputeClusterBounds(mesh);
+    }
+
+    void MeshOptimizer::BuildClusters(MeshData& mesh) {
+        size_t triangleCount = mesh.indices.size() / 3;
+        mesh.indices.resize(triangleCount * 3);
+        mesh.clusters.clear();
+        if (triangleCount <= CLUSTER_MAX_TRIANGLES) {
+            OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+            OptimizeOverdraw(mesh.indices, mesh.vertices);
+            MeshCluster cluster = MeshCluster();
+            cluster.firstIndex = 0;
+            cluster.indexCount = (GLuint)mesh.indices.size();
+            mesh.clusters.push_back(cluster);
+            return;
+        }
+
+        std::vector<glm::vec3> centroids(triangleCount);
+        std::vector<glm::vec3> normals(triangleCount);
+        //blocks only have six face directions, splitting by them first gives tight normal cones
+        std::vector<size_t> triangles[6];
+        for (size_t t = 0; t < triangleCount; t++) {
+            glm::vec3 p0 = mesh.vertices[mesh.indices[t * 3]].Position;
+            glm::vec3 p1 = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+            glm::vec3 p2 = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+            centroids[t] = (p0 + p1 + p2) / 3.0f;
+            normals[t] = glm::cross(p1 - p0, p2 - p0);
+            glm::vec3 magnitude = glm::abs(normals[t]);
+            int axis = magnitude.x >= magnitude.y ? (magnitude.x >= magnitude.z ? 0 : 2) : (magnitude.y >= magnitude.z ? 1 : 2);
+            triangles[axis * 2 + (normals[t][axis] < 0.0f ? 1 : 0)].push_back(t);
+        }
+
+        //median splits along the longest axis of the centroid bounds
+        std::vector<std::pair<size_t, size_t>> ranges;
+        std::vector<size_t> order;
+        order.reserve(triangleCount);
+        for (int direction = 0; direction < 6; direction++) {
+            size_t base = order.size();
+            order.insert(order.end(), triangles[direction].begin(), triangles[direction].end());
+            std::vector<std::pair<size_t, size_t>> pending;
+            if (order.size() > base) {
+                pending.push_back(std::make_pair(base, order.size()));
+            }
+            while (!pending.empty()) {
+                std::pair<size_t, size_t> range = pending.back();
+                pending.pop_back();
+                if (range.second - range.first <= CLUSTER_MAX_TRIANGLES) {
+                    ranges.push_back(range);
+                    continue;
+                }
+                glm::vec3 minPoint(FLT_MAX);
+                glm::vec3 maxPoint(-FLT_MAX);
+                for (size_t i = range.first; i < range.second; i++) {
+                    minPoint = glm::min(minPoint, centroids[order[i]]);
+                    maxPoint = glm::max(maxPoint, centroids[order[i]]);
+                }
+                glm::vec3 extent = maxPoint - minPoint;
+                int axis = extent.x >= extent.y ? (extent.x >= extent.z ? 0 : 2) : (extent.y >= extent.z ? 1 : 2);
+                size_t middle = range.first + (range.second - range.first) / 2;
+                std::nth_element(order.begin() + range.first, order.begin() + middle, order.begin() + range.second,
+                    [&centroids, axis](size_t a, size_t b) { return centroids[a][axis] < centroids[b][axis]; });
+                pending.push_back(std::make_pair(middle, range.second));
+                pending.push_back(std::make_pair(range.first, middle));
+            }
+        }
+
+        //cache order inside every cluster, on local vertex ids so the cost does not depend on the mesh size
+        const GLuint unassigned = 0xFFFFFFFF;
+        std::vector<GLuint> localIds(mesh.vertices.size(), unassigned);
+        std::vector<GLuint> globalIds;
+        std::vector<GLuint> localIndices;
+        std::vector<std::vector<GLuint>> clusterIndices(ranges.size());
+        std::vector<TriangleCluster> sortable(ranges.size());
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        std::vector<glm::vec3> clusterCentroids(ranges.size(), glm::vec3(0.0f));
+        std::vector<glm::vec3> clusterNormals(ranges.size(), glm::vec3(0.0f));
+        for (size_t c = 0; c < ranges.size(); c++) {
+            globalIds.clear();
+            localIndices.clear();
+            float clusterArea = 0.0f;
+            for (size_t i = ranges[c].first; i < ranges[c].second; i++) {
+                size_t t = order[i];
+                for (int k = 0; k < 3; k++) {
+                    GLuint vertex = mesh.indices[t * 3 + k];
+                    if (localIds[vertex] == unassigned) {
+                        localIds[vertex] = (GLuint)globalIds.size();
+                        globalIds.push_back(vertex);
+                    }
+                    localIndices.push_back(localIds[vertex]);
+                }
+                float area = glm::length(normals[t]);
+                clusterCentroids[c] += centroids[t] * area;
+                clusterNormals[c] += normals[t];
+                clusterArea += area;
+            }
+            OptimizeVertexCache(localIndices, globalIds.size());
+            clusterIndices[c].resize(localIndices.size());
+            for (size_t i = 0; i < localIndices.size(); i++) {
+                clusterIndices[c][i] = globalIds[localIndices[i]];
+            }
+            for (size_t v = 0; v < globalIds.size(); v++) {
+                localIds[globalIds[v]] = unassigned;
+            }
+            meshCentroid += clusterCentroids[c];
+            meshArea += clusterArea;
+            if (clusterArea > 0.0f) {
+                clusterCentroids[c] /= clusterArea;
+            }
+        }
+
+        //same outward-first ordering as OptimizeOverdraw, at cluster granularity
+        if (meshArea > 0.0f) {
+            meshCentroid /= meshArea;
+        }
+        for (size_t c = 0; c < ranges.size(); c++) {
+            float normalLength = glm::length(clusterNormals[c]);
+            glm::vec3 normal = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+            sortable[c].firstTriangle = c;
+            sortable[c].triangleCount = ranges[c].second - ranges[c].first;
+            sortable[c].sortKey = glm::dot(clusterCentroids[c] - meshCentroid, normal);
+        }
+        std::stable_sort(sortable.begin(), sortable.end(), [](const TriangleCluster& a, const TriangleCluster& b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        mesh.indices.clear();
+        for (size_t c = 0; c < sortable.size(); c++) {
+            const std::vector<GLuint>& indices = clusterIndices[sortable[c].firstTriangle];
+            MeshCluster cluster = MeshCluster();
+            cluster.firstIndex = (GLuint)mesh.indices.size();
+            cluster.indexCount = (GLuint)indices.size();
+            mesh.clusters.push_back(cluster);
+            mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+        }
+    }
+
+    void MeshOptimizer::ComputeClusterBounds(MeshData& mesh) {
+        for (size_t c = 0; c < mesh.clusters.size(); c++) {
+            MeshCluster& cluster = mesh.clusters[c];
+            cluster.minPoint = glm::vec3(FLT_MAX);
+            cluster.maxPoint = glm::vec3(-FLT_MAX);
+            glm::vec3 normalSum(0.0f);
+            for (GLuint i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i += 3) {
+                glm::vec3 p0 = mesh.vertices[mesh.indices[i]].Position;
+                glm::vec3 p1 = mesh.vertices[mesh.indices[i + 1]].Position;
+                glm::vec3 p2 = mesh.vertices[mesh.indices[i + 2]].Position;
+                cluster.minPoint = glm::min(cluster.minPoint, glm::min(p0, glm::min(p1, p2)));
+                cluster.maxPoint = glm::max(cluster.maxPoint, glm::max(p0, glm::max(p1, p2)));
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float length = glm::length(normal);
+                if (length > 0.0f) {
+                    normalSum += normal / length;
+                }
+            }
+
+            cluster.sphereCenter = (cluster.minPoint + cluster.maxPoint) * 0.5f;
+            cluster.sphereRadius = 0.0f;
+            for (GLuint i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i++) {
+                cluster.sphereRadius = std::max(cluster.sphereRadius, glm::length(mesh.vertices[mesh.indices[i]].Position - cluster.sphereCenter));
+            }
+
+            //the cone has to contain every face normal, a half angle of 90 degrees or more is useless
+            float sumLength = glm::length(normalSum);
+            cluster.coneAxis = sumLength > 0.0f ? normalSum / sumLength : glm::vec3(0.0f, 1.0f, 0.0f);
+            cluster.coneCutoff = sumLength > 0.0f ? 1.0f : -1.0f;
+            for (GLuint i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i += 3) {
+                glm::vec3 p0 = mesh.vertices[mesh.indices[i]].Position;
+                glm::vec3 p1 = mesh.vertices[mesh.indices[i + 1]].Position;
+                glm::vec3 p2 = mesh.vertices[mesh.indices[i + 2]].Position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float length = glm::length(normal);
+                if (length > 0.0f) {
+                    cluster.coneCutoff = std::min(cluster.coneCutoff, glm::dot(normal / length, cluster.coneAxis));
+                }
+            }
+        }
+    }
+
+    void MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        //triangles adjacent to every vertex, packed in one array
+        std::vector<unsigned int> remaining(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            remaining[indices[i]]++;
+        }
+        std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+        }
+        std::vector<size_t> adjacency(triangleCount * 3);
+        std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+            }
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++) {
+            vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+        }
+        std::vector<float> triangleScore(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+        }
+
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<GLuint> output;
+        output.reserve(triangleCount * 3);
+        std::vector<GLuint> cache;
+        std::vector<GLuint> nextCache;
+        size_t scanCursor = 0;
+        long long bestTriangle = -1;
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+            if (bestTriangle < 0) {
+                //nothing adjacent to the cache is left, continue with the next unused triangle
+                while (emitted[scanCursor]) {
+                    scanCursor++;
+                }
+                bestTriangle = (long long)scanCursor;
+            }
+
+            size_t triangle = (size_t)bestTriangle;
+            emitted[triangle] = true;
+            nextCache.clear();
+            for (int k = 0; k < 3; k++) {
+                GLuint vertex = indices[triangle * 3 + k];
+                output.push_back(vertex);
+                nextCache.push_back(vertex);
+
+                size_t begin = adjacencyOffset[vertex];
+                size_t end = begin + remaining[vertex];
+                for (size_t a = begin; a < end; a++) {
+                    if (adjacency[a] == triangle) {
+                        adjacency[a] = adjacency[end - 1];
+                        break;
+                    }
+                }
+                remaining[vertex]--;
+            }
+            for (size_t c = 0; c < cache.size(); c++) {
+                GLuint vertex = cache[c];
+                if (vertex != nextCache[0] && vertex != nextCache[1] && vertex != nextCache[2]) {
+                    nextCache.push_back(vertex);
+                }
+            }
+            for (size_t c = FORSYTH_CACHE_SIZE; c < nextCache.size(); c++) {
+                cachePosition[nextCache[c]] = -1;
+                vertexScore[nextCache[c]] = ForsythVertexScore(-1, remaining[nextCache[c]]);
+            }
+            if (nextCache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+                nextCache.resize(FORSYTH_CACHE_SIZE);
+            }
+            cache.swap(nextCache);
+
+            for (size_t c = 0; c < cache.size(); c++) {
+                cachePosition[cache[c]] = (int)c;
+                vertexScore[cache[c]] = ForsythVertexScore((int)c, remaining[cache[c]]);
+            }
+
+            //only triangles touching the cache changed score
+            bestTriangle = -1;
+            float bestScore = -FLT_MAX;
+            for (size_t c = 0; c < cache.size(); c++) {
+                GLuint vertex = cache[c];
+                size_t begin = adjacencyOffset[vertex];
+                size_t end = begin + remaining[vertex];
+                for (size_t a = begin; a < end; a++) {
+                    size_t t = adjacency[a];
+                    float score = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                    triangleScore[t] = score;
+                    if (score > bestScore) {
+                        bestScore = score;
+                        bestTriangle = (long long)t;
+                    }
+                }
+            }
+        }
+
+        output.insert(output.end(), indices.begin() + triangleCount * 3, indices.end());
+        indices.swap(output);
+    }
+
+    void MeshOptimizer::OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        //clusters start wherever the cache ordered sequence misses all three vertices,
+        //so moving them around costs no extra vertex transforms
+        std::vector<TriangleCluster> clusters;
+        std::vector<size_t> cacheTime(vertices.size(), 0);
+        size_t timestamp = SIMULATED_CACHE_SIZE + 1;
+        for (size_t t = 0; t < triangleCount; t++) {
+            int misses = 0;
+            for (int k = 0; k < 3; k++) {
+                GLuint vertex = indices[t * 3 + k];
+                if (timestamp - cacheTime[vertex] > (size_t)SIMULATED_CACHE_SIZE) {
+                    cacheTime[vertex] = timestamp++;
+                    misses++;
+                }
+            }
+            if (clusters.empty() || misses == 3) {
+                clusters.push_back({ t, 0, 0.0f });
+            }
+            clusters.back().triangleCount++;
+        }
+
+        //outward facing clusters far from the centre are drawn first, they tend to occlude the rest
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        std::vector<glm::vec3> clusterCentroids(clusters.size(), glm::vec3(0.0f));
+        std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3(0.0f));
+        std::vector<float> clusterAreas(clusters.size(), 0.0f);
+        for (size_t c = 0; c < clusters.size(); c++) {
+            for (size_t t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].triangleCount; t++) {
+                glm::vec3 p0 = vertices[indices[t * 3]].Position;
+                glm::vec3 p1 = vertices[indices[t * 3 + 1]].Position;
+                glm::vec3 p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float area = glm::length(normal);
+                glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+                clusterCentroids[c] += centroid * area;
+                clusterNormals[c] += normal;
+                clusterAreas[c] += area;
+                meshCentroid += centroid * area;
+                meshArea += area;
+            }
+        }
+        if (meshArea > 0.0f) {
+            meshCentroid /= meshArea;
+        }
+        for (size_t c = 0; c < clusters.size(); c++) {
+            glm::vec3 centroid = clusterAreas[c] > 0.0f ? clusterCentroids[c] / clusterAreas[c] : clusterCentroids[c];
+            float normalLength = glm::length(clusterNormals[c]);
+            glm::vec3 normal = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+            clusters[c].sortKey = glm::dot(centroid - meshCentroid, normal);
+        }
+        std::stable_sort(clusters.begin(), clusters.end(), [](const TriangleCluster& a, const TriangleCluster& b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<GLuint> output;
+        output.reserve(indices.size());
+        for (size_t c = 0; c < clusters.size(); c++) {
+            output.insert(output.end(), indices.begin() + clusters[c].firstTriangle * 3,
+                indices.begin() + (clusters[c].firstTriangle + clusters[c].triangleCount) * 3);
+        }
+        output.insert(output.end(), indices.begin() + triangleCount * 3, indices.end());
+        indices.swap(output);
+    }
+
+    void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+        //vertices are stored in the order the index buffer first touches them, unused ones are dropped
+        const GLuint unassigned = 0xFFFFFFFF;
+        std::vector<GLuint> remap(vertices.size(), unassigned);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint& target = remap[indices[i]];
+            if (target == unassigned) {
+                target = (GLuint)reordered.size();
+                reordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = target;
+        }
+        vertices.swap(reordered);
+    }
+
+    VertexCacheStatistics MeshOptimizer::AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize) {
+        VertexCacheStatistics statistics = { 0.0f, 0.0f };
+        std::vector<size_t> cacheTime(vertexCount, 0);
+        std::vector<bool> referenced(vertexCount, false);
+        size_t timestamp = (size_t)cacheSize + 1;
+        size_t transformed = 0;
+        size_t uniqueVertices = 0;
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint vertex = indices[i];
+            if (!referenced[vertex]) {
+                referenced[vertex] = true;
+                uniqueVertices++;
+            }
+            if (timestamp - cacheTime[vertex] > (size_t)cacheSize) {
+                cacheTime[vertex] = timestamp++;
+                transformed++;
+            }
+        }
+        if (indices.size() >= 3) {
+            statistics.acmr = (float)transformed / (float)(indices.size() / 3);
+        }
+        if (uniqueVertices > 0) {
+            statistics.atvr = (float)transformed / (float)uniqueVertices;
+        }
+        return statistics;
+    }
+
+    float MeshOptimizer::AnalyzeOverdraw(const std::vector<GLuint>& indices, const std::vector<Vertex>& vertices) {
+        if (indices.size() < 3) {
+            return 0.0f;
+        }
+        glm::vec3 minPoint(FLT_MAX);
+        glm::vec3 maxPoint(-FLT_MAX);
+        for (size_t i = 0; i < indices.size(); i++) {
+            minPoint = glm::min(minPoint, vertices[indices[i]].Position);
+            maxPoint = glm::max(maxPoint, vertices[indices[i]].Position);
+        }
+        glm::vec3 extent = glm::max(maxPoint - minPoint, glm::vec3(1e-6f));
+
+        size_t shaded = 0;
+        size_t covered = 0;
+        std::vector<float> depthBuffer(OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE);
+        for (int axis = 0; axis < 3; axis++) {
+            int uAxis = (axis + 1) % 3;
+            int vAxis = (axis + 2) % 3;
+            for (int direction = 1; direction >= -1; direction -= 2) {
+                std::fill(depthBuffer.begin(), depthBuffer.end(), FLT_MAX);
+                for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                    float u[3];
+                    float v[3];
+                    float depth[3];
+                    for (int k = 0; k < 3; k++) {
+                        glm::vec3 p = (vertices[indices[t + k]].Position - minPoint) / extent;
+                        u[k] = p[uAxis] * (OVERDRAW_GRID_SIZE - 1);
+                        v[k] = p[vAxis] * (OVERDRAW_GRID_SIZE - 1);
+                        //looking down the axis from the +direction side
+                        depth[k] = direction > 0 ? 1.0f - p[axis] : p[axis];
+                    }
+                    float area = (u[1] - u[0]) * (v[2] - v[0]) - (u[2] - u[0]) * (v[1] - v[0]);
+                    //back faces are culled like in the renderer (counter clockwise front faces)
+                    if (area * direction <= 0.0f) {
+                        continue;
+                    }
+                    int minU = std::max(0, (int)std::floor(std::min(u[0], std::min(u[1], u[2]))));
+                    int maxU = std::min(OVERDRAW_GRID_SIZE - 1, (int)std::ceil(std::max(u[0], std::max(u[1], u[2]))));
+                    int minV = std::max(0, (int)std::floor(std::min(v[0], std::min(v[1], v[2]))));
+                    int maxV = std::min(OVERDRAW_GRID_SIZE - 1, (int)std::ceil(std::max(v[0], std::max(v[1], v[2]))));
+                    for (int y = minV; y <= maxV; y++) {
+                        for (int x = minU; x <= maxU; x++) {
+                            float w0 = ((u[2] - u[1]) * (y - v[1]) - (v[2] - v[1]) * (x - u[1])) / area;
+                            float w1 = ((u[0] - u[2]) * (y - v[2]) - (v[0] - v[2]) * (x - u[2])) / area;
+                            float w2 = 1.0f - w0 - w1;
+                            if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+                                continue;
+                            }
+                            float z = w0 * depth[0] + w1 * depth[1] + w2 * depth[2];
+                            float& stored = depthBuffer[y * OVERDRAW_GRID_SIZE + x];
+                            if (z < stored) {
+                                stored = z;
+                                shaded++;
+                            }
+                        }
+                    }
+                }
+                for (size_t p = 0; p < depthBuffer.size(); p++) {
+                    if (depthBuffer[p] != FLT_MAX) {
+                        covered++;
+                    }
+                }
+            }
+        }
+        return covered > 0 ? (float)shaded / (float)covered : 0.0f;
+    }
+
+    void MeshOptimizer::PrintStatistics(std::vector<MeshData>& meshes) {
+        size_t triangles = 0;
+        double acmrBefore = 0.0;
+        double acmrAfter = 0.0;
+        double atvrBefore = 0.0;
+        double atvrAfter = 0.0;
+        double overdrawBefore = 0.0;
+        double overdrawAfter = 0.0;
+        double optimizeMilliseconds = 0.0;
+        size_t clusterCount = 0;
+        size_t coneClusters = 0;
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+            MeshData& mesh = meshes[m];
+            size_t meshTriangles = mesh.indices.size() / 3;
+            if (meshTriangles == 0) {
+                continue;
+            }
+            VertexCacheStatistics before = AnalyzeVertexCache(mesh.indices, mesh.vertices.size(), SIMULATED_CACHE_SIZE);
+            float overdraw = AnalyzeOverdraw(mesh.indices, mesh.vertices);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            Optimize(mesh);
+            optimizeMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            VertexCacheStatistics after = AnalyzeVertexCache(mesh.indices, mesh.vertices.size(), SIMULATED_CACHE_SIZE);
+            clusterCount += mesh.clusters.size();
+            for (size_t c = 0; c < mesh.clusters.size(); c++) {
+                if (mesh.clusters[c].coneCutoff > 0.0f) {
+                    coneClusters++;
+                }
+            }
+            //weighted by triangle count so large meshes dominate like they do on the GPU
+            triangles += meshTriangles;
+            acmrBefore += before.acmr * meshTriangles;
+            acmrAfter += after.acmr * meshTriangles;
+            atvrBefore += before.atvr * meshTriangles;
+            atvrAfter += after.atvr * meshTriangles;
+            overdrawBefore += overdraw * meshTriangles;
+            overdrawAfter += AnalyzeOverdraw(mesh.indices, mesh.vertices) * meshTriangles;
+        }
+        if (triangles == 0) {
+            std::cout << "no triangles" << std::endl;
+            return;
+        }
+        std::cout << "meshes         : " << meshes.size() << ", triangles: " << triangles << std::endl;
+        std::cout << "ACMR (FIFO " << SIMULATED_CACHE_SIZE << ")  : " << acmrBefore / triangles << " -> " << acmrAfter / triangles << std::endl;
+        std::cout << "ATVR (FIFO " << SIMULATED_CACHE_SIZE << ")  : " << atvrBefore / triangles << " -> " << atvrAfter / triangles << std::endl;
+        std::cout << "overdraw       : " << overdrawBefore / triangles << " -> " << overdrawAfter / triangles << std::endl;
+        std::cout << "clusters       : " << clusterCount << ", " << (double)triangles / clusterCount
+            << " triangles on average, " << coneClusters << " with a usable normal cone" << std::endl;
+        std::cout << "optimize time  : " << optimizeMilliseconds << " ms" << std::endl;
+    }
+}
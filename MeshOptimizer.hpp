@@ -0,0 +1,44 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    struct VertexCacheStatistics {
+        float acmr;     //transformed vertices per triangle
+        float atvr;     //transformed vertices per unique vertex
+    };
+
+    const size_t CLUSTER_MAX_TRIANGLES = 256;
+
+    //index and vertex reordering run on freshly parsed meshes: Forsyth vertex cache
+    //ordering, overdraw-aware sorting of the resulting clusters and vertex fetch ordering
+    class MeshOptimizer {
+
+    public:
+        //clusters, cache/overdraw order inside and between them, fetch order and cluster bounds
+        static void Optimize(MeshData& mesh);
+
+        static void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+        static void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices);
+        static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+        //splits meshes above CLUSTER_MAX_TRIANGLES into clusters grouped by dominant face
+        //direction and then by median splits in space; each cluster is cache optimized on its own
+        static void BuildClusters(MeshData& mesh);
+        static void ComputeClusterBounds(MeshData& mesh);
+
+        //FIFO cache simulation, cacheSize entries
+        static VertexCacheStatistics AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, int cacheSize);
+        //pixels shaded per pixel covered, rasterized with depth test from the six axis directions
+        static float AnalyzeOverdraw(const std::vector<GLuint>& indices, const std::vector<Vertex>& vertices);
+
+        //prints ACMR/ATVR and overdraw of the source order against the optimized order
+        static void PrintStatistics(std::vector<MeshData>& meshes);
+    };
+
+}
+
+#endif
@@ -0,0 +1,410 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace gps {
+
+    namespace {
+
+        //each level aims for half the triangles of the previous one, with an error
+        //budget relative to the cluster's bounding sphere
+        const float LOD_ERROR_BUDGET[MESH_LOD_COUNT - 1] = { 0.02f, 0.05f, 0.12f };
+        //a level that keeps more than this fraction of the previous one is not worth storing
+        const float LOD_MIN_REDUCTION = 0.85f;
+        const int SIMPLIFY_MAX_PASSES = 64;
+
+        struct Quadric {
+            double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+            void Clear() {
+                a2 = ab = ac = ad = b2 = bc = bd = c2 = cd = d2 = 0.0;
+            }
+
+            void AddPlane(double a, double b, double c, double d) {
+                a2 += a * a; ab += a * b; ac += a * c; ad += a * d;
+                b2 += b * b; bc += b * c; bd += b * d;
+                c2 += c * c; cd += c * d;
+                d2 += d * d;
+            }
+
+            void Add(const Quadric& other) {
+                a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+                b2 += other.b2; bc += other.bc; bd += other.bd;
+                c2 += other.c2; cd += other.cd;
+                d2 += other.d2;
+            }
+
+            //sum of squared distances of p to the accumulated planes
+            double Evaluate(glm::vec3 p) const {
+                double x = p.x;
+                double y = p.y;
+                double z = p.z;
+                double result = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+                    + b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+                    + c2 * z * z + 2.0 * cd * z
+                    + d2;
+                return result > 0.0 ? result : 0.0;
+            }
+        };
+
+        struct PositionKey {
+            uint32_t x, y, z;
+
+            bool operator==(const PositionKey& other) const {
+                return x == other.x && y == other.y && z == other.z;
+            }
+        };
+
+        struct PositionHash {
+            size_t operator()(const PositionKey& key) const {
+                return (size_t)key.x * 73856093u ^ (size_t)key.y * 19349663u ^ (size_t)key.z * 83492791u;
+            }
+        };
+
+        struct Collapse {
+            double cost;
+            GLuint from;
+            GLuint to;
+        };
+
+        struct ClassEdge {
+            GLuint a;
+            GLuint b;
+
+            bool operator<(const ClassEdge& other) const {
+                return a != other.a ? a < other.a : b < other.b;
+            }
+
+            bool operator==(const ClassEdge& other) const {
+                return a == other.a && b == other.b;
+            }
+        };
+
+        PositionKey MakePositionKey(glm::vec3 position) {
+            PositionKey key;
+            std::memcpy(&key.x, &position.x, sizeof(float));
+            std::memcpy(&key.y, &position.y, sizeof(float));
+            std::memcpy(&key.z, &position.z, sizeof(float));
+            return key;
+        }
+    }
+
+    float MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+        size_t targetIndexCount, float maxError, std::vector<GLuint>& result) {
+        result = indices;
+        if (indices.size() <= targetIndexCount || indices.size() < 3) {
+            return 0.0f;
+        }
+
+        //local vertex ids, and position classes: vertices sharing a position move together
+        const GLuint unassigned = 0xFFFFFFFF;
+        std::unordered_map<GLuint, GLuint> localIds;
+        std::vector<GLuint> globalIds;
+        std::vector<GLuint> triangles(indices.size() - indices.size() % 3);
+        std::unordered_map<PositionKey, GLuint, PositionHash> classIds;
+        std::vector<GLuint> classOf;
+        std::vector<glm::vec3> classPosition;
+        for (size_t i = 0; i < triangles.size(); i++) {
+            auto found = localIds.find(indices[i]);
+            if (found == localIds.end()) {
+                GLuint local = (GLuint)globalIds.size();
+                found = localIds.insert(std::make_pair(indices[i], local)).first;
+                globalIds.push_back(indices[i]);
+                glm::vec3 position = vertices[indices[i]].Position;
+                auto positionClass = classIds.find(MakePositionKey(position));
+                if (positionClass == classIds.end()) {
+                    positionClass = classIds.insert(std::make_pair(MakePositionKey(position), (GLuint)classPosition.size())).first;
+                    classPosition.push_back(position);
+                }
+                classOf.push_back(positionClass->second);
+            }
+            triangles[i] = found->second;
+        }
+        size_t classCount = classPosition.size();
+
+        std::vector<std::vector<GLuint>> classVertices(classCount);
+        for (GLuint v = 0; v < (GLuint)classOf.size(); v++) {
+            classVertices[classOf[v]].push_back(v);
+        }
+
+        std::vector<Quadric> quadrics(classCount);
+        for (size_t c = 0; c < classCount; c++) {
+            quadrics[c].Clear();
+        }
+        std::vector<ClassEdge> edges;
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+            glm::vec3 p0 = classPosition[classOf[triangles[t]]];
+            glm::vec3 p1 = classPosition[classOf[triangles[t + 1]]];
+            glm::vec3 p2 = classPosition[classOf[triangles[t + 2]]];
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(normal);
+            if (length > 0.0f) {
+                normal /= length;
+                double d = -(double)glm::dot(normal, p0);
+                for (int k = 0; k < 3; k++) {
+                    quadrics[classOf[triangles[t + k]]].AddPlane(normal.x, normal.y, normal.z, d);
+                }
+            }
+            for (int k = 0; k < 3; k++) {
+                GLuint a = classOf[triangles[t + k]];
+                GLuint b = classOf[triangles[t + (k + 1) % 3]];
+                if (a != b) {
+                    edges.push_back({ std::min(a, b), std::max(a, b) });
+                }
+            }
+        }
+
+        //edges not shared by exactly two triangles are open borders (or non manifold), their ends stay put
+        std::vector<bool> locked(classCount, false);
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();) {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i]) {
+                j++;
+            }
+            if (j - i != 2) {
+                locked[edges[i].a] = true;
+                locked[edges[i].b] = true;
+            }
+            i = j;
+        }
+
+        double maxCost = (double)maxError * (double)maxError;
+        float achievedError = 0.0f;
+        size_t targetTriangles = targetIndexCount / 3;
+        std::vector<GLuint> vertexRemap(classOf.size(), unassigned);
+        std::vector<bool> touched(classCount, false);
+        std::vector<size_t> classTriangleOffset(classCount + 1);
+        std::vector<GLuint> classTriangles;
+        std::vector<Collapse> collapses;
+        std::vector<GLuint> partners;
+
+        for (int pass = 0; pass < SIMPLIFY_MAX_PASSES && triangles.size() / 3 > targetTriangles; pass++) {
+            //triangles around every position class
+            std::fill(classTriangleOffset.begin(), classTriangleOffset.end(), 0);
+            for (size_t i = 0; i < triangles.size(); i++) {
+                classTriangleOffset[classOf[triangles[i]] + 1]++;
+            }
+            for (size_t c = 0; c < classCount; c++) {
+                classTriangleOffset[c + 1] += classTriangleOffset[c];
+            }
+            classTriangles.resize(triangles.size());
+            std::vector<size_t> fill(classTriangleOffset.begin(), classTriangleOffset.end() - 1);
+            for (size_t i = 0; i < triangles.size(); i++) {
+                classTriangles[fill[classOf[triangles[i]]]++] = (GLuint)(i / 3);
+            }
+
+            edges.clear();
+            for (size_t t = 0; t < triangles.size(); t += 3) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = classOf[triangles[t + k]];
+                    GLuint b = classOf[triangles[t + (k + 1) % 3]];
+                    if (a != b) {
+                        edges.push_back({ std::min(a, b), std::max(a, b) });
+                    }
+                }
+            }
+            std::sort(edges.begin(), edges.end());
+            edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+            collapses.clear();
+            for (size_t e = 0; e < edges.size(); e++) {
+                GLuint a = edges[e].a;
+                GLuint b = edges[e].b;
+                Quadric combined = quadrics[a];
+                combined.Add(quadrics[b]);
+                double costToB = locked[a] ? maxCost + 1.0 : combined.Evaluate(classPosition[b]);
+                double costToA = locked[b] ? maxCost + 1.0 : combined.Evaluate(classPosition[a]);
+                if (costToB <= costToA && costToB <= maxCost) {
+                    collapses.push_back({ costToB, a, b });
+                }
+                else if (costToA < costToB && costToA <= maxCost) {
+                    collapses.push_back({ costToA, b, a });
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+                if (x.cost != y.cost) {
+                    return x.cost < y.cost;
+                }
+                return x.from != y.from ? x.from < y.from : x.to < y.to;
+            });
+
+            std::fill(touched.begin(), touched.end(), false);
+            size_t remainingTriangles = triangles.size() / 3;
+            size_t applied = 0;
+            for (size_t i = 0; i < collapses.size() && remainingTriangles > targetTriangles; i++) {
+                GLuint from = collapses[i].from;
+                GLuint to = collapses[i].to;
+                if (touched[from] || touched[to]) {
+                    continue;
+                }
+
+                //every live vertex at "from" needs a vertex at "to" sharing one of its triangles,
+                //otherwise the collapse would tear an attribute seam
+                bool valid = true;
+                partners.assign(classVertices[from].size(), unassigned);
+                for (size_t v = 0; v < classVertices[from].size() && valid; v++) {
+                    GLuint vertex = classVertices[from][v];
+                    bool live = false;
+                    for (size_t a = classTriangleOffset[from]; a < classTriangleOffset[from + 1]; a++) {
+                        const GLuint* corners = &triangles[classTriangles[a] * 3];
+                        if (corners[0] != vertex && corners[1] != vertex && corners[2] != vertex) {
+                            continue;
+                        }
+                        live = true;
+                        for (int k = 0; k < 3; k++) {
+                            if (classOf[corners[k]] == to && corners[k] < partners[v]) {
+                                partners[v] = corners[k];
+                            }
+                        }
+                    }
+                    if (live && partners[v] == unassigned) {
+                        valid = false;
+                    }
+                }
+
+                //no surviving triangle may flip
+                size_t removed = 0;
+                for (size_t a = classTriangleOffset[from]; a < classTriangleOffset[from + 1] && valid; a++) {
+                    const GLuint* corners = &triangles[classTriangles[a] * 3];
+                    glm::vec3 before[3];
+                    glm::vec3 after[3];
+                    bool degenerates = false;
+                    for (int k = 0; k < 3; k++) {
+                        GLuint positionClass = classOf[corners[k]];
+                        degenerates = degenerates || positionClass == to;
+                        before[k] = classPosition[positionClass];
+                        after[k] = positionClass == from ? classPosition[to] : before[k];
+                    }
+                    if (degenerates) {
+                        removed++;
+                        continue;
+                    }
+                    glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+                        valid = false;
+                    }
+                }
+                if (!valid) {
+                    continue;
+                }
+
+                for (size_t v = 0; v < classVertices[from].size(); v++) {
+                    if (partners[v] != unassigned) {
+                        vertexRemap[classVertices[from][v]] = partners[v];
+                    }
+                }
+                quadrics[to].Add(quadrics[from]);
+                //the neighbourhood changed, its costs are refreshed next pass
+                for (size_t a = classTriangleOffset[from]; a < classTriangleOffset[from + 1]; a++) {
+                    const GLuint* corners = &triangles[classTriangles[a] * 3];
+                    for (int k = 0; k < 3; k++) {
+                        touched[classOf[corners[k]]] = true;
+                    }
+                }
+                achievedError = std::max(achievedError, (float)std::sqrt(collapses[i].cost));
+                remainingTriangles -= std::min(removed, remainingTriangles);
+                applied++;
+            }
+            if (applied == 0) {
+                break;
+            }
+
+            size_t write = 0;
+            for (size_t t = 0; t < triangles.size(); t += 3) {
+                GLuint corners[3];
+                for (int k = 0; k < 3; k++) {
+                    GLuint vertex = triangles[t + k];
+                    corners[k] = vertexRemap[vertex] != unassigned ? vertexRemap[vertex] : vertex;
+                }
+                if (classOf[corners[0]] == classOf[corners[1]] || classOf[corners[1]] == classOf[corners[2]] ||
+                    classOf[corners[0]] == classOf[corners[2]]) {
+                    continue;
+                }
+                triangles[write++] = corners[0];
+                triangles[write++] = corners[1];
+                triangles[write++] = corners[2];
+            }
+            triangles.resize(write);
+            std::fill(vertexRemap.begin(), vertexRemap.end(), unassigned);
+        }
+
+        result.resize(triangles.size());
+        for (size_t i = 0; i < triangles.size(); i++) {
+            result[i] = globalIds[triangles[i]];
+        }
+        return achievedError;
+    }
+
+    void MeshSimplifier::BuildLods(MeshData& mesh) {
+        mesh.lodIndices.clear();
+        std::vector<GLuint> previous;
+        std::vector<GLuint> simplified;
+        for (size_t c = 0; c < mesh.clusters.size(); c++) {
+            MeshCluster& cluster = mesh.clusters[c];
+            cluster.lodCount = 0;
+            previous.assign(mesh.indices.begin() + cluster.firstIndex, mesh.indices.begin() + cluster.firstIndex + cluster.indexCount);
+            float error = 0.0f;
+            for (int level = 0; level < MESH_LOD_COUNT - 1; level++) {
+                size_t target = (size_t)(cluster.indexCount >> (level + 1)) / 3 * 3;
+                if (target < 3) {
+                    break;
+                }
+                //each level is simplified from the previous one, so its distance from level 0 is
+                //bounded by the sum of the level errors, which has to stay within the budget
+                float remaining = cluster.sphereRadius * LOD_ERROR_BUDGET[level] - error;
+                if (remaining <= 0.0f) {
+                    break;
+                }
+                float levelError = Simplify(mesh.vertices, previous, target, remaining, simplified);
+                if (simplified.empty() || simplified.size() > previous.size() * LOD_MIN_REDUCTION) {
+                    break;
+                }
+                error += levelError;
+                cluster.lodFirstIndex[level] = (GLuint)(mesh.indices.size() + mesh.lodIndices.size());
+                cluster.lodIndexCount[level] = (GLuint)simplified.size();
+                cluster.lodError[level] = error;
+                cluster.lodCount = level + 1;
+                mesh.lodIndices.insert(mesh.lodIndices.end(), simplified.begin(), simplified.end());
+                previous.swap(simplified);
+            }
+        }
+    }
+
+    void MeshSimplifier::PrintReport(const std::vector<MeshData>& meshes) {
+        size_t triangles[MESH_LOD_COUNT] = {};
+        float maxError[MESH_LOD_COUNT] = {};
+        size_t clusters = 0;
+        size_t clustersWithLevel[MESH_LOD_COUNT] = {};
+        for (size_t m = 0; m < meshes.size(); m++) {
+            for (size_t c = 0; c < meshes[m].clusters.size(); c++) {
+                const MeshCluster& cluster = meshes[m].clusters[c];
+                clusters++;
+                clustersWithLevel[0]++;
+                triangles[0] += cluster.indexCount / 3;
+                //clusters without a level fall back to the coarsest one they have
+                for (int level = 1; level < MESH_LOD_COUNT; level++) {
+                    int available = std::min(level, (int)cluster.lodCount);
+                    triangles[level] += (available == 0 ? cluster.indexCount : cluster.lodIndexCount[available - 1]) / 3;
+                    if (available == level) {
+                        clustersWithLevel[level]++;
+                        maxError[level] = std::max(maxError[level], cluster.lodError[level - 1]);
+                    }
+                }
+            }
+        }
+        std::cout << "clusters       : " << clusters << std::endl;
+        for (int level = 0; level < MESH_LOD_COUNT; level++) {
+            std::cout << "LOD " << level << "          : " << triangles[level] << " triangles";
+            if (triangles[0] > 0) {
+                std::cout << " (" << 100.0 * triangles[level] / triangles[0] << "%)";
+            }
+            std::cout << ", " << clustersWithLevel[level] << " clusters, max error " << maxError[level] << std::endl;
+        }
+    }
+}
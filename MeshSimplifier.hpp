@@ -0,0 +1,31 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    //quadric error metric edge collapse (Garland/Heckbert). Vertices only move onto
+    //existing vertices so every level shares the mesh's vertex buffer, open borders are
+    //locked and attribute seams only collapse along themselves. Single threaded and
+    //ordered by (cost, vertex ids), so the output only depends on the input.
+    class MeshSimplifier {
+
+    public:
+        //reduces indices towards targetIndexCount without exceeding maxError (object space
+        //distance); returns the largest error of an accepted collapse
+        static float Simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+            size_t targetIndexCount, float maxError, std::vector<GLuint>& result);
+
+        //fills the lod fields of every cluster and appends their indices to mesh.lodIndices
+        static void BuildLods(MeshData& mesh);
+
+        //triangle count and error per level, summed over all clusters
+        static void PrintReport(const std::vector<MeshData>& meshes);
+    };
+
+}
+
+#endif
@@ -0,0 +1,241 @@
+#include "MipGenerator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        //sRGB8 -> 14 bit linear, so the sum of a 2x2 block still fits 16 bits, and that sum -> sRGB8.
+        //alpha is stored as value * 64 to share the layout. 14 bits keep the darkest sRGB steps ~5 apart
+        struct GammaTables {
+            uint16_t toLinear[256];
+            uint8_t sumToSrgb[65536];
+
+            GammaTables() {
+                for (int i = 0; i < 256; i++) {
+                    double c = i / 255.0;
+                    double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+                    toLinear[i] = (uint16_t)std::lround(linear * 16383.0);
+                }
+                for (int i = 0; i < 65536; i++) {
+                    double linear = std::min(1.0, i / (4.0 * 16383.0));
+                    double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                    sumToSrgb[i] = (uint8_t)std::lround(c * 255.0);
+                }
+            }
+        };
+
+        const GammaTables& GetTables() {
+            static GammaTables tables;
+            return tables;
+        }
+
+        void DecodeRow(const unsigned char* row, int width, uint16_t* decoded, const GammaTables& tables) {
+            for (int x = 0; x < width; x++) {
+                decoded[x * 4 + 0] = tables.toLinear[row[x * 4 + 0]];
+                decoded[x * 4 + 1] = tables.toLinear[row[x * 4 + 1]];
+                decoded[x * 4 + 2] = tables.toLinear[row[x * 4 + 2]];
+                decoded[x * 4 + 3] = (uint16_t)(row[x * 4 + 3] << 6);
+            }
+        }
+
+        inline void StorePixel(const uint16_t* sums, unsigned char* output, const GammaTables& tables) {
+            output[0] = tables.sumToSrgb[sums[0]];
+            output[1] = tables.sumToSrgb[sums[1]];
+            output[2] = tables.sumToSrgb[sums[2]];
+            //(a0 + a1 + a2 + a3 + 2) / 4 for the raw alpha values
+            output[3] = (unsigned char)((sums[3] + 128) >> 8);
+        }
+
+        void DownsampleRows(const unsigned char* source, int width, int height, unsigned char* destination) {
+            const GammaTables& tables = GetTables();
+            int nextWidth = std::max(1, width / 2);
+            int nextHeight = std::max(1, height / 2);
+            std::vector<uint16_t> decoded((size_t)width * 8);
+            uint16_t* top = decoded.data();
+            uint16_t* bottom = decoded.data() + (size_t)width * 4;
+            for (int y = 0; y < nextHeight; y++) {
+                int y0 = std::min(y * 2, height - 1);
+                int y1 = std::min(y * 2 + 1, height - 1);
+                DecodeRow(source + (size_t)y0 * width * 4, width, top, tables);
+                const uint16_t* row1 = top;
+                if (y1 != y0) {
+                    DecodeRow(source + (size_t)y1 * width * 4, width, bottom, tables);
+                    row1 = bottom;
+                }
+                unsigned char* output = destination + (size_t)y * nextWidth * 4;
+                for (int x = 0; x < nextWidth; x++) {
+                    int x0 = std::min(x * 2, width - 1);
+                    int x1 = std::min(x * 2 + 1, width - 1);
+                    uint16_t sums[4];
+                    for (int c = 0; c < 4; c++) {
+                        sums[c] = (uint16_t)(top[x0 * 4 + c] + top[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c]);
+                    }
+                    StorePixel(sums, output + x * 4, tables);
+                }
+            }
+        }
+
+        void BuildChainWith(const unsigned char* pixels, int width, int height, std::vector<unsigned char>& data,
+            std::vector<CookedLevel>& levels) {
+            data.clear();
+            levels.clear();
+            int levelWidth = width;
+            int levelHeight = height;
+            size_t totalSize = 0;
+            while (levelWidth > 1 || levelHeight > 1) {
+                levelWidth = std::max(1, levelWidth / 2);
+                levelHeight = std::max(1, levelHeight / 2);
+                CookedLevel info;
+                info.width = levelWidth;
+                info.height = levelHeight;
+                info.offset = totalSize;
+                info.size = (size_t)levelWidth * levelHeight * 4;
+                levels.push_back(info);
+                totalSize += info.size;
+            }
+            data.resize(totalSize);
+            const unsigned char* previous = pixels;
+            int previousWidth = width;
+            int previousHeight = height;
+            for (size_t i = 0; i < levels.size(); i++) {
+                DownsampleRows(previous, previousWidth, previousHeight, data.data() + levels[i].offset);
+                previous = data.data() + levels[i].offset;
+                previousWidth = levels[i].width;
+                previousHeight = levels[i].height;
+            }
+        }
+
+        double SrgbToLinear(int value) {
+            double c = value / 255.0;
+            return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+        }
+
+        double LinearToSrgb(double linear) {
+            double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+            return c * 255.0;
+        }
+
+        //pseudo random pixels, deterministic so failures can be reproduced
+        void FillNoise(std::vector<unsigned char>& pixels, uint32_t seed) {
+            uint32_t state = seed;
+            for (size_t i = 0; i < pixels.size(); i++) {
+                state = state * 1664525u + 1013904223u;
+                pixels[i] = (unsigned char)(state >> 24);
+            }
+        }
+    }
+
+    int MipGenerator::GetLevelCount(int width, int height) {
+        int count = 1;
+        while (width > 1 || height > 1) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            count++;
+        }
+        return count;
+    }
+
+    void MipGenerator::Downsample(const unsigned char* source, int width, int height, unsigned char* destination) {
+        DownsampleRows(source, width, height, destination);
+    }
+
+    void MipGenerator::BuildChain(const unsigned char* pixels, int width, int height,
+        std::vector<unsigned char>& data, std::vector<CookedLevel>& levels) {
+        BuildChainWith(pixels, width, height, data, levels);
+    }
+
+    bool MipGenerator::SelfTest() {
+        bool passed = true;
+        const GammaTables& tables = GetTables();
+
+        //every sRGB value survives the trip through the linear tables
+        int roundTripFailures = 0;
+        for (int i = 0; i < 256; i++) {
+            if (tables.sumToSrgb[tables.toLinear[i] * 4] != i) {
+                roundTripFailures++;
+            }
+        }
+        printf("sRGB round trip: %d of 256 values changed\n", roundTripFailures);
+        passed = passed && roundTripFailures == 0;
+
+        //black and white average to 50% light, which is 188 in sRGB rather than 128
+        const unsigned char checker[16] = { 0, 0, 0, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0, 0, 0, 255 };
+        unsigned char average[4];
+        Downsample(checker, 2, 2, average);
+        printf("black/white checker: %d %d %d %d (expected 188 188 188 255)\n", average[0], average[1], average[2], average[3]);
+        passed = passed && average[0] == 188 && average[1] == 188 && average[2] == 188 && average[3] == 255;
+
+        //odd and degenerate sizes exercise the clamped edges
+        const int sizes[][2] = { { 64, 64 }, { 37, 19 }, { 1, 9 }, { 9, 1 }, { 2, 2 }, { 513, 256 } };
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            int width = sizes[s][0];
+            int height = sizes[s][1];
+            std::vector<unsigned char> source((size_t)width * height * 4);
+            FillNoise(source, (uint32_t)(s + 1));
+
+            std::vector<unsigned char> data;
+            std::vector<CookedLevel> levels;
+            BuildChainWith(source.data(), width, height, data, levels);
+            bool levelCountMatches = (int)levels.size() + 1 == GetLevelCount(width, height);
+
+            //first level against a double precision box filter
+            int nextWidth = std::max(1, width / 2);
+            int nextHeight = std::max(1, height / 2);
+            double maxError = 0.0;
+            for (int y = 0; y < nextHeight; y++) {
+                for (int x = 0; x < nextWidth; x++) {
+                    int xs[2] = { std::min(x * 2, width - 1), std::min(x * 2 + 1, width - 1) };
+                    int ys[2] = { std::min(y * 2, height - 1), std::min(y * 2 + 1, height - 1) };
+                    for (int c = 0; c < 4; c++) {
+                        double sum = 0.0;
+                        for (int j = 0; j < 2; j++) {
+                            for (int i = 0; i < 2; i++) {
+                                int value = source[((size_t)ys[j] * width + xs[i]) * 4 + c];
+                                sum += c == 3 ? value : SrgbToLinear(value);
+                            }
+                        }
+                        double expected = c == 3 ? sum / 4.0 : LinearToSrgb(sum / 4.0);
+                        double error = std::fabs(expected - data[((size_t)y * nextWidth + x) * 4 + c]);
+                        maxError = std::max(maxError, error);
+                    }
+                }
+            }
+            printf("%dx%d: %zu levels%s, max error vs reference %.3f\n", width, height, levels.size() + 1,
+                levelCountMatches ? "" : " (WRONG LEVEL COUNT)", maxError);
+            passed = passed && levelCountMatches && maxError <= 1.0;
+        }
+
+        printf("%s\n", passed ? "PASSED" : "FAILED");
+        return passed;
+    }
+
+    void MipGenerator::Benchmark(int size) {
+        std::vector<unsigned char> source((size_t)size * size * 4);
+        FillNoise(source, 1);
+        GetTables();
+
+        std::vector<unsigned char> data;
+        std::vector<CookedLevel> levels;
+        const int runs = 5;
+        size_t pixels = 0;
+        BuildChainWith(source.data(), size, size, data, levels);
+        for (size_t i = 0; i < levels.size(); i++) {
+            pixels += (size_t)(i == 0 ? size * size : levels[i - 1].width * levels[i - 1].height);
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int run = 0; run < runs; run++) {
+            BuildChainWith(source.data(), size, size, data, levels);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / runs;
+        printf("%dx%d chain: %8.2f ms, %8.1f Mpixels/s\n", size, size, seconds * 1000.0, pixels / seconds / 1e6);
+    }
+}
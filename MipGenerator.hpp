@@ -0,0 +1,32 @@
+#ifndef MipGenerator_hpp
+#define MipGenerator_hpp
+
+#include "TextureCooker.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    //gamma correct mip chains for sRGB RGBA8 images: each level is a 2x2 box filter of the
+    //previous one with color averaged in linear space and alpha as is. Level sizes follow
+    //glGenerateMipmap (max(1, size / 2)). The sRGB conversions are table lookups, which SSE2
+    //can't gather, so there is no SIMD path. Does not need a GL context.
+    class MipGenerator {
+
+    public:
+        static int GetLevelCount(int width, int height);
+        //destination holds max(1, width / 2) x max(1, height / 2) pixels
+        static void Downsample(const unsigned char* source, int width, int height, unsigned char* destination);
+        //levels 1 and below of the image, packed back to back in data
+        static void BuildChain(const unsigned char* pixels, int width, int height,
+            std::vector<unsigned char>& data, std::vector<CookedLevel>& levels);
+
+        //compares the chain with a double precision reference
+        static bool SelfTest();
+        //Mpixels/s of the chain for a size x size image
+        static void Benchmark(int size);
+    };
+
+}
+
+#endif
@@ -1,80 +1,506 @@
 #include "Model3D.hpp"
+#include "ClusterCulling.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "ObjParser.hpp"
+#include "TextureRegistry.hpp"
+#include "VertexFormat.hpp"
+#include "VirtualFile.hpp"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
 
 namespace gps {
 
+    namespace {
+
+        //bytes copied per glBufferSubData call while streaming
+        const size_t STREAM_SLICE_BYTES = 256 * 1024;
+
+        //for meshes drawn with a mirroring transform, which would otherwise be back face culled
+        void FlipWinding(gps::MeshData& mesh) {
+            for (size_t j = 0; j + 2 < mesh.indices.size(); j += 3) {
+                std::swap(mesh.indices[j + 1], mesh.indices[j + 2]);
+            }
+        }
+
+        struct ObjIndexKey {
+            int vertex;
+            int normal;
+            int texcoord;
+
+            bool operator==(const ObjIndexKey& other) const {
+                return vertex == other.vertex && normal == other.normal && texcoord == other.texcoord;
+            }
+        };
+
+        struct ObjIndexHash {
+            size_t operator()(const ObjIndexKey& key) const {
+                size_t hash = (size_t)(unsigned int)key.vertex * 73856093u;
+                hash ^= (size_t)(unsigned int)key.normal * 19349663u;
+                hash ^= (size_t)(unsigned int)key.texcoord * 83492791u;
+                return hash;
+            }
+        };
+    }
+
+    float Model3D::lodPixelError = 1.0f;
+
+    Model3D::Model3D() {
+        residency = gps::RESIDENCY_NONE;
+        useTextureArrays = false;
+        streaming = false;
+        parsed = false;
+    }
+
     void Model3D::LoadModel(std::string fileName) {
-        std::string extension = fileName.substr(fileName.find_last_of('.') + 1);
+        std::vector<gps::MeshData> meshData;
+        if (!ParseModel(fileName, meshData)) {
+            return;
+        }
+
+        UploadMeshes(meshData, false);
+        calculateBoundingBox();
+    }
+
+    void Model3D::LoadModelAsync(std::string fileName) {
+        streaming = true;
+        parsed = false;
+        parseThread = std::thread([this, fileName]() {
+            ParseModel(fileName, parsedMeshes);
+            parsed = true;
+        });
+    }
+
+    double Model3D::StreamUploads(glm::vec3 viewerPosition, double budgetMilliseconds) {
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!streaming || !parsed) {
+            return 0.0;
+        }
+        if (parseThread.joinable()) {
+            parseThread.join();
+            //buffers are only allocated here, their contents follow in slices
+            UploadMeshes(parsedMeshes, true);
+            parsedMeshes.clear();
+            calculateBoundingBox();
+        }
+
+        double elapsed = 0.0;
+        while (elapsed < budgetMilliseconds) {
+            //the mesh whose bounding box is closest to the viewer goes first
+            int nearest = -1;
+            float nearestDistance = FLT_MAX;
+            for (size_t i = 0; i < meshes.size(); i++) {
+                if (meshes[i].isUploaded()) {
+                    continue;
+                }
+                glm::vec3 closestPoint = glm::clamp(viewerPosition, meshes[i].minPoint, meshes[i].maxPoint);
+                float distance = glm::length(closestPoint - viewerPosition);
+                if (distance < nearestDistance) {
+                    nearest = (int)i;
+                    nearestDistance = distance;
+                }
+            }
+            if (nearest < 0) {
+                streaming = false;
+                break;
+            }
+            meshes[nearest].UploadSlice(STREAM_SLICE_BYTES);
+            elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        }
+        return elapsed;
+    }
+
+    bool Model3D::isLoaded() {
+        return !streaming;
+    }
+
+    void Model3D::PrintVertexFormatReport(std::string fileName) {
+        std::vector<gps::MeshData> meshData;
+        if (ParseModel(fileName, meshData)) {
+            gps::VertexFormat::PrintReport(meshData);
+        }
+    }
+
+    void Model3D::PrintMeshStatistics(std::string fileName) {
+        //always the exporter's order, the cache already holds optimized meshes
+        std::vector<gps::MeshData> meshData;
+        std::vector<std::string> dependencies;
+        if (ReadSource(fileName, meshData, dependencies)) {
+            gps::MeshOptimizer::PrintStatistics(meshData);
+        }
+    }
+
+    void Model3D::PrintLodReport(std::string fileName) {
+        //from the source like ParseModel does on a cache miss, so the report reflects the current simplifier
+        std::vector<gps::MeshData> meshData;
+        std::vector<std::string> dependencies;
+        if (!ReadSource(fileName, meshData, dependencies)) {
+            return;
+        }
+        for (size_t i = 0; i < meshData.size(); i++) {
+            gps::MeshOptimizer::Optimize(meshData[i]);
+            gps::MeshSimplifier::BuildLods(meshData[i]);
+        }
+        gps::MeshSimplifier::PrintReport(meshData);
+    }
+
+    void Model3D::PrintMemoryReport(std::string fileName) {
+        std::vector<gps::MeshData> meshData;
+        if (!ParseModel(fileName, meshData)) {
+            return;
+        }
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        size_t lodIndexCount = 0;
+        for (size_t i = 0; i < meshData.size(); i++) {
+            vertexCount += meshData[i].vertices.size();
+            indexCount += meshData[i].indices.size();
+            lodIndexCount += meshData[i].lodIndices.size();
+        }
+        const char* names[] = { "none", "positions", "full" };
+        gps::MeshResidency policies[] = { gps::RESIDENCY_NONE, gps::RESIDENCY_POSITIONS, gps::RESIDENCY_FULL };
+        size_t fullBytes = gps::Mesh::GetResidentBytes(vertexCount, indexCount, lodIndexCount, gps::RESIDENCY_FULL);
+        printf("%s: %zu meshes, %zu vertices, %zu indices, %zu lod indices\n", fileName.c_str(), meshData.size(), vertexCount, indexCount, lodIndexCount);
+        printf("residency  cpu bytes after upload   saved\n");
+        for (int p = 0; p < 3; p++) {
+            size_t bytes = gps::Mesh::GetResidentBytes(vertexCount, indexCount, lodIndexCount, policies[p]);
+            printf("%-9s  %10zu KB            %10zu KB\n", names[p], bytes / 1024, (fullBytes - bytes) / 1024);
+        }
+    }
 
+    void Model3D::PrintTextureArrayReport(std::string fileName) {
+        std::vector<gps::MeshData> meshData;
+        if (!ParseModel(fileName, meshData)) {
+            return;
+        }
+        gps::TextureArraySet arrays;
+        size_t textureBinds = 0;
+        size_t packed = 0;
+        for (size_t i = 0; i < meshData.size(); i++) {
+            int materialId = meshData[i].materialId;
+            if (materialId < 0 || materialId >= (int)materials.size()) {
+                continue;
+            }
+            for (size_t t = 0; t < materials[materialId].textures.size(); t++) {
+                uint32_t array;
+                uint32_t layer;
+                textureBinds++;
+                if (arrays.Add(materials[materialId].textures[t].path, array, layer)) {
+                    packed++;
+                }
+            }
+        }
+        printf("%s: %zu meshes, %zu texture references, %zu packed into %zu layers\n", fileName.c_str(), meshData.size(), textureBinds, packed, arrays.getLayerCount());
+        arrays.PrintSummary();
+        printf("texture binds per draw of the model: %zu -> %zu\n", textureBinds, arrays.getArrayCount() + (textureBinds - packed));
+    }
+
+    void Model3D::setTextureArrays(bool enabled) {
+        this->useTextureArrays = enabled;
+    }
+
+    void Model3D::setResidency(gps::MeshResidency residency) {
+        this->residency = residency;
+    }
+
+    size_t Model3D::getResidentBytes() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            bytes += meshes[i].getResidentBytes();
+        }
+        return bytes;
+    }
+
+    bool Model3D::ParseModel(std::string fileName, std::vector<gps::MeshData>& meshData) {
+        if (gps::MeshCache::Load(fileName, meshData, materials)) {
+            return true;
+        }
+        std::vector<std::string> dependencies;
+        if (!ReadSource(fileName, meshData, dependencies)) {
+            return false;
+        }
+        for (size_t i = 0; i < meshData.size(); i++) {
+            gps::MeshOptimizer::Optimize(meshData[i]);
+            gps::MeshSimplifier::BuildLods(meshData[i]);
+            computeMeshBounds(meshData[i]);
+        }
+        gps::MeshCache::Save(fileName, meshData, materials, dependencies);
+        return true;
+    }
+
+    bool Model3D::ReadSource(std::string fileName, std::vector<gps::MeshData>& meshData, std::vector<std::string>& dependencies) {
+        std::string extension = fileName.substr(fileName.find_last_of('.') + 1);
         if (extension == "obj" || extension == "OBJ") {
             std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-            ReadOBJ(fileName, basePath);
+            ReadOBJ(fileName, basePath, meshData, dependencies);
+            return true;
         }
-        else if (extension == "fbx" || extension == "FBX") {
-            ReadFBX(fileName);
+        if (extension == "fbx" || extension == "FBX") {
+            if (!ReadFBX(fileName, meshData)) {
+                return false;
+            }
+            MergeByMaterial(meshData);
+            return true;
         }
-        else {
-            std::cerr << "Unsupported file format: " << extension << std::endl;
-            return;
+        std::cerr << "Unsupported file format: " << extension << std::endl;
+        return false;
+    }
+
+    void Model3D::UploadMeshes(std::vector<gps::MeshData>& meshData, bool deferUpload) {
+        glm::vec3 quantizationMin(0.0f);
+        glm::vec3 quantizationExtent(0.0f);
+        if (gps::Mesh::useCompactLayout) {
+            gps::VertexFormat::GetQuantizationBounds(meshData, quantizationMin, quantizationExtent);
+        }
+        for (size_t i = 0; i < meshData.size(); i++) {
+            std::vector<gps::Texture> textures;
+            std::vector<gps::TextureArrayLayer> layers;
+            int materialId = meshData[i].materialId;
+            if (materialId >= 0 && materialId < (int)materials.size()) {
+                for (size_t t = 0; t < materials[materialId].textures.size(); t++) {
+                    const gps::TextureInfo& info = materials[materialId].textures[t];
+                    gps::TextureArrayLayer layer;
+                    //textures that don't fit an array fall back to their own 2D texture
+                    if (useTextureArrays && textureArrays.Add(info.path, layer.array, layer.layer)) {
+                        layer.sampler = gps::TextureRegistry::Get().InternSampler(info.type);
+                        layers.push_back(layer);
+                    }
+                    else {
+                        textures.push_back(LoadTexture(info.path, info.type));
+                    }
+                }
+            }
+            meshes.emplace_back(std::move(meshData[i].vertices), std::move(meshData[i].indices), std::move(textures), deferUpload,
+                std::move(meshData[i].lodIndices), residency, quantizationMin, quantizationExtent);
+            meshes.back().textureLayers = std::move(layers);
+            meshes.back().minPoint = meshData[i].minPoint;
+            meshes.back().maxPoint = meshData[i].maxPoint;
+            meshes.back().clusters = std::move(meshData[i].clusters);
+            meshes.back().SetInstances(std::move(meshData[i].instances));
+        }
+        if (textureArrays.getArrayCount() > 0) {
+            textureArrays.Create();
+            textureArrays.PrintSummary();
         }
+    }
 
-        calculateBoundingBox();
+    void Model3D::BindTextureArrays() {
+        if (textureArrays.getArrayCount() > 0) {
+            textureArrays.Bind();
+        }
     }
 
+    void Model3D::MergeByMaterial(std::vector<gps::MeshData>& meshData) {
+        std::vector<gps::MeshData> merged;
+        std::unordered_map<int, size_t> materialBuckets;
+        for (size_t i = 0; i < meshData.size(); i++) {
+            //instanced meshes keep their own buffers, merging would copy them once per node
+            if (!meshData[i].instances.empty()) {
+                merged.push_back(std::move(meshData[i]));
+                continue;
+            }
+            auto bucket = materialBuckets.find(meshData[i].materialId);
+            if (bucket == materialBuckets.end()) {
+                materialBuckets[meshData[i].materialId] = merged.size();
+                merged.push_back(std::move(meshData[i]));
+                continue;
+            }
+            gps::MeshData& target = merged[bucket->second];
+            GLuint baseVertex = (GLuint)target.vertices.size();
+            target.vertices.insert(target.vertices.end(), meshData[i].vertices.begin(), meshData[i].vertices.end());
+            for (size_t j = 0; j < meshData[i].indices.size(); j++) {
+                target.indices.push_back(baseVertex + meshData[i].indices[j]);
+            }
+            target.minPoint = glm::min(target.minPoint, meshData[i].minPoint);
+            target.maxPoint = glm::max(target.maxPoint, meshData[i].maxPoint);
+        }
+        std::cout << "# of meshes    : " << meshData.size() << " -> " << merged.size() << " material batches" << std::endl;
+        meshData.swap(merged);
+    }
 
+    void Model3D::computeMeshBounds(gps::MeshData& mesh) {
+        mesh.minPoint = glm::vec3(FLT_MAX);
+        mesh.maxPoint = glm::vec3(-FLT_MAX);
+        for (auto& vertex : mesh.vertices) {
+            mesh.minPoint = glm::min(mesh.minPoint, vertex.Position);
+            mesh.maxPoint = glm::max(mesh.maxPoint, vertex.Position);
+        }
+        if (mesh.instances.empty() || mesh.vertices.empty()) {
+            return;
+        }
+        //instanced meshes are bounded by the corners of every placed copy
+        glm::vec3 localMin = mesh.minPoint;
+        glm::vec3 localMax = mesh.maxPoint;
+        mesh.minPoint = glm::vec3(FLT_MAX);
+        mesh.maxPoint = glm::vec3(-FLT_MAX);
+        for (size_t i = 0; i < mesh.instances.size(); i++) {
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 local((corner & 1) ? localMax.x : localMin.x, (corner & 2) ? localMax.y : localMin.y, (corner & 4) ? localMax.z : localMin.z);
+                glm::vec3 world = glm::vec3(mesh.instances[i] * glm::vec4(local, 1.0f));
+                mesh.minPoint = glm::min(mesh.minPoint, world);
+                mesh.maxPoint = glm::max(mesh.maxPoint, world);
+            }
+        }
+    }
 
     std::vector<glm::vec3> Model3D::GetTriangles() {
         std::vector<glm::vec3> triangles;
         for (auto& mesh : meshes) {
-            for (size_t i = 0; i < mesh.indices.size(); i += 3) {
-                glm::vec3 v0 = mesh.vertices[mesh.indices[i]].Position;
-                glm::vec3 v1 = mesh.vertices[mesh.indices[i + 1]].Position;
-                glm::vec3 v2 = mesh.vertices[mesh.indices[i + 2]].Position;
-                triangles.push_back(v0);
-                triangles.push_back(v1);
-                triangles.push_back(v2);
+            size_t instanceCount = mesh.isInstanced() ? mesh.instances.size() : 1;
+            for (size_t instance = 0; instance < instanceCount; instance++) {
+                glm::mat4 transform = mesh.isInstanced() ? mesh.instances[instance] : glm::mat4(1.0f);
+                //RESIDENCY_POSITIONS keeps only the positions, RESIDENCY_FULL the whole vertices
+                bool positionsOnly = mesh.vertices.empty();
+                for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+                    glm::vec3 p0 = positionsOnly ? mesh.positions[mesh.indices[i]] : mesh.vertices[mesh.indices[i]].Position;
+                    glm::vec3 p1 = positionsOnly ? mesh.positions[mesh.indices[i + 1]] : mesh.vertices[mesh.indices[i + 1]].Position;
+                    glm::vec3 p2 = positionsOnly ? mesh.positions[mesh.indices[i + 2]] : mesh.vertices[mesh.indices[i + 2]].Position;
+                    glm::vec3 v0 = glm::vec3(transform * glm::vec4(p0, 1.0f));
+                    glm::vec3 v1 = glm::vec3(transform * glm::vec4(p1, 1.0f));
+                    glm::vec3 v2 = glm::vec3(transform * glm::vec4(p2, 1.0f));
+                    triangles.push_back(v0);
+                    triangles.push_back(v1);
+                    triangles.push_back(v2);
+                }
             }
         }
         return triangles;
     }
-    std::vector<gps::Texture> Model3D::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
-        std::vector<gps::Texture> textures;
+
+    std::vector<glm::vec3> Model3D::ReadTriangles(std::string fileName) {
+        std::vector<glm::vec3> triangles;
+        std::vector<gps::MeshData> meshData;
+        if (!ParseModel(fileName, meshData)) {
+            return triangles;
+        }
+        for (auto& mesh : meshData) {
+            size_t instanceCount = mesh.instances.empty() ? 1 : mesh.instances.size();
+            for (size_t instance = 0; instance < instanceCount; instance++) {
+                glm::mat4 transform = mesh.instances.empty() ? glm::mat4(1.0f) : mesh.instances[instance];
+                for (size_t i = 0; i < mesh.indices.size(); i++) {
+                    triangles.push_back(glm::vec3(transform * glm::vec4(mesh.vertices[mesh.indices[i]].Position, 1.0f)));
+                }
+            }
+        }
+        return triangles;
+    }
+    std::vector<gps::TextureInfo> Model3D::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
+        std::vector<gps::TextureInfo> textures;
 
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
             aiString str;
             mat->GetTexture(type, i, &str);
 
-            bool skip = false;
-            for (size_t j = 0; j < loadedTextures.size(); j++) {
-                if (std::strcmp(loadedTextures[j].path.c_str(), str.C_Str()) == 0) {
-                    textures.push_back(loadedTextures[j]);
-                    skip = true;
-                    break;
+            gps::TextureInfo texture;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+        }
+
+        return textures;
+    }
+
+
+    void Model3D::Draw(gps::Shader& shaderProgram) {
+        BindTextureArrays();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            meshes[i].Draw(shaderProgram);
+        }
+    }
+
+    void Model3D::DrawCulled(gps::Shader& shaderProgram, glm::mat4 modelViewProjection, glm::vec3 cameraPosition, float lodScale) {
+        gps::ClusterCulling culling(modelViewProjection, cameraPosition);
+        std::vector<GLuint> visible;
+        std::vector<GLuint> levels;
+        BindTextureArrays();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            //clusters are placed per copy, so instanced meshes are drawn whole
+            if (meshes[i].isInstanced()) {
+                meshes[i].Draw(shaderProgram);
+                continue;
+            }
+            visible.clear();
+            levels.clear();
+            for (size_t c = 0; c < meshes[i].clusters.size(); c++) {
+                if (culling.IsVisible(meshes[i].clusters[c])) {
+                    visible.push_back((GLuint)c);
+                    levels.push_back(SelectLod(meshes[i].clusters[c], cameraPosition, lodScale));
                 }
             }
+            meshes[i].DrawClusters(shaderProgram, visible, levels);
+        }
+    }
 
-            if (!skip) {
-                gps::Texture texture;
-                texture.id = ReadTextureFromFile(str.C_Str());
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                loadedTextures.push_back(texture);
+    void Model3D::DrawLod(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::vec3 cameraPosition, float lodScale) {
+        //errors are measured in object space, so the camera moves there. Error over distance is
+        //then a ratio of object space lengths, the model's scale cancels out
+        glm::vec3 objectCamera = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f));
+        std::vector<GLuint> clusterIds;
+        std::vector<GLuint> levels;
+        BindTextureArrays();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (meshes[i].isInstanced()) {
+                meshes[i].Draw(shaderProgram);
+                continue;
+            }
+            clusterIds.clear();
+            levels.clear();
+            for (size_t c = 0; c < meshes[i].clusters.size(); c++) {
+                clusterIds.push_back((GLuint)c);
+                levels.push_back(SelectLod(meshes[i].clusters[c], objectCamera, lodScale));
             }
+            meshes[i].DrawClusters(shaderProgram, clusterIds, levels);
         }
-
-        return textures;
     }
 
+    GLuint Model3D::SelectLod(const gps::MeshCluster& cluster, glm::vec3 cameraPosition, float lodScale) {
+        if (lodScale <= 0.0f) {
+            return 0;
+        }
+        float distance = glm::length(cluster.sphereCenter - cameraPosition) - cluster.sphereRadius;
+        if (distance <= 0.0f) {
+            return 0;
+        }
+        GLuint level = 0;
+        while (level < cluster.lodCount && cluster.lodError[level] * lodScale / distance <= lodPixelError) {
+            level++;
+        }
+        return level;
+    }
 
-    void Model3D::Draw(gps::Shader shaderProgram) {
-        for (int i = 0; i < meshes.size(); i++) {
-            meshes[i].Draw(shaderProgram);
+    void Model3D::QueryClusters(glm::mat4 modelViewProjection, glm::vec3 cameraPosition, std::vector<gps::ClusterRef>& visible) {
+        gps::ClusterCulling culling(modelViewProjection, cameraPosition);
+        visible.clear();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (meshes[i].isInstanced()) {
+                continue;
+            }
+            for (size_t c = 0; c < meshes[i].clusters.size(); c++) {
+                if (culling.IsVisible(meshes[i].clusters[c])) {
+                    visible.push_back({ (unsigned int)i, (unsigned int)c });
+                }
+            }
         }
     }
 
+    size_t Model3D::getMeshCount() {
+        return meshes.size();
+    }
+
+    const std::vector<gps::MeshCluster>& Model3D::getClusters(size_t meshIndex) {
+        return meshes[meshIndex].clusters;
+    }
+
     glm::vec3 minPoint;
     glm::vec3 maxPoint;
 
@@ -82,21 +508,18 @@ namespace gps {
         minPoint = glm::vec3(FLT_MAX);
         maxPoint = glm::vec3(-FLT_MAX);
         for (auto& mesh : meshes) {
-            for (auto& vertex : mesh.vertices) {
-                minPoint = glm::min(minPoint, vertex.Position);
-                maxPoint = glm::max(maxPoint, vertex.Position);
-            }
+            minPoint = glm::min(minPoint, mesh.minPoint);
+            maxPoint = glm::max(maxPoint, mesh.maxPoint);
         }
     }
 
-    void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
+    void Model3D::ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData, std::vector<std::string>& materialLibraries) {
         std::cout << "Loading : " << fileName << std::endl;
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        int materialId;
+        std::vector<tinyobj::material_t> objMaterials;
         std::string err;
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+        bool ret = gps::ObjParser::Load(&attrib, &shapes, &objMaterials, &err, fileName, basePath, &materialLibraries);
         if (!err.empty()) {
             std::cerr << err << std::endl;
         }
@@ -104,22 +527,70 @@ namespace gps {
             exit(1);
         }
         std::cout << "# of shapes    : " << shapes.size() << std::endl;
-        std::cout << "# of materials : " << materials.size() << std::endl;
+        std::cout << "# of materials : " << objMaterials.size() << std::endl;
+        for (size_t m = 0; m < objMaterials.size(); m++) {
+            gps::Material currentMaterial;
+            currentMaterial.ambient = glm::vec3(objMaterials[m].ambient[0], objMaterials[m].ambient[1], objMaterials[m].ambient[2]);
+            currentMaterial.diffuse = glm::vec3(objMaterials[m].diffuse[0], objMaterials[m].diffuse[1], objMaterials[m].diffuse[2]);
+            currentMaterial.specular = glm::vec3(objMaterials[m].specular[0], objMaterials[m].specular[1], objMaterials[m].specular[2]);
+            std::string ambientTexturePath = objMaterials[m].ambient_texname;
+            if (!ambientTexturePath.empty()) {
+                currentMaterial.textures.push_back({ "ambientTexture", basePath + ambientTexturePath });
+            }
+            std::string diffuseTexturePath = objMaterials[m].diffuse_texname;
+            if (!diffuseTexturePath.empty()) {
+                currentMaterial.textures.push_back({ "diffuseTexture", basePath + diffuseTexturePath });
+            }
+            std::string specularTexturePath = objMaterials[m].specular_texname;
+            if (!specularTexturePath.empty()) {
+                currentMaterial.textures.push_back({ "specularTexture", basePath + specularTexturePath });
+            }
+            materials.push_back(currentMaterial);
+        }
+        size_t cornerCount = 0;
+        size_t weldedCount = 0;
+        //faces are bucketed by their own material, so every material becomes one mesh
+        //no matter how many shapes it is spread across
+        std::unordered_map<int, size_t> materialBuckets;
+        std::vector<std::unordered_map<ObjIndexKey, GLuint, ObjIndexHash>> weldedVertices;
         for (size_t s = 0; s < shapes.size(); s++) {
-            std::vector<gps::Vertex> vertices;
-            std::vector<GLuint> indices;
-            std::vector<gps::Texture> textures;
             size_t index_offset = 0;
             for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-                int fv = shapes[s].mesh.num_face_vertices[f];
+                size_t fv = shapes[s].mesh.num_face_vertices[f];
+                int materialId = f < shapes[s].mesh.material_ids.size() ? shapes[s].mesh.material_ids[f] : -1;
+                if (materialId < 0 || materialId >= (int)materials.size()) {
+                    materialId = -1;
+                }
+                auto bucket = materialBuckets.find(materialId);
+                if (bucket == materialBuckets.end()) {
+                    bucket = materialBuckets.insert(std::make_pair(materialId, meshData.size())).first;
+                    meshData.push_back(gps::MeshData());
+                    meshData.back().materialId = materialId;
+                    weldedVertices.push_back(std::unordered_map<ObjIndexKey, GLuint, ObjIndexHash>());
+                }
+                std::vector<gps::Vertex>& vertices = meshData[bucket->second].vertices;
+                std::vector<GLuint>& indices = meshData[bucket->second].indices;
+                //face corners with the same position/normal/texcoord triple share one vertex
+                std::unordered_map<ObjIndexKey, GLuint, ObjIndexHash>& welded = weldedVertices[bucket->second];
                 for (size_t v = 0; v < fv; v++) {
                     tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+                    ObjIndexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+                    auto existing = welded.find(key);
+                    if (existing != welded.end()) {
+                        indices.push_back(existing->second);
+                        continue;
+                    }
                     float vx = attrib.vertices[3 * idx.vertex_index + 0];
                     float vy = attrib.vertices[3 * idx.vertex_index + 1];
                     float vz = attrib.vertices[3 * idx.vertex_index + 2];
-                    float nx = attrib.normals[3 * idx.normal_index + 0];
-                    float ny = attrib.normals[3 * idx.normal_index + 1];
-                    float nz = attrib.normals[3 * idx.normal_index + 2];
+                    float nx = 0.0f;
+                    float ny = 0.0f;
+                    float nz = 0.0f;
+                    if (idx.normal_index != -1) {
+                        nx = attrib.normals[3 * idx.normal_index + 0];
+                        ny = attrib.normals[3 * idx.normal_index + 1];
+                        nz = attrib.normals[3 * idx.normal_index + 2];
+                    }
                     float tx = 0.0f;
                     float ty = 0.0f;
                     if (idx.texcoord_index != -1) {
@@ -133,69 +604,150 @@ namespace gps {
                     currentVertex.Position = vertexPosition;
                     currentVertex.Normal = vertexNormal;
                     currentVertex.TexCoords = vertexTexCoords;
+                    welded[key] = (GLuint)vertices.size();
+                    indices.push_back((GLuint)vertices.size());
                     vertices.push_back(currentVertex);
-                    indices.push_back((GLuint)(index_offset + v));
                 }
                 index_offset += fv;
             }
-            size_t a = shapes[s].mesh.material_ids.size();
-            if (a > 0 && materials.size() > 0) {
-                materialId = shapes[s].mesh.material_ids[0];
-                if (materialId != -1) {
-                    gps::Material currentMaterial;
-                    currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
-                    currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
-                    currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
-                    std::string ambientTexturePath = materials[materialId].ambient_texname;
-                    if (!ambientTexturePath.empty()) {
-                        gps::Texture currentTexture;
-                        currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-                        textures.push_back(currentTexture);
-                    }
-                    std::string diffuseTexturePath = materials[materialId].diffuse_texname;
-                    if (!diffuseTexturePath.empty()) {
-                        gps::Texture currentTexture;
-                        currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-                        textures.push_back(currentTexture);
-                    }
-                    std::string specularTexturePath = materials[materialId].specular_texname;
-                    if (!specularTexturePath.empty()) {
-                        gps::Texture currentTexture;
-                        currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-                        textures.push_back(currentTexture);
-                    }
-                }
-            }
-            meshes.push_back(gps::Mesh(vertices, indices, textures));
         }
+        for (size_t i = 0; i < meshData.size(); i++) {
+            cornerCount += meshData[i].indices.size();
+            weldedCount += meshData[i].vertices.size();
+            computeMeshBounds(meshData[i]);
+        }
+        std::cout << "# of meshes    : " << shapes.size() << " shapes -> " << meshData.size() << " material batches" << std::endl;
+        std::cout << "# of vertices  : " << cornerCount << " -> " << weldedCount << " after welding" << std::endl;
+        std::cout << "VBO size       : " << cornerCount * sizeof(gps::Vertex) / 1024 << " KB -> "
+            << weldedCount * sizeof(gps::Vertex) / 1024 << " KB" << std::endl;
     }
-    void Model3D::ReadFBX(std::string fileName) {
+    bool Model3D::ReadFBX(std::string fileName, std::vector<gps::MeshData>& meshData) {
         Assimp::Importer importer;
 
-        const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+        gps::VirtualFile file;
+        if (!file.Open(fileName)) {
+            std::cerr << "Error loading FBX file: cannot open " << fileName << std::endl;
+            return false;
+        }
+        const aiScene* scene = importer.ReadFileFromMemory(file.getData(), file.getSize(),
+            aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals, "fbx");
 
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             std::cerr << "Error loading FBX file: " << importer.GetErrorString() << std::endl;
-            return;
+            return false;
         }
 
-        processNode(scene->mRootNode, scene);
+        for (unsigned int i = 0; i < scene->mNumMaterials; i++) {
+            gps::Material currentMaterial;
+            currentMaterial.ambient = glm::vec3(0.0f);
+            currentMaterial.diffuse = glm::vec3(0.0f);
+            currentMaterial.specular = glm::vec3(0.0f);
+
+            std::vector<gps::TextureInfo> diffuseMaps = loadMaterialTextures(scene->mMaterials[i], aiTextureType_DIFFUSE, "texture_diffuse");
+            currentMaterial.textures.insert(currentMaterial.textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+
+            std::vector<gps::TextureInfo> specularMaps = loadMaterialTextures(scene->mMaterials[i], aiTextureType_SPECULAR, "texture_specular");
+            currentMaterial.textures.insert(currentMaterial.textures.end(), specularMaps.begin(), specularMaps.end());
+
+            materials.push_back(currentMaterial);
+        }
+
+        //each aiMesh is converted once, every node referencing it adds an instance
+        std::vector<int> meshSlots(scene->mNumMeshes, -1);
+        processNode(scene->mRootNode, scene, glm::mat4(1.0f), meshData, meshSlots);
+
+        size_t references = 0;
+        for (size_t i = 0; i < meshData.size(); i++) {
+            references += meshData[i].instances.size();
+        }
+        BakeSingleInstances(meshData);
+        SplitMirroredInstances(meshData);
+        size_t instanced = 0;
+        for (size_t i = 0; i < meshData.size(); i++) {
+            instanced += meshData[i].instances.empty() ? 0 : 1;
+        }
+        std::cout << "# of nodes     : " << references << " mesh references -> " << meshData.size() << " meshes, "
+            << instanced << " instanced" << std::endl;
+        return true;
     }
-    void Model3D::processNode(aiNode* node, const aiScene* scene) {
+    void Model3D::processNode(aiNode* node, const aiScene* scene, glm::mat4 parentTransform, std::vector<gps::MeshData>& meshData, std::vector<int>& meshSlots) {
+        //assimp matrices are row major
+        glm::mat4 transform = parentTransform * glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+
         for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            unsigned int meshIndex = node->mMeshes[i];
+            if (meshSlots[meshIndex] < 0) {
+                meshSlots[meshIndex] = (int)meshData.size();
+                meshData.push_back(processMesh(scene->mMeshes[meshIndex]));
+            }
+            meshData[meshSlots[meshIndex]].instances.push_back(transform);
         }
 
         for (unsigned int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, transform, meshData, meshSlots);
         }
     }
 
-    gps::Mesh Model3D::processMesh(aiMesh* mesh, const aiScene* scene) {
-        std::vector<gps::Vertex> vertices;
-        std::vector<GLuint> indices;
-        std::vector<gps::Texture> textures;
+    void Model3D::BakeSingleInstances(std::vector<gps::MeshData>& meshData) {
+        //a mesh placed once gets its node transform applied to the vertices, so it can still be merged and culled
+        for (size_t i = 0; i < meshData.size(); i++) {
+            gps::MeshData& mesh = meshData[i];
+            if (mesh.instances.size() != 1) {
+                computeMeshBounds(mesh);
+                continue;
+            }
+            glm::mat4 transform = mesh.instances[0];
+            glm::mat3 normalTransform = glm::inverseTranspose(glm::mat3(transform));
+            for (auto& vertex : mesh.vertices) {
+                vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+                if (glm::length(vertex.Normal) > 0.0f) {
+                    vertex.Normal = glm::normalize(normalTransform * vertex.Normal);
+                }
+            }
+            //a mirroring transform flips the winding
+            if (glm::determinant(glm::mat3(transform)) < 0.0f) {
+                FlipWinding(mesh);
+            }
+            mesh.instances.clear();
+            computeMeshBounds(mesh);
+        }
+    }
+
+    void Model3D::SplitMirroredInstances(std::vector<gps::MeshData>& meshData) {
+        //one instanced draw has a single winding, so the mirrored instances of a mesh get their
+        //own copy of it with the winding flipped
+        size_t meshCount = meshData.size();
+        for (size_t i = 0; i < meshCount; i++) {
+            std::vector<glm::mat4> kept;
+            std::vector<glm::mat4> mirrored;
+            for (size_t j = 0; j < meshData[i].instances.size(); j++) {
+                glm::mat4 transform = meshData[i].instances[j];
+                if (glm::determinant(glm::mat3(transform)) < 0.0f) {
+                    mirrored.push_back(transform);
+                }
+                else {
+                    kept.push_back(transform);
+                }
+            }
+            if (mirrored.empty()) {
+                continue;
+            }
+            if (kept.empty()) {
+                FlipWinding(meshData[i]);
+                continue;
+            }
+            meshData[i].instances = kept;
+            gps::MeshData copy = meshData[i];
+            copy.instances = mirrored;
+            FlipWinding(copy);
+            meshData.push_back(std::move(copy));
+        }
+    }
+
+    gps::MeshData Model3D::processMesh(aiMesh* mesh) {
+        gps::MeshData meshData;
+        std::vector<gps::Vertex>& vertices = meshData.vertices;
+        std::vector<GLuint>& indices = meshData.indices;
 
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
             gps::Vertex vertex;
@@ -215,85 +767,28 @@ namespace gps {
             }
         }
 
-        if (mesh->mMaterialIndex >= 0) {
-            aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        meshData.materialId = (int)mesh->mMaterialIndex;
 
-            std::vector<gps::Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-            std::vector<gps::Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-            textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        }
-
-        return gps::Mesh(vertices, indices, textures);
+        return meshData;
     }
 
 
     gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
-        for (int i = 0; i < loadedTextures.size(); i++) {
-            if (loadedTextures[i].path == path) {
-                return loadedTextures[i];
-            }
-        }
         gps::Texture currentTexture;
-        currentTexture.id = ReadTextureFromFile(path.c_str());
-        currentTexture.type = type;
-        currentTexture.path = path;
-        loadedTextures.push_back(currentTexture);
+        currentTexture.handle = gps::TextureRegistry::Get().Acquire(path);
+        currentTexture.textureId = 0;
+        currentTexture.sampler = gps::TextureRegistry::Get().InternSampler(type);
+        loadedTextures.push_back(currentTexture.handle);
         return currentTexture;
     }
 
-    GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-        int x, y, n;
-        int force_channels = 4;
-        unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-        if (!image_data) {
-            fprintf(stderr, "ERROR: could not load %s\n", file_name);
-            return 0;
-        }
-        if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-            fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name);
-        }
-        int width_in_bytes = x * 4;
-        unsigned char* top = nullptr;
-        unsigned char* bottom = nullptr;
-        unsigned char temp = 0;
-        int half_height = y / 2;
-        for (int row = 0; row < half_height; row++) {
-            top = image_data + row * width_in_bytes;
-            bottom = image_data + (y - row - 1) * width_in_bytes;
-            for (int col = 0; col < width_in_bytes; col++) {
-                temp = *top;
-                *top = *bottom;
-                *bottom = temp;
-                top++;
-                bottom++;
-            }
-        }
-        GLuint textureID;
-        glGenTextures(1, &textureID);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, x, y, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        return textureID;
-    }
-
     Model3D::~Model3D() {
-        for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures[i].id);
+        if (parseThread.joinable()) {
+            parseThread.join();
         }
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes[i].getBuffers().VBO;
-            GLuint EBO = meshes[i].getBuffers().EBO;
-            GLuint VAO = meshes[i].getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
+        for (size_t i = 0; i < loadedTextures.size(); i++) {
+            gps::TextureRegistry::Get().Release(loadedTextures[i]);
         }
+        //the meshes delete their own buffers
     }
 }
@@ -2,42 +2,103 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "TextureArray.hpp"
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <atomic>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 
 namespace gps {
 
+    struct ClusterRef {
+        unsigned int mesh;
+        unsigned int cluster;
+    };
+
     class Model3D {
 
     public:
+        Model3D();
         ~Model3D();
 
         void LoadModel(std::string fileName);
-        void Draw(gps::Shader shaderProgram);
+        //parses on a background thread; StreamUploads then moves the geometry to the GPU
+        //nearest mesh first, spending at most budgetMilliseconds per call. Returns the time spent.
+        void LoadModelAsync(std::string fileName);
+        double StreamUploads(glm::vec3 viewerPosition, double budgetMilliseconds);
+        bool isLoaded();
+        //parses the model and prints the float vs compact vertex layout comparison, no GL needed
+        void PrintVertexFormatReport(std::string fileName);
+        //ACMR/ATVR and overdraw of the source index order against the optimized one
+        void PrintMeshStatistics(std::string fileName);
+        //triangles and error of every generated detail level
+        void PrintLodReport(std::string fileName);
+        //CPU side geometry kept after the upload under each MeshResidency
+        void PrintMemoryReport(std::string fileName);
+        //how the material textures group into texture arrays and the binds that saves
+        void PrintTextureArrayReport(std::string fileName);
+
+        //applies to meshes uploaded after the call, RESIDENCY_NONE unless changed
+        void setResidency(gps::MeshResidency residency);
+        size_t getResidentBytes();
+        //packs textures of meshes uploaded after the call into texture arrays, off unless changed
+        void setTextureArrays(bool enabled);
+
+        static float lodPixelError;
+        void Draw(gps::Shader& shaderProgram);
+        //draws only the clusters passing ClusterCulling; matrix and camera are in object space.
+        //lodScale is the projection's pixels per unit at distance 1 (0 keeps full detail)
+        void DrawCulled(gps::Shader& shaderProgram, glm::mat4 modelViewProjection, glm::vec3 cameraPosition, float lodScale);
+        //draws every cluster at the coarsest level whose error projects below lodPixelError
+        void DrawLod(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::vec3 cameraPosition, float lodScale);
+        void QueryClusters(glm::mat4 modelViewProjection, glm::vec3 cameraPosition, std::vector<gps::ClusterRef>& visible);
+        size_t getMeshCount();
+        const std::vector<gps::MeshCluster>& getClusters(size_t meshIndex);
         std::vector<glm::vec3> GetTriangles();
-        std::vector<gps::Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
+        //parses the model and returns the same triangles as GetTriangles, no GL needed
+        std::vector<glm::vec3> ReadTriangles(std::string fileName);
+        std::vector<gps::TextureInfo> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
         void calculateBoundingBox();
 
     private:
         std::vector<gps::Mesh> meshes;
+        std::vector<gps::Material> materials;
         glm::vec3 minPoint;
         glm::vec3 maxPoint;
+        gps::MeshResidency residency;
+        bool useTextureArrays;
+        gps::TextureArraySet textureArrays;
+
+        std::thread parseThread;
+        std::atomic<bool> parsed;
+        std::vector<gps::MeshData> parsedMeshes;
+        bool streaming;
 
-        void ReadOBJ(std::string fileName, std::string basePath);
-        void ReadFBX(std::string fileName);
-        void processNode(aiNode* node, const aiScene* scene);
-        gps::Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+        bool ParseModel(std::string fileName, std::vector<gps::MeshData>& meshData);
+        //dependencies receives the files besides fileName the parse read, for the mesh cache
+        bool ReadSource(std::string fileName, std::vector<gps::MeshData>& meshData, std::vector<std::string>& dependencies);
+        GLuint SelectLod(const gps::MeshCluster& cluster, glm::vec3 cameraPosition, float lodScale);
+        void ReadOBJ(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData, std::vector<std::string>& materialLibraries);
+        bool ReadFBX(std::string fileName, std::vector<gps::MeshData>& meshData);
+        void processNode(aiNode* node, const aiScene* scene, glm::mat4 parentTransform, std::vector<gps::MeshData>& meshData, std::vector<int>& meshSlots);
+        gps::MeshData processMesh(aiMesh* mesh);
+        void computeMeshBounds(gps::MeshData& mesh);
+        void BakeSingleInstances(std::vector<gps::MeshData>& meshData);
+        void SplitMirroredInstances(std::vector<gps::MeshData>& meshData);
+        void MergeByMaterial(std::vector<gps::MeshData>& meshData);
+        void UploadMeshes(std::vector<gps::MeshData>& meshData, bool deferUpload);
+        void BindTextureArrays();
 
         gps::Texture LoadTexture(std::string path, std::string type);
-        GLuint ReadTextureFromFile(const char* file_name);
 
-        std::vector<gps::Texture> loadedTextures;
+        //one entry per Acquire, released in the destructor
+        std::vector<gps::TextureHandle> loadedTextures;
     };
 
 }
@@ -0,0 +1,498 @@
+#include "ObjParser.hpp"
+#include "MappedFile.hpp"
+#include "VirtualFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace gps {
+
+    namespace {
+
+        const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+        //negative obj indices are relative to the vertices read so far, so inside a
+        //chunk they can only be resolved once the counts of the previous chunks are known
+        const unsigned char RELATIVE_VERTEX = 1;
+        const unsigned char RELATIVE_NORMAL = 2;
+        const unsigned char RELATIVE_TEXCOORD = 4;
+
+        void PrefixTexture(std::string& texture, const std::string& directory) {
+            if (!texture.empty() && texture[0] != '/' && texture.find(':') == std::string::npos) {
+                texture = directory + texture;
+            }
+        }
+
+        //tinyobj::MaterialFileReader, reading the library through VirtualFile so it can come from the asset pack
+        class VirtualMaterialReader : public tinyobj::MaterialReader {
+
+        public:
+            explicit VirtualMaterialReader(const std::string& basePath) : basePath(basePath) {
+            }
+
+            virtual bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials,
+                std::map<std::string, int>* matMap, std::string* err) {
+                std::string filePath = basePath + matId;
+                gps::VirtualFile file;
+                if (!file.Open(filePath)) {
+                    if (err) {
+                        (*err) += "WARN: Material file [ " + filePath + " ] not found. Created a default material.";
+                    }
+                    std::istringstream empty;
+                    tinyobj::LoadMtl(matMap, materials, &empty);
+                    return true;
+                }
+                std::istringstream stream(std::string((const char*)file.getData(), file.getSize()));
+                size_t firstMaterial = materials->size();
+                tinyobj::LoadMtl(matMap, materials, &stream);
+                //texture paths are relative to the library, loaders resolve them against the obj's
+                //directory, so a library in a subdirectory adds that directory in front of them
+                size_t slash = matId.find_last_of('/');
+                if (slash != std::string::npos) {
+                    std::string directory = matId.substr(0, slash + 1);
+                    for (size_t i = firstMaterial; i < materials->size(); i++) {
+                        tinyobj::material_t& material = (*materials)[i];
+                        PrefixTexture(material.ambient_texname, directory);
+                        PrefixTexture(material.diffuse_texname, directory);
+                        PrefixTexture(material.specular_texname, directory);
+                        PrefixTexture(material.specular_highlight_texname, directory);
+                        PrefixTexture(material.bump_texname, directory);
+                        PrefixTexture(material.displacement_texname, directory);
+                        PrefixTexture(material.alpha_texname, directory);
+                    }
+                }
+                return true;
+            }
+
+        private:
+            std::string basePath;
+        };
+
+        enum ChunkEventType {
+            EVENT_GROUP,
+            EVENT_OBJECT,
+            EVENT_USEMTL,
+            EVENT_MTLLIB
+        };
+
+        struct ChunkEvent {
+            ChunkEventType type;
+            std::string name;
+            size_t cornerOffset;
+        };
+
+        struct ObjChunk {
+            const char* begin;
+            const char* end;
+            std::vector<float> vertices;
+            std::vector<float> normals;
+            std::vector<float> texcoords;
+            std::vector<tinyobj::index_t> corners;
+            std::vector<unsigned char> relative;
+            std::vector<ChunkEvent> events;
+        };
+
+        inline bool IsSpace(char c) {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        inline const char* SkipSpace(const char* p, const char* end) {
+            while (p < end && IsSpace(*p)) {
+                p++;
+            }
+            return p;
+        }
+
+        inline const char* SkipToken(const char* p, const char* end) {
+            while (p < end && !IsSpace(*p)) {
+                p++;
+            }
+            return p;
+        }
+
+        const char* ParseFloat(const char* p, const char* end, float& value) {
+            static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+            p = SkipSpace(p, end);
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = *p == '-';
+                p++;
+            }
+            double mantissa = 0.0;
+            int exponent = 0;
+            while (p < end && *p >= '0' && *p <= '9') {
+                mantissa = mantissa * 10.0 + (*p - '0');
+                p++;
+            }
+            if (p < end && *p == '.') {
+                p++;
+                while (p < end && *p >= '0' && *p <= '9') {
+                    mantissa = mantissa * 10.0 + (*p - '0');
+                    exponent--;
+                    p++;
+                }
+            }
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                p++;
+                bool negativeExponent = false;
+                if (p < end && (*p == '-' || *p == '+')) {
+                    negativeExponent = *p == '-';
+                    p++;
+                }
+                int explicitExponent = 0;
+                while (p < end && *p >= '0' && *p <= '9') {
+                    explicitExponent = explicitExponent * 10 + (*p - '0');
+                    p++;
+                }
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            }
+            while (exponent < -22) {
+                mantissa /= 1e22;
+                exponent += 22;
+            }
+            while (exponent > 22) {
+                mantissa *= 1e22;
+                exponent -= 22;
+            }
+            mantissa = exponent < 0 ? mantissa / powersOfTen[-exponent] : mantissa * powersOfTen[exponent];
+            value = (float)(negative ? -mantissa : mantissa);
+            return SkipToken(p, end);
+        }
+
+        inline const char* ParseInt(const char* p, const char* end, int& value) {
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                negative = *p == '-';
+                p++;
+            }
+            int result = 0;
+            while (p < end && *p >= '0' && *p <= '9') {
+                result = result * 10 + (*p - '0');
+                p++;
+            }
+            value = negative ? -result : result;
+            return p;
+        }
+
+        //same rules as tinyobj's fixIndex, except that relative indices stay chunk local
+        inline int FixIndex(int index, int localCount, unsigned char flag, unsigned char& relative) {
+            if (index > 0) {
+                return index - 1;
+            }
+            if (index == 0) {
+                return 0;
+            }
+            relative |= flag;
+            return localCount + index;
+        }
+
+        std::string ParseName(const char* p, const char* end) {
+            p = SkipSpace(p, end);
+            return std::string(p, SkipToken(p, end));
+        }
+
+        void ParseFace(ObjChunk& chunk, const char* p, const char* end) {
+            //polygon -> triangle fan, as tinyobj does. A fan only needs the first and the previous
+            //corner, so faces of any size are emitted while they are read
+            tinyobj::index_t first;
+            tinyobj::index_t previous;
+            unsigned char firstRelative = 0;
+            unsigned char previousRelative = 0;
+            int faceSize = 0;
+
+            p = SkipSpace(p, end);
+            while (p < end) {
+                tinyobj::index_t corner;
+                unsigned char relative = 0;
+                int index;
+                corner.vertex_index = -1;
+                corner.normal_index = -1;
+                corner.texcoord_index = -1;
+
+                p = ParseInt(p, end, index);
+                corner.vertex_index = FixIndex(index, (int)(chunk.vertices.size() / 3), RELATIVE_VERTEX, relative);
+                if (p < end && *p == '/') {
+                    p++;
+                    if (p < end && *p != '/') {
+                        p = ParseInt(p, end, index);
+                        corner.texcoord_index = FixIndex(index, (int)(chunk.texcoords.size() / 2), RELATIVE_TEXCOORD, relative);
+                    }
+                    if (p < end && *p == '/') {
+                        p++;
+                        p = ParseInt(p, end, index);
+                        corner.normal_index = FixIndex(index, (int)(chunk.normals.size() / 3), RELATIVE_NORMAL, relative);
+                    }
+                }
+                if (faceSize == 0) {
+                    first = corner;
+                    firstRelative = relative;
+                }
+                else if (faceSize >= 2) {
+                    chunk.corners.push_back(first);
+                    chunk.corners.push_back(previous);
+                    chunk.corners.push_back(corner);
+                    chunk.relative.push_back(firstRelative);
+                    chunk.relative.push_back(previousRelative);
+                    chunk.relative.push_back(relative);
+                }
+                previous = corner;
+                previousRelative = relative;
+                faceSize++;
+                p = SkipSpace(SkipToken(p, end), end);
+            }
+        }
+
+        void ParseChunk(ObjChunk& chunk) {
+            const char* p = chunk.begin;
+            while (p < chunk.end) {
+                const char* lineEnd = (const char*)memchr(p, '\n', chunk.end - p);
+                if (!lineEnd) {
+                    lineEnd = chunk.end;
+                }
+                const char* token = SkipSpace(p, lineEnd);
+                size_t length = lineEnd - token;
+
+                if (length >= 2 && token[0] == 'v' && IsSpace(token[1])) {
+                    float x, y, z;
+                    token = ParseFloat(token + 2, lineEnd, x);
+                    token = ParseFloat(token, lineEnd, y);
+                    ParseFloat(token, lineEnd, z);
+                    chunk.vertices.push_back(x);
+                    chunk.vertices.push_back(y);
+                    chunk.vertices.push_back(z);
+                }
+                else if (length >= 3 && token[0] == 'v' && token[1] == 'n' && IsSpace(token[2])) {
+                    float x, y, z;
+                    token = ParseFloat(token + 3, lineEnd, x);
+                    token = ParseFloat(token, lineEnd, y);
+                    ParseFloat(token, lineEnd, z);
+                    chunk.normals.push_back(x);
+                    chunk.normals.push_back(y);
+                    chunk.normals.push_back(z);
+                }
+                else if (length >= 3 && token[0] == 'v' && token[1] == 't' && IsSpace(token[2])) {
+                    float x, y;
+                    token = ParseFloat(token + 3, lineEnd, x);
+                    ParseFloat(token, lineEnd, y);
+                    chunk.texcoords.push_back(x);
+                    chunk.texcoords.push_back(y);
+                }
+                else if (length >= 2 && token[0] == 'f' && IsSpace(token[1])) {
+                    ParseFace(chunk, token + 2, lineEnd);
+                }
+                else if (length >= 7 && strncmp(token, "usemtl", 6) == 0 && IsSpace(token[6])) {
+                    chunk.events.push_back({ EVENT_USEMTL, ParseName(token + 7, lineEnd), chunk.corners.size() });
+                }
+                else if (length >= 7 && strncmp(token, "mtllib", 6) == 0 && IsSpace(token[6])) {
+                    chunk.events.push_back({ EVENT_MTLLIB, ParseName(token + 7, lineEnd), chunk.corners.size() });
+                }
+                else if (length >= 1 && token[0] == 'g' && (length == 1 || IsSpace(token[1]))) {
+                    chunk.events.push_back({ EVENT_GROUP, ParseName(token + 1, lineEnd), chunk.corners.size() });
+                }
+                else if (length >= 2 && token[0] == 'o' && IsSpace(token[1])) {
+                    chunk.events.push_back({ EVENT_OBJECT, ParseName(token + 2, lineEnd), chunk.corners.size() });
+                }
+
+                p = lineEnd + 1;
+            }
+        }
+
+        void AppendTriangles(tinyobj::shape_t& shape, const ObjChunk& chunk, size_t begin, size_t end, int material) {
+            if (begin >= end) {
+                return;
+            }
+            shape.mesh.indices.insert(shape.mesh.indices.end(), chunk.corners.begin() + begin, chunk.corners.begin() + end);
+            shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(), (end - begin) / 3, (unsigned char)3);
+            shape.mesh.material_ids.insert(shape.mesh.material_ids.end(), (end - begin) / 3, material);
+        }
+
+        template <typename Function>
+        void RunParallel(size_t count, unsigned int threadCount, Function function) {
+            std::atomic<size_t> next(0);
+            std::vector<std::thread> workers;
+            for (unsigned int t = 1; t < threadCount; t++) {
+                workers.push_back(std::thread([&]() {
+                    for (size_t i = next++; i < count; i = next++) {
+                        function(i);
+                    }
+                }));
+            }
+            for (size_t i = next++; i < count; i = next++) {
+                function(i);
+            }
+            for (size_t t = 0; t < workers.size(); t++) {
+                workers[t].join();
+            }
+        }
+    }
+
+    bool ObjParser::Load(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+        std::vector<tinyobj::material_t>* materials, std::string* err,
+        std::string fileName, std::string basePath, std::vector<std::string>* materialLibraries) {
+
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        gps::VirtualFile file;
+        if (!file.Open(fileName)) {
+            if (err) {
+                (*err) = "Cannot open file [" + fileName + "]\n";
+            }
+            return false;
+        }
+
+        const char* data = (const char*)file.getData();
+        size_t size = file.getSize();
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        size_t chunkCount = std::min((size_t)threadCount * 4, size / MIN_CHUNK_SIZE + 1);
+
+        //split at line boundaries
+        std::vector<ObjChunk> chunks(chunkCount);
+        const char* chunkBegin = data;
+        for (size_t c = 0; c < chunkCount; c++) {
+            const char* chunkEnd = data + size * (c + 1) / chunkCount;
+            if (chunkEnd < chunkBegin) {
+                chunkEnd = chunkBegin;
+            }
+            if (c + 1 < chunkCount) {
+                const char* newline = (const char*)memchr(chunkEnd, '\n', data + size - chunkEnd);
+                chunkEnd = newline ? newline + 1 : data + size;
+            }
+            else {
+                chunkEnd = data + size;
+            }
+            chunks[c].begin = chunkBegin;
+            chunks[c].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+
+        RunParallel(chunkCount, threadCount, [&](size_t c) {
+            ParseChunk(chunks[c]);
+        });
+
+        std::vector<size_t> vertexBase(chunkCount + 1, 0);
+        std::vector<size_t> normalBase(chunkCount + 1, 0);
+        std::vector<size_t> texcoordBase(chunkCount + 1, 0);
+        for (size_t c = 0; c < chunkCount; c++) {
+            vertexBase[c + 1] = vertexBase[c] + chunks[c].vertices.size();
+            normalBase[c + 1] = normalBase[c] + chunks[c].normals.size();
+            texcoordBase[c + 1] = texcoordBase[c] + chunks[c].texcoords.size();
+        }
+        attrib->vertices.resize(vertexBase[chunkCount]);
+        attrib->normals.resize(normalBase[chunkCount]);
+        attrib->texcoords.resize(texcoordBase[chunkCount]);
+
+        RunParallel(chunkCount, threadCount, [&](size_t c) {
+            ObjChunk& chunk = chunks[c];
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib->vertices.begin() + vertexBase[c]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), attrib->normals.begin() + normalBase[c]);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib->texcoords.begin() + texcoordBase[c]);
+            for (size_t i = 0; i < chunk.corners.size(); i++) {
+                if (chunk.relative[i] & RELATIVE_VERTEX) {
+                    chunk.corners[i].vertex_index += (int)(vertexBase[c] / 3);
+                }
+                if (chunk.relative[i] & RELATIVE_NORMAL) {
+                    chunk.corners[i].normal_index += (int)(normalBase[c] / 3);
+                }
+                if (chunk.relative[i] & RELATIVE_TEXCOORD) {
+                    chunk.corners[i].texcoord_index += (int)(texcoordBase[c] / 2);
+                }
+            }
+        });
+
+        //replay groups, objects and materials in file order
+        VirtualMaterialReader materialReader(basePath);
+        std::map<std::string, int> materialMap;
+        tinyobj::shape_t shape;
+        std::string name;
+        int material = -1;
+
+        for (size_t c = 0; c < chunkCount; c++) {
+            const ObjChunk& chunk = chunks[c];
+            size_t corner = 0;
+            for (size_t e = 0; e < chunk.events.size(); e++) {
+                const ChunkEvent& event = chunk.events[e];
+                AppendTriangles(shape, chunk, corner, event.cornerOffset, material);
+                corner = event.cornerOffset;
+
+                if (event.type == EVENT_USEMTL) {
+                    std::map<std::string, int>::iterator found = materialMap.find(event.name);
+                    material = found != materialMap.end() ? found->second : -1;
+                }
+                else if (event.type == EVENT_MTLLIB) {
+                    if (materialLibraries) {
+                        materialLibraries->push_back(basePath + event.name);
+                    }
+                    std::string mtlErr;
+                    bool ok = materialReader(event.name, materials, &materialMap, &mtlErr);
+                    if (err) {
+                        (*err) += mtlErr;
+                    }
+                    if (!ok) {
+                        return false;
+                    }
+                }
+                else {
+                    if (!shape.mesh.indices.empty()) {
+                        shape.name = name;
+                        shapes->push_back(tinyobj::shape_t());
+                        std::swap(shapes->back(), shape);
+                    }
+                    shape = tinyobj::shape_t();
+                    name = event.name;
+                }
+            }
+            AppendTriangles(shape, chunk, corner, chunk.corners.size(), material);
+        }
+        if (!shape.mesh.indices.empty()) {
+            shape.name = name;
+            shapes->push_back(shape);
+        }
+
+        return true;
+    }
+
+    void ObjParser::Benchmark(std::string fileName, std::string basePath) {
+        gps::MappedFile file;
+        if (!file.Open(fileName)) {
+            std::cerr << "ERROR: could not open " << fileName << std::endl;
+            return;
+        }
+        double megabytes = file.getSize() / (1024.0 * 1024.0);
+        file.Close();
+
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string err;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), true);
+        double tinyobjSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        size_t tinyobjVertices = attrib.vertices.size() / 3;
+        size_t tinyobjShapes = shapes.size();
+
+        materials.clear();
+        start = std::chrono::high_resolution_clock::now();
+        ObjParser::Load(&attrib, &shapes, &materials, &err, fileName, basePath, nullptr);
+        double parallelSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << "File              : " << fileName << " (" << megabytes << " MB)" << std::endl;
+        std::cout << "tinyobj::LoadObj  : " << tinyobjSeconds * 1000.0 << " ms, " << megabytes / tinyobjSeconds << " MB/s, "
+            << tinyobjVertices << " vertices, " << tinyobjShapes << " shapes" << std::endl;
+        std::cout << "gps::ObjParser    : " << parallelSeconds * 1000.0 << " ms, " << megabytes / parallelSeconds << " MB/s, "
+            << attrib.vertices.size() / 3 << " vertices, " << shapes.size() << " shapes" << std::endl;
+        std::cout << "Speedup           : " << tinyobjSeconds / parallelSeconds << "x on "
+            << std::max(1u, std::thread::hardware_concurrency()) << " threads" << std::endl;
+    }
+}
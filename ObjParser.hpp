@@ -0,0 +1,28 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    //multi-threaded replacement for tinyobj::LoadObj: the file is memory mapped,
+    //split at line boundaries and each chunk is tokenized on its own worker thread.
+    //the merged result has the same layout tinyobj produces with triangulation on.
+    class ObjParser {
+
+    public:
+        //materialLibraries, when given, receives the path of every mtllib the file names, found or not
+        static bool Load(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+            std::vector<tinyobj::material_t>* materials, std::string* err,
+            std::string fileName, std::string basePath, std::vector<std::string>* materialLibraries);
+
+        //parses the file with both loaders and prints their throughput
+        static void Benchmark(std::string fileName, std::string basePath);
+    };
+
+}
+
+#endif
@@ -7,27 +7,18 @@
 //
 
 #include "Shader.hpp"
+#include "VirtualFile.hpp"
 
 namespace gps {
     std::string Shader::readShaderFile(std::string fileName) {
 
-        std::ifstream shaderFile;
-        std::string shaderString;
-        
-        //open shader file
-        shaderFile.open(fileName);
-        
-        std::stringstream shaderStringStream;
-        
-        //read shader content into stream
-        shaderStringStream << shaderFile.rdbuf();
-        
-        //close shader file
-        shaderFile.close();
-        
-        //convert stream into GLchar array
-        shaderString = shaderStringStream.str();
-        return shaderString;
+        //the source comes from the asset pack when one is mounted
+        gps::VirtualFile shaderFile;
+        if (!shaderFile.Open(fileName)) {
+            std::cout << "Shader file not found: " << fileName << std::endl;
+            return std::string();
+        }
+        return std::string((const char*)shaderFile.getData(), shaderFile.getSize());
     }
     
     void Shader::shaderCompileLog(GLuint shaderId) {
@@ -81,7 +72,7 @@ namespace gps {
         shaderCompileLog(fragmentShader);
         
         //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
+        this->shaderProgram.reset(glCreateProgram());
         glAttachShader(this->shaderProgram, vertexShader);
         glAttachShader(this->shaderProgram, fragmentShader);
         glLinkProgram(this->shaderProgram);
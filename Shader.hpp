@@ -10,6 +10,8 @@
     #include <GL/glew.h>
 #endif
 
+#include "GLHandle.hpp"
+
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -20,7 +22,8 @@ namespace gps {
     class Shader {
 
     public:
-        GLuint shaderProgram;
+        //owns the linked program, converts to GLuint for gl* calls
+        GLProgram shaderProgram;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
         void useShaderProgram();
     
@@ -0,0 +1,138 @@
+#include "TextureArray.hpp"
+#include "MipGenerator.hpp"
+#include "TextureLoader.hpp"
+#include "VirtualFile.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace gps {
+
+    bool TextureArraySet::Add(std::string path, uint32_t& array, uint32_t& layer) {
+        //repeated textures are found from the hash alone, without reading the file
+        uint64_t contentHash;
+        if (!gps::VirtualFile::GetHash(path, contentHash)) {
+            return false;
+        }
+        auto existing = slotsByHash.find(contentHash);
+        if (existing != slotsByHash.end()) {
+            array = existing->second.array;
+            layer = existing->second.layer;
+            return true;
+        }
+
+        gps::VirtualFile file;
+        int width;
+        int height;
+        int channels;
+        if (!file.Open(path) || !stbi_info_from_memory(file.getData(), (int)file.getSize(), &width, &height, &channels)) {
+            return false;
+        }
+
+        size_t target = arrays.size();
+        for (size_t i = 0; i < arrays.size(); i++) {
+            if (arrays[i].width == width && arrays[i].height == height && arrays[i].paths.size() < MAX_TEXTURE_ARRAY_LAYERS) {
+                target = i;
+                break;
+            }
+        }
+        if (target == arrays.size()) {
+            if (arrays.size() == MAX_TEXTURE_ARRAYS) {
+                return false;
+            }
+            arrays.emplace_back();
+            arrays.back().width = width;
+            arrays.back().height = height;
+        }
+
+        Slot slot = { (uint32_t)target, (uint32_t)arrays[target].paths.size() };
+        arrays[target].paths.push_back(path);
+        slotsByHash[contentHash] = slot;
+        array = slot.array;
+        layer = slot.layer;
+        return true;
+    }
+
+    void TextureArraySet::Create() {
+        for (size_t i = 0; i < arrays.size(); i++) {
+            Array& array = arrays[i];
+            if (array.texture != 0) {
+                continue;
+            }
+            GLsizei layerCount = (GLsizei)array.paths.size();
+            int levelCount = gps::MipGenerator::GetLevelCount(array.width, array.height);
+            array.texture = CreateGLTexture();
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array.texture);
+            if (gps::TextureLoader::HasTextureStorage()) {
+                glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, GL_SRGB8, array.width, array.height, layerCount);
+            }
+            else {
+                for (int level = 0; level < levelCount; level++) {
+                    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_SRGB, std::max(1, array.width >> level), std::max(1, array.height >> level),
+                        layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                }
+            }
+
+            //neutral grey until the decoded layers arrive, like TextureLoader's placeholders.
+            //every level is filled so layers that fail to load still sample grey
+            std::vector<unsigned char> placeholder((size_t)array.width * array.height * 4, 128);
+            for (size_t p = 3; p < placeholder.size(); p += 4) {
+                placeholder[p] = 255;
+            }
+            for (int level = 0; level < levelCount; level++) {
+                for (GLsizei layer = 0; layer < layerCount; layer++) {
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, std::max(1, array.width >> level), std::max(1, array.height >> level), 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, placeholder.data());
+                }
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            //complete with level 0 alone, TextureLoader lifts this once the mip chain exists
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            for (GLsizei layer = 0; layer < layerCount; layer++) {
+                gps::TextureLoader::Get().LoadLayer(array.texture, layer, array.width, array.height, array.paths[layer]);
+            }
+        }
+    }
+
+    void TextureArraySet::Bind() {
+        for (size_t i = 0; i < arrays.size(); i++) {
+            glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_FIRST_UNIT + (GLuint)i);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i].texture);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void TextureArraySet::SetSamplerUnits(gps::Shader& shader) {
+        //unset samplers default to unit 0, where a sampler2D of another type lives
+        shader.useShaderProgram();
+        for (int i = 0; i < MAX_TEXTURE_ARRAYS; i++) {
+            std::string name = "textureArrays[" + std::to_string(i) + "]";
+            glUniform1i(glGetUniformLocation(shader.shaderProgram, name.c_str()), TEXTURE_ARRAY_FIRST_UNIT + i);
+        }
+    }
+
+    size_t TextureArraySet::getArrayCount() {
+        return arrays.size();
+    }
+
+    size_t TextureArraySet::getLayerCount() {
+        size_t layers = 0;
+        for (size_t i = 0; i < arrays.size(); i++) {
+            layers += arrays[i].paths.size();
+        }
+        return layers;
+    }
+
+    void TextureArraySet::PrintSummary() {
+        for (size_t i = 0; i < arrays.size(); i++) {
+            size_t bytes = (size_t)arrays[i].width * arrays[i].height * 4 * arrays[i].paths.size();
+            printf("texture array %zu: %dx%d, %zu layers, %zu KB\n", i, arrays[i].width, arrays[i].height, arrays[i].paths.size(), bytes / 1024);
+        }
+    }
+}
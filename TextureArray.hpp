@@ -0,0 +1,67 @@
+#ifndef TextureArray_hpp
+#define TextureArray_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "GLHandle.hpp"
+#include "Shader.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    //the shader declares textureArrays[MAX_TEXTURE_ARRAYS], bound to consecutive units from
+    //TEXTURE_ARRAY_FIRST_UNIT so they never share a unit with the 2D samplers
+    const int MAX_TEXTURE_ARRAYS = 4;
+    const GLuint TEXTURE_ARRAY_FIRST_UNIT = 8;
+    //the GL 3.0 minimum for GL_MAX_ARRAY_TEXTURE_LAYERS
+    const size_t MAX_TEXTURE_ARRAY_LAYERS = 256;
+
+    //packs a model's textures into GL_TEXTURE_2D_ARRAY layers, one array per image size,
+    //so a world made of many small block textures draws with a single texture binding.
+    //Add only reads the image header and needs no GL context; Create allocates the arrays
+    //and queues their layers on TextureLoader.
+    class TextureArraySet {
+
+    public:
+        //false when the image can't be read or every array slot is taken by other sizes
+        bool Add(std::string path, uint32_t& array, uint32_t& layer);
+        void Create();
+        //binds every array to its unit, the sampler uniforms are set once by SetSamplerUnits
+        void Bind();
+        static void SetSamplerUnits(gps::Shader& shader);
+
+        size_t getArrayCount();
+        size_t getLayerCount();
+        void PrintSummary();
+
+    private:
+        struct Array {
+            int width;
+            int height;
+            std::vector<std::string> paths;
+            GLTexture texture;
+        };
+
+        struct Slot {
+            uint32_t array;
+            uint32_t layer;
+        };
+
+        std::vector<Array> arrays;
+        //identical images referenced through different paths share a layer
+        std::unordered_map<uint64_t, Slot> slotsByHash;
+    };
+
+}
+
+#endif
@@ -0,0 +1,516 @@
+#include "TextureCooker.hpp"
+#include "MipGenerator.hpp"
+#include "VirtualFile.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+namespace gps {
+
+    namespace {
+
+        const uint32_t DDS_MAGIC = 0x20534444;
+        const uint32_t DDSD_CAPS = 0x1;
+        const uint32_t DDSD_HEIGHT = 0x2;
+        const uint32_t DDSD_WIDTH = 0x4;
+        const uint32_t DDSD_PIXELFORMAT = 0x1000;
+        const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+        const uint32_t DDSD_LINEARSIZE = 0x80000;
+        const uint32_t DDPF_FOURCC = 0x4;
+        const uint32_t DDSCAPS_COMPLEX = 0x8;
+        const uint32_t DDSCAPS_TEXTURE = 0x1000;
+        const uint32_t DDSCAPS_MIPMAP = 0x400000;
+        const uint32_t FOURCC_DXT1 = 0x31545844;
+        const uint32_t FOURCC_DXT5 = 0x35545844;
+
+        struct DDSPixelFormat {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t fourCC;
+            uint32_t rgbBitCount;
+            uint32_t rBitMask;
+            uint32_t gBitMask;
+            uint32_t bBitMask;
+            uint32_t aBitMask;
+        };
+
+        struct DDSHeader {
+            uint32_t size;
+            uint32_t flags;
+            uint32_t height;
+            uint32_t width;
+            uint32_t pitchOrLinearSize;
+            uint32_t depth;
+            uint32_t mipMapCount;
+            uint32_t reserved1[11];
+            DDSPixelFormat pixelFormat;
+            uint32_t caps;
+            uint32_t caps2;
+            uint32_t caps3;
+            uint32_t caps4;
+            uint32_t reserved2;
+        };
+
+        inline uint16_t PackColor565(const float* color) {
+            int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+            int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+            int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+            return (uint16_t)((r << 11) | (g << 5) | b);
+        }
+
+        inline void UnpackColor565(uint16_t packed, int* color) {
+            int r = (packed >> 11) & 31;
+            int g = (packed >> 5) & 63;
+            int b = packed & 31;
+            color[0] = (r << 3) | (r >> 2);
+            color[1] = (g << 2) | (g >> 4);
+            color[2] = (b << 3) | (b >> 2);
+        }
+
+        inline int ColorDistance(const unsigned char* pixel, const int* color) {
+            int dr = pixel[0] - color[0];
+            int dg = pixel[1] - color[1];
+            int db = pixel[2] - color[2];
+            return dr * dr + dg * dg + db * db;
+        }
+
+        //4x4 block with edge texels repeated for sizes that are not multiples of 4
+        void GatherBlock(const unsigned char* pixels, int width, int height, int blockX, int blockY, unsigned char* block) {
+            for (int y = 0; y < 4; y++) {
+                int sourceY = std::min(blockY * 4 + y, height - 1);
+                for (int x = 0; x < 4; x++) {
+                    int sourceX = std::min(blockX * 4 + x, width - 1);
+                    memcpy(block + (y * 4 + x) * 4, pixels + ((size_t)sourceY * width + sourceX) * 4, 4);
+                }
+            }
+        }
+
+        void ScatterBlock(const unsigned char* block, int width, int height, int blockX, int blockY, unsigned char* pixels) {
+            for (int y = 0; y < 4 && blockY * 4 + y < height; y++) {
+                for (int x = 0; x < 4 && blockX * 4 + x < width; x++) {
+                    memcpy(pixels + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4, block + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+    }
+
+    std::string TextureCooker::GetCookedPath(std::string sourcePath) {
+        return sourcePath + ".dds";
+    }
+
+    bool TextureCooker::IsUpToDate(std::string sourcePath) {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t cookedSize;
+        int64_t cookedTime;
+        if (!gps::VirtualFile::GetStamp(GetCookedPath(sourcePath), cookedSize, cookedTime)) {
+            return false;
+        }
+        //a cooked file without its source (e.g. shipped alone) is still usable
+        return !gps::VirtualFile::GetStamp(sourcePath, sourceSize, sourceTime) || cookedTime >= sourceTime;
+    }
+
+    size_t TextureCooker::GetLevelSize(int width, int height, CookedFormat format) {
+        size_t blockBytes = format == COOKED_BC1 ? 8 : 16;
+        return (size_t)std::max(1, (width + 3) / 4) * (size_t)std::max(1, (height + 3) / 4) * blockBytes;
+    }
+
+    void TextureCooker::EncodeColorBlock(const unsigned char* block, unsigned char* output) {
+        //endpoints from the extremes along the principal axis of the block colors
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                mean[c] += block[i * 4 + c] / 16.0f;
+            }
+        }
+        float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            float r = block[i * 4 + 0] - mean[0];
+            float g = block[i * 4 + 1] - mean[1];
+            float b = block[i * 4 + 2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+            float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+            float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+            float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+            if (length < 1e-6f) {
+                break;
+            }
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+        float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        for (int c = 0; c < 3; c++) {
+            axis[c] /= axisLength;
+        }
+
+        float minProjection = FLT_MAX;
+        float maxProjection = -FLT_MAX;
+        for (int i = 0; i < 16; i++) {
+            float projection = (block[i * 4 + 0] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+        //pull the endpoints in slightly, the interpolated colors cover the ends better that way
+        float inset = (maxProjection - minProjection) / 16.0f;
+        minProjection += inset;
+        maxProjection -= inset;
+
+        float endpoint0[3];
+        float endpoint1[3];
+        for (int c = 0; c < 3; c++) {
+            endpoint0[c] = mean[c] + axis[c] * maxProjection;
+            endpoint1[c] = mean[c] + axis[c] * minProjection;
+        }
+        uint16_t color0 = PackColor565(endpoint0);
+        uint16_t color1 = PackColor565(endpoint1);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            UnpackColor565(color0, palette[0]);
+            UnpackColor565(color1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++) {
+                int best = 0;
+                int bestDistance = ColorDistance(block + i * 4, palette[0]);
+                for (int p = 1; p < 4; p++) {
+                    int distance = ColorDistance(block + i * 4, palette[p]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t)best << (i * 2);
+            }
+        }
+
+        output[0] = (unsigned char)(color0 & 0xFF);
+        output[1] = (unsigned char)(color0 >> 8);
+        output[2] = (unsigned char)(color1 & 0xFF);
+        output[3] = (unsigned char)(color1 >> 8);
+        for (int i = 0; i < 4; i++) {
+            output[4 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+        }
+    }
+
+    void TextureCooker::EncodeAlphaBlock(const unsigned char* block, unsigned char* output) {
+        int alpha0 = 0;
+        int alpha1 = 255;
+        for (int i = 0; i < 16; i++) {
+            alpha0 = std::max(alpha0, (int)block[i * 4 + 3]);
+            alpha1 = std::min(alpha1, (int)block[i * 4 + 3]);
+        }
+
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            int palette[8];
+            palette[0] = alpha0;
+            palette[1] = alpha1;
+            for (int p = 1; p < 7; p++) {
+                palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+            }
+            for (int i = 0; i < 16; i++) {
+                int best = 0;
+                int bestDistance = 256;
+                for (int p = 0; p < 8; p++) {
+                    int distance = std::abs((int)block[i * 4 + 3] - palette[p]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (uint64_t)best << (i * 3);
+            }
+        }
+
+        output[0] = (unsigned char)alpha0;
+        output[1] = (unsigned char)alpha1;
+        for (int i = 0; i < 6; i++) {
+            output[2 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+        }
+    }
+
+    void TextureCooker::DecodeColorBlock(const unsigned char* input, unsigned char* block, bool allowTransparent) {
+        uint16_t color0 = (uint16_t)(input[0] | (input[1] << 8));
+        uint16_t color1 = (uint16_t)(input[2] | (input[3] << 8));
+        uint32_t indices = input[4] | (input[5] << 8) | (input[6] << 16) | ((uint32_t)input[7] << 24);
+
+        int palette[4][4];
+        UnpackColor565(color0, palette[0]);
+        UnpackColor565(color1, palette[1]);
+        palette[0][3] = 255;
+        palette[1][3] = 255;
+        palette[2][3] = 255;
+        palette[3][3] = 255;
+        if (color0 > color1 || !allowTransparent) {
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+        }
+        else {
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+            palette[3][3] = 0;
+        }
+
+        for (int i = 0; i < 16; i++) {
+            int index = (indices >> (i * 2)) & 3;
+            for (int c = 0; c < 4; c++) {
+                block[i * 4 + c] = (unsigned char)palette[index][c];
+            }
+        }
+    }
+
+    void TextureCooker::DecodeAlphaBlock(const unsigned char* input, unsigned char* block) {
+        int palette[8];
+        palette[0] = input[0];
+        palette[1] = input[1];
+        if (palette[0] > palette[1]) {
+            for (int p = 1; p < 7; p++) {
+                palette[p + 1] = ((7 - p) * palette[0] + p * palette[1]) / 7;
+            }
+        }
+        else {
+            for (int p = 1; p < 5; p++) {
+                palette[p + 1] = ((5 - p) * palette[0] + p * palette[1]) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t indices = 0;
+        for (int i = 0; i < 6; i++) {
+            indices |= (uint64_t)input[2 + i] << (i * 8);
+        }
+        for (int i = 0; i < 16; i++) {
+            block[i * 4 + 3] = (unsigned char)palette[(indices >> (i * 3)) & 7];
+        }
+    }
+
+    void TextureCooker::EncodeImage(const unsigned char* pixels, int width, int height, CookedFormat format, unsigned char* blocks) {
+        int blocksX = std::max(1, (width + 3) / 4);
+        int blocksY = std::max(1, (height + 3) / 4);
+        unsigned char block[64];
+        for (int by = 0; by < blocksY; by++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                GatherBlock(pixels, width, height, bx, by, block);
+                if (format == COOKED_BC3) {
+                    EncodeAlphaBlock(block, blocks);
+                    blocks += 8;
+                }
+                EncodeColorBlock(block, blocks);
+                blocks += 8;
+            }
+        }
+    }
+
+    void TextureCooker::DecodeImage(const unsigned char* blocks, int width, int height, CookedFormat format, unsigned char* pixels) {
+        int blocksX = std::max(1, (width + 3) / 4);
+        int blocksY = std::max(1, (height + 3) / 4);
+        unsigned char block[64];
+        for (int by = 0; by < blocksY; by++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                if (format == COOKED_BC3) {
+                    DecodeColorBlock(blocks + 8, block, false);
+                    DecodeAlphaBlock(blocks, block);
+                    blocks += 16;
+                }
+                else {
+                    DecodeColorBlock(blocks, block, true);
+                    blocks += 8;
+                }
+                ScatterBlock(block, width, height, bx, by, pixels);
+            }
+        }
+    }
+
+    double TextureCooker::ComputePSNR(const unsigned char* original, const unsigned char* decoded, int width, int height, bool withAlpha) {
+        int channels = withAlpha ? 4 : 3;
+        double squaredError = 0.0;
+        size_t pixelCount = (size_t)width * height;
+        for (size_t i = 0; i < pixelCount; i++) {
+            for (int c = 0; c < channels; c++) {
+                double difference = (double)original[i * 4 + c] - (double)decoded[i * 4 + c];
+                squaredError += difference * difference;
+            }
+        }
+        double meanSquaredError = squaredError / (double)(pixelCount * channels);
+        if (meanSquaredError <= 0.0) {
+            return 99.0;
+        }
+        return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+    }
+
+    void TextureCooker::FlipRows(unsigned char* pixels, int width, int height) {
+        size_t width_in_bytes = (size_t)width * 4;
+        std::vector<unsigned char> row(width_in_bytes);
+        for (int top = 0, bottom = height - 1; top < bottom; top++, bottom--) {
+            unsigned char* topRow = pixels + top * width_in_bytes;
+            unsigned char* bottomRow = pixels + bottom * width_in_bytes;
+            memcpy(row.data(), topRow, width_in_bytes);
+            memcpy(topRow, bottomRow, width_in_bytes);
+            memcpy(bottomRow, row.data(), width_in_bytes);
+        }
+    }
+
+    bool TextureCooker::Cook(std::string sourcePath) {
+        int width, height, n;
+        unsigned char* image_data = stbi_load(sourcePath.c_str(), &width, &height, &n, 4);
+        if (!image_data) {
+            fprintf(stderr, "ERROR: could not load %s\n", sourcePath.c_str());
+            return false;
+        }
+        FlipRows(image_data, width, height);
+
+        std::vector<unsigned char> level(image_data, image_data + (size_t)width * height * 4);
+        stbi_image_free(image_data);
+
+        bool hasAlpha = false;
+        for (size_t i = 3; i < level.size(); i += 4) {
+            if (level[i] != 255) {
+                hasAlpha = true;
+                break;
+            }
+        }
+
+        CookedTexture texture;
+        texture.format = hasAlpha ? COOKED_BC3 : COOKED_BC1;
+        texture.width = width;
+        texture.height = height;
+
+        //the mips are filtered in linear space before they are block compressed
+        std::vector<unsigned char> mipData;
+        std::vector<CookedLevel> mipLevels;
+        gps::MipGenerator::BuildChain(level.data(), width, height, mipData, mipLevels);
+
+        double psnr = 0.0;
+        size_t uncompressedSize = 0;
+        for (size_t l = 0; l <= mipLevels.size(); l++) {
+            const unsigned char* pixels = l == 0 ? level.data() : mipData.data() + mipLevels[l - 1].offset;
+            int levelWidth = l == 0 ? width : mipLevels[l - 1].width;
+            int levelHeight = l == 0 ? height : mipLevels[l - 1].height;
+            CookedLevel info;
+            info.width = levelWidth;
+            info.height = levelHeight;
+            info.offset = texture.data.size();
+            info.size = GetLevelSize(levelWidth, levelHeight, texture.format);
+            texture.levels.push_back(info);
+            texture.data.resize(info.offset + info.size);
+            EncodeImage(pixels, levelWidth, levelHeight, texture.format, texture.data.data() + info.offset);
+            uncompressedSize += (size_t)levelWidth * levelHeight * 4;
+
+            if (l == 0) {
+                std::vector<unsigned char> decoded(level.size());
+                DecodeImage(texture.data.data(), levelWidth, levelHeight, texture.format, decoded.data());
+                psnr = ComputePSNR(level.data(), decoded.data(), levelWidth, levelHeight, hasAlpha);
+            }
+        }
+
+        DDSHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = sizeof(DDSHeader);
+        header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+        header.height = (uint32_t)height;
+        header.width = (uint32_t)width;
+        header.pitchOrLinearSize = (uint32_t)texture.levels[0].size;
+        header.mipMapCount = (uint32_t)texture.levels.size();
+        header.pixelFormat.size = sizeof(DDSPixelFormat);
+        header.pixelFormat.flags = DDPF_FOURCC;
+        header.pixelFormat.fourCC = texture.format == COOKED_BC1 ? FOURCC_DXT1 : FOURCC_DXT5;
+        header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+        std::string cookedPath = GetCookedPath(sourcePath);
+        std::ofstream out(cookedPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC));
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)texture.data.data(), texture.data.size());
+        if (!out) {
+            fprintf(stderr, "ERROR: could not write %s\n", cookedPath.c_str());
+            return false;
+        }
+
+        struct stat sourceInfo;
+        size_t sourceSize = stat(sourcePath.c_str(), &sourceInfo) == 0 ? (size_t)sourceInfo.st_size : 0;
+        std::cout << cookedPath << " : " << width << "x" << height << " "
+            << (texture.format == COOKED_BC1 ? "BC1" : "BC3") << ", " << texture.levels.size() << " mips, "
+            << "source " << sourceSize / 1024 << " KB, RGBA8 " << uncompressedSize / 1024 << " KB -> "
+            << texture.data.size() / 1024 << " KB, PSNR " << psnr << " dB" << std::endl;
+        return true;
+    }
+
+    bool TextureCooker::LoadCooked(std::string cookedPath, CookedTexture& texture) {
+        gps::VirtualFile in;
+        if (!in.Open(cookedPath) || in.getSize() < sizeof(uint32_t) + sizeof(DDSHeader)) {
+            return false;
+        }
+        uint32_t magic;
+        DDSHeader header;
+        memcpy(&magic, in.getData(), sizeof(magic));
+        memcpy(&header, in.getData() + sizeof(magic), sizeof(header));
+        size_t dataOffset = sizeof(magic) + sizeof(header);
+        if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & DDPF_FOURCC)) {
+            return false;
+        }
+        if (header.pixelFormat.fourCC == FOURCC_DXT1) {
+            texture.format = COOKED_BC1;
+        }
+        else if (header.pixelFormat.fourCC == FOURCC_DXT5) {
+            texture.format = COOKED_BC3;
+        }
+        else {
+            return false;
+        }
+
+        texture.width = (int)header.width;
+        texture.height = (int)header.height;
+        texture.levels.clear();
+        int levelCount = std::max(1, (int)header.mipMapCount);
+        int levelWidth = texture.width;
+        int levelHeight = texture.height;
+        size_t totalSize = 0;
+        for (int i = 0; i < levelCount; i++) {
+            CookedLevel info;
+            info.width = levelWidth;
+            info.height = levelHeight;
+            info.offset = totalSize;
+            info.size = GetLevelSize(levelWidth, levelHeight, texture.format);
+            texture.levels.push_back(info);
+            totalSize += info.size;
+            levelWidth = std::max(1, levelWidth / 2);
+            levelHeight = std::max(1, levelHeight / 2);
+        }
+
+        if (totalSize > in.getSize() - dataOffset) {
+            return false;
+        }
+        texture.data.assign(in.getData() + dataOffset, in.getData() + dataOffset + totalSize);
+        return true;
+    }
+}
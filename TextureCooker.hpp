@@ -0,0 +1,56 @@
+#ifndef TextureCooker_hpp
+#define TextureCooker_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    enum CookedFormat {
+        COOKED_BC1,
+        COOKED_BC3
+    };
+
+    struct CookedLevel {
+        int width;
+        int height;
+        size_t offset;
+        size_t size;
+    };
+
+    //a block compressed texture with its whole mip chain, rows already flipped for GL
+    struct CookedTexture {
+        CookedFormat format;
+        int width;
+        int height;
+        std::vector<CookedLevel> levels;
+        std::vector<unsigned char> data;
+    };
+
+    //offline texture cooking: source images are encoded to BC1 (opaque) or BC3 (with alpha)
+    //and written with a precomputed mip chain to <source>.dds. Does not need a GL context.
+    class TextureCooker {
+
+    public:
+        static std::string GetCookedPath(std::string sourcePath);
+        static bool Cook(std::string sourcePath);
+        static bool IsUpToDate(std::string sourcePath);
+        static bool LoadCooked(std::string cookedPath, CookedTexture& texture);
+
+        static void EncodeImage(const unsigned char* pixels, int width, int height, CookedFormat format, unsigned char* blocks);
+        static void DecodeImage(const unsigned char* blocks, int width, int height, CookedFormat format, unsigned char* pixels);
+        static double ComputePSNR(const unsigned char* original, const unsigned char* decoded, int width, int height, bool withAlpha);
+        static size_t GetLevelSize(int width, int height, CookedFormat format);
+        static void FlipRows(unsigned char* pixels, int width, int height);
+
+    private:
+        static void EncodeColorBlock(const unsigned char* block, unsigned char* output);
+        static void EncodeAlphaBlock(const unsigned char* block, unsigned char* output);
+        static void DecodeColorBlock(const unsigned char* input, unsigned char* block, bool allowTransparent);
+        static void DecodeAlphaBlock(const unsigned char* input, unsigned char* block);
+    };
+
+}
+
+#endif
@@ -0,0 +1,302 @@
+#include "TextureLoader.hpp"
+#include "MipGenerator.hpp"
+#include "VirtualFile.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+    #define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+    #define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+namespace gps {
+
+    TextureLoader& TextureLoader::Get() {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    TextureLoader::TextureLoader() {
+        nextTicket = 0;
+        stopping = false;
+        compressionSupported = false;
+    }
+
+    TextureLoader::~TextureLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        for (size_t i = 0; i < decoded.size(); i++) {
+            if (decoded[i].pixels) {
+                stbi_image_free(decoded[i].pixels);
+            }
+        }
+    }
+
+    void TextureLoader::StartWorkers() {
+#if defined (__APPLE__)
+        compressionSupported = true;
+#else
+        compressionSupported = GLEW_EXT_texture_compression_s3tc != 0;
+#endif
+        unsigned int cores = std::thread::hardware_concurrency();
+        unsigned int threadCount = cores > 1 ? cores - 1 : 1;
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.push_back(std::thread(&TextureLoader::WorkerLoop, this));
+        }
+    }
+
+    GLuint TextureLoader::Load(std::string path) {
+        if (workers.empty()) {
+            StartWorkers();
+        }
+
+        //neutral grey until the decoded image arrives
+        const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back({ nextTicket++, textureID, -1, path, compressionSupported });
+        }
+        condition.notify_one();
+        return textureID;
+    }
+
+    void TextureLoader::LoadLayer(GLuint arrayId, GLint layer, int width, int height, std::string path) {
+        if (workers.empty()) {
+            StartWorkers();
+        }
+
+        LayeredArray& array = layeredArrays[arrayId];
+        array.remaining++;
+        array.width = width;
+        array.height = height;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            //cooked textures are block compressed, they can't share an uncompressed array
+            requests.push_back({ nextTicket++, arrayId, layer, path, false });
+        }
+        condition.notify_one();
+    }
+
+    void TextureLoader::ProcessUploads(double budgetMilliseconds) {
+        auto start = std::chrono::high_resolution_clock::now();
+        while (true) {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (decoded.empty()) {
+                    return;
+                }
+                image = std::move(decoded.front());
+                decoded.pop_front();
+            }
+
+            if (image.layer >= 0) {
+                UploadLayer(image);
+            }
+            else if (image.pixels) {
+                UploadImage(image);
+            }
+            else {
+                glBindTexture(GL_TEXTURE_2D, image.textureId);
+                GLenum format = image.cooked.format == gps::COOKED_BC1 ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+                for (size_t level = 0; level < image.cooked.levels.size(); level++) {
+                    const gps::CookedLevel& info = image.cooked.levels[level];
+                    glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, format, info.width, info.height, 0,
+                        (GLsizei)info.size, image.cooked.data.data() + info.offset);
+                }
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.cooked.levels.size() - 1);
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+
+            double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            if (elapsed >= budgetMilliseconds) {
+                return;
+            }
+        }
+    }
+
+    void TextureLoader::Cancel(GLuint textureId) {
+        layeredArrays.erase(textureId);
+        std::vector<unsigned char*> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.erase(std::remove_if(requests.begin(), requests.end(),
+                [textureId](const DecodeRequest& request) { return request.textureId == textureId; }), requests.end());
+            for (auto it = decoding.begin(); it != decoding.end();) {
+                if (it->second == textureId) {
+                    it = decoding.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+            for (auto it = decoded.begin(); it != decoded.end();) {
+                if (it->textureId == textureId) {
+                    dropped.push_back(it->pixels);
+                    it = decoded.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+        for (size_t i = 0; i < dropped.size(); i++) {
+            if (dropped[i]) {
+                stbi_image_free(dropped[i]);
+            }
+        }
+    }
+
+    bool TextureLoader::HasTextureStorage() {
+#if defined (__APPLE__)
+        return false;
+#else
+        return GLEW_ARB_texture_storage != 0;
+#endif
+    }
+
+    void TextureLoader::UploadImage(DecodedImage& image) {
+        GLsizei levelCount = (GLsizei)image.mipLevels.size() + 1;
+        glBindTexture(GL_TEXTURE_2D, image.textureId);
+        if (HasTextureStorage()) {
+            //replaces the mutable 1x1 placeholder storage
+            glTexStorage2D(GL_TEXTURE_2D, levelCount, GL_SRGB8, image.width, image.height);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+            for (size_t level = 0; level < image.mipLevels.size(); level++) {
+                const gps::CookedLevel& info = image.mipLevels[level];
+                glTexSubImage2D(GL_TEXTURE_2D, (GLint)level + 1, 0, 0, info.width, info.height, GL_RGBA, GL_UNSIGNED_BYTE, image.mipData.data() + info.offset);
+            }
+        }
+        else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+            for (size_t level = 0; level < image.mipLevels.size(); level++) {
+                const gps::CookedLevel& info = image.mipLevels[level];
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level + 1, GL_SRGB, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.mipData.data() + info.offset);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        stbi_image_free(image.pixels);
+    }
+
+    void TextureLoader::UploadLayer(DecodedImage& image) {
+        auto array = layeredArrays.find(image.textureId);
+        if (array == layeredArrays.end()) {
+            if (image.pixels) {
+                stbi_image_free(image.pixels);
+            }
+            return;
+        }
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, image.textureId);
+        if (image.pixels) {
+            if (image.width == array->second.width && image.height == array->second.height) {
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, image.layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+                for (size_t level = 0; level < image.mipLevels.size(); level++) {
+                    const gps::CookedLevel& info = image.mipLevels[level];
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level + 1, 0, 0, image.layer, info.width, info.height, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, image.mipData.data() + info.offset);
+                }
+            }
+            else {
+                fprintf(stderr, "WARNING: texture array layer %d is %dx%d, expected %dx%d\n", image.layer,
+                    image.width, image.height, array->second.width, array->second.height);
+            }
+            stbi_image_free(image.pixels);
+        }
+
+        //the array samples its mips only once every layer has them
+        array->second.remaining--;
+        if (array->second.remaining == 0) {
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, gps::MipGenerator::GetLevelCount(array->second.width, array->second.height) - 1);
+            layeredArrays.erase(array);
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    size_t TextureLoader::getPendingCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return requests.size() + decoding.size() + decoded.size();
+    }
+
+    void TextureLoader::WorkerLoop() {
+        while (true) {
+            DecodeRequest request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !requests.empty(); });
+                if (stopping) {
+                    return;
+                }
+                request = requests.front();
+                requests.pop_front();
+                decoding[request.ticket] = request.textureId;
+            }
+
+            DecodedImage image;
+            image.textureId = request.textureId;
+            image.layer = request.layer;
+            image.pixels = nullptr;
+            bool loaded = false;
+            if (request.allowCooked && gps::TextureCooker::IsUpToDate(request.path)) {
+                loaded = gps::TextureCooker::LoadCooked(gps::TextureCooker::GetCookedPath(request.path), image.cooked);
+                image.width = image.cooked.width;
+                image.height = image.cooked.height;
+            }
+            if (!loaded) {
+                int n;
+                int force_channels = 4;
+                gps::VirtualFile file;
+                if (file.Open(request.path)) {
+                    image.pixels = stbi_load_from_memory(file.getData(), (int)file.getSize(), &image.width, &image.height, &n, force_channels);
+                }
+                if (!image.pixels) {
+                    fprintf(stderr, "ERROR: could not load %s\n", request.path.c_str());
+                }
+                else {
+                    if ((image.width & (image.width - 1)) != 0 || (image.height & (image.height - 1)) != 0) {
+                        fprintf(stderr, "WARNING: texture %s is not power-of-2 dimensions\n", request.path.c_str());
+                    }
+                    gps::TextureCooker::FlipRows(image.pixels, image.width, image.height);
+                    gps::MipGenerator::BuildChain(image.pixels, image.width, image.height, image.mipData, image.mipLevels);
+                    loaded = true;
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (decoding.erase(request.ticket) == 0) {
+                //cancelled while decoding, the name may already belong to another texture
+                lock.unlock();
+                if (image.pixels) {
+                    stbi_image_free(image.pixels);
+                }
+                continue;
+            }
+            //failed layers are still handed over so their array gets its mip chain
+            if (loaded || request.layer >= 0) {
+                decoded.push_back(std::move(image));
+            }
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef TextureLoader_hpp
+#define TextureLoader_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "TextureCooker.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    //decodes, flips and mips textures on worker threads. Load returns a texture name right
+    //away that holds a 1x1 placeholder; ProcessUploads swaps in the real image on the GL thread.
+    //a cooked .dds next to the source is preferred when the driver supports S3TC.
+    //LoadLayer fills one layer of a GL_TEXTURE_2D_ARRAY the same way, see TextureArraySet.
+    class TextureLoader {
+
+    public:
+        static TextureLoader& Get();
+
+        GLuint Load(std::string path);
+        //the array must already have storage for the layer's whole mip chain, the array's
+        //mips are enabled once every queued layer of it has been processed
+        void LoadLayer(GLuint arrayId, GLint layer, int width, int height, std::string path);
+        void ProcessUploads(double budgetMilliseconds);
+        //drops the queued, decoding and decoded work for a texture name, must be called on the
+        //GL thread before the name is deleted so an upload never lands on a freed or reused name
+        void Cancel(GLuint textureId);
+        size_t getPendingCount();
+        //immutable storage (glTexStorage*) is core in 4.2, an extension on 4.1 drivers
+        static bool HasTextureStorage();
+
+    private:
+        struct DecodeRequest {
+            //tells a cancelled decode apart from a later request that got the same name
+            uint64_t ticket;
+            GLuint textureId;
+            //-1 for a plain 2D texture
+            GLint layer;
+            std::string path;
+            bool allowCooked;
+        };
+
+        struct DecodedImage {
+            GLuint textureId;
+            GLint layer;
+            int width;
+            int height;
+            unsigned char* pixels;
+            //levels below pixels, filtered in linear space by MipGenerator
+            std::vector<unsigned char> mipData;
+            std::vector<gps::CookedLevel> mipLevels;
+            gps::CookedTexture cooked;
+        };
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<DecodeRequest> requests;
+        std::deque<DecodedImage> decoded;
+        //arrays with layers still being decoded, only touched on the GL thread
+        struct LayeredArray {
+            size_t remaining;
+            int width;
+            int height;
+        };
+        std::unordered_map<GLuint, LayeredArray> layeredArrays;
+        //texture name of each request a worker is decoding, by ticket. Cancel removes the
+        //entry and the worker then discards its image
+        std::unordered_map<uint64_t, GLuint> decoding;
+        uint64_t nextTicket;
+        bool stopping;
+        bool compressionSupported;
+
+        TextureLoader();
+        ~TextureLoader();
+        TextureLoader(const TextureLoader&);
+        TextureLoader& operator=(const TextureLoader&);
+
+        void StartWorkers();
+        void UploadImage(DecodedImage& image);
+        void UploadLayer(DecodedImage& image);
+        void WorkerLoop();
+    };
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "TextureRegistry.hpp"
+#include "VirtualFile.hpp"
+#include "TextureLoader.hpp"
+
+#include <functional>
+
+namespace gps {
+
+    TextureRegistry& TextureRegistry::Get() {
+        //never destroyed: models release their handles from global destructors
+        static TextureRegistry* registry = new TextureRegistry();
+        return *registry;
+    }
+
+    TextureRegistry::TextureRegistry() {
+        liveCount = 0;
+    }
+
+    TextureHandle TextureRegistry::Acquire(std::string path) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint64_t contentHash;
+        auto knownPath = hashesByPath.find(path);
+        if (knownPath != hashesByPath.end()) {
+            contentHash = knownPath->second;
+        }
+        else {
+            if (!gps::VirtualFile::GetHash(path, contentHash)) {
+                //unreadable files are only shared by path, TextureLoader reports the error
+                contentHash = std::hash<std::string>()(path) ^ 0x9E3779B97F4A7C15ULL;
+            }
+            hashesByPath[path] = contentHash;
+        }
+
+        auto existing = handlesByHash.find(contentHash);
+        if (existing != handlesByHash.end()) {
+            entries[existing->second].refCount++;
+            return existing->second;
+        }
+
+        Entry entry;
+        entry.textureId.reset(gps::TextureLoader::Get().Load(path));
+        entry.contentHash = contentHash;
+        entry.path = path;
+        entry.refCount = 1;
+
+        TextureHandle handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+            entries[handle] = std::move(entry);
+        }
+        else {
+            handle = (TextureHandle)entries.size();
+            entries.push_back(std::move(entry));
+        }
+        handlesByHash[contentHash] = handle;
+        liveCount++;
+        return handle;
+    }
+
+    void TextureRegistry::Release(TextureHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (handle >= entries.size() || entries[handle].refCount == 0) {
+            return;
+        }
+        Entry& entry = entries[handle];
+        entry.refCount--;
+        if (entry.refCount > 0) {
+            return;
+        }
+        //a decode still queued for the name would otherwise upload into it after it is freed
+        gps::TextureLoader::Get().Cancel(entry.textureId);
+        entry.textureId.reset(0);
+        handlesByHash.erase(entry.contentHash);
+        entry.path.clear();
+        freeHandles.push_back(handle);
+        liveCount--;
+    }
+
+    GLuint TextureRegistry::getTextureId(TextureHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (handle >= entries.size()) {
+            return 0;
+        }
+        return entries[handle].textureId;
+    }
+
+    uint32_t TextureRegistry::InternSampler(std::string name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < samplerNames.size(); i++) {
+            if (samplerNames[i] == name) {
+                return (uint32_t)i;
+            }
+        }
+        samplerNames.push_back(name);
+        return (uint32_t)samplerNames.size() - 1;
+    }
+
+    const char* TextureRegistry::getSamplerName(uint32_t sampler) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return sampler < samplerNames.size() ? samplerNames[sampler].c_str() : "";
+    }
+
+    size_t TextureRegistry::getTextureCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return liveCount;
+    }
+}
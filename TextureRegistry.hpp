@@ -0,0 +1,67 @@
+#ifndef TextureRegistry_hpp
+#define TextureRegistry_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include "GLHandle.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    typedef uint32_t TextureHandle;
+    const TextureHandle INVALID_TEXTURE_HANDLE = 0xFFFFFFFF;
+
+    //process-wide, reference counted texture table keyed by the hash of the file contents,
+    //so identical images referenced by different models or paths share one GL texture
+    class TextureRegistry {
+
+    public:
+        static TextureRegistry& Get();
+
+        //must be called on the GL thread, the texture itself is decoded by TextureLoader
+        TextureHandle Acquire(std::string path);
+        void Release(TextureHandle handle);
+        GLuint getTextureId(TextureHandle handle);
+
+        //sampler uniform names are stored once and referenced by index
+        uint32_t InternSampler(std::string name);
+        const char* getSamplerName(uint32_t sampler);
+
+        size_t getTextureCount();
+
+    private:
+        struct Entry {
+            GLTexture textureId;
+            uint64_t contentHash;
+            std::string path;
+            uint32_t refCount;
+        };
+
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        std::vector<TextureHandle> freeHandles;
+        std::unordered_map<uint64_t, TextureHandle> handlesByHash;
+        std::unordered_map<std::string, uint64_t> hashesByPath;
+        std::deque<std::string> samplerNames;
+        size_t liveCount;
+
+        TextureRegistry();
+        TextureRegistry(const TextureRegistry&);
+        TextureRegistry& operator=(const TextureRegistry&);
+    };
+
+}
+
+#endif
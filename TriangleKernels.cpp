@@ -0,0 +1,320 @@
+#include "TriangleKernels.hpp"
+#include "TriangleKernelsImpl.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define GPS_KERNELS_SSE
+    #include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+#endif
+
+namespace gps {
+
+    //in TriangleKernelsAvx2.cpp, null when the AVX2 kernels were not compiled for this target
+    const KernelTable* GetAvx2KernelTable();
+
+    namespace {
+
+        struct Float1 {
+            struct Mask {
+                bool value;
+            };
+            static const int WIDTH = 1;
+            float value;
+
+            Float1() {}
+            explicit Float1(float value) : value(value) {}
+            static Float1 Load(const float* p) { return Float1(*p); }
+        };
+
+        inline Float1 operator+(Float1 a, Float1 b) { return Float1(a.value + b.value); }
+        inline Float1 operator-(Float1 a, Float1 b) { return Float1(a.value - b.value); }
+        inline Float1 operator*(Float1 a, Float1 b) { return Float1(a.value * b.value); }
+        inline Float1 operator/(Float1 a, Float1 b) { return Float1(a.value / b.value); }
+        //same operand order as minps / maxps
+        inline Float1 Min(Float1 a, Float1 b) { return Float1(a.value < b.value ? a.value : b.value); }
+        inline Float1 Max(Float1 a, Float1 b) { return Float1(a.value > b.value ? a.value : b.value); }
+        inline Float1 Abs(Float1 a) { return Float1(std::fabs(a.value)); }
+        inline Float1::Mask Greater(Float1 a, Float1 b) { Float1::Mask m = { a.value > b.value }; return m; }
+        inline Float1::Mask GreaterEqual(Float1 a, Float1 b) { Float1::Mask m = { a.value >= b.value }; return m; }
+        inline Float1::Mask Less(Float1 a, Float1 b) { Float1::Mask m = { a.value < b.value }; return m; }
+        inline Float1::Mask LessEqual(Float1 a, Float1 b) { Float1::Mask m = { a.value <= b.value }; return m; }
+        inline Float1::Mask operator|(Float1::Mask a, Float1::Mask b) { Float1::Mask m = { a.value || b.value }; return m; }
+        inline Float1::Mask operator&(Float1::Mask a, Float1::Mask b) { Float1::Mask m = { a.value && b.value }; return m; }
+        inline Float1 Select(Float1::Mask mask, Float1 a, Float1 b) { return mask.value ? a : b; }
+        inline int Bits(Float1::Mask mask) { return mask.value ? 1 : 0; }
+        inline void Store(float* p, Float1 a) { *p = a.value; }
+
+#ifdef GPS_KERNELS_SSE
+        struct Float4 {
+            struct Mask {
+                __m128 value;
+            };
+            static const int WIDTH = 4;
+            __m128 value;
+
+            Float4() {}
+            Float4(__m128 value) : value(value) {}
+            explicit Float4(float value) : value(_mm_set1_ps(value)) {}
+            static Float4 Load(const float* p) { return _mm_loadu_ps(p); }
+        };
+
+        inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.value, b.value); }
+        inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.value, b.value); }
+        inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.value, b.value); }
+        inline Float4 operator/(Float4 a, Float4 b) { return _mm_div_ps(a.value, b.value); }
+        inline Float4 Min(Float4 a, Float4 b) { return _mm_min_ps(a.value, b.value); }
+        inline Float4 Max(Float4 a, Float4 b) { return _mm_max_ps(a.value, b.value); }
+        inline Float4 Abs(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.value); }
+        inline Float4::Mask Greater(Float4 a, Float4 b) { Float4::Mask m = { _mm_cmpgt_ps(a.value, b.value) }; return m; }
+        inline Float4::Mask GreaterEqual(Float4 a, Float4 b) { Float4::Mask m = { _mm_cmpge_ps(a.value, b.value) }; return m; }
+        inline Float4::Mask Less(Float4 a, Float4 b) { Float4::Mask m = { _mm_cmplt_ps(a.value, b.value) }; return m; }
+        inline Float4::Mask LessEqual(Float4 a, Float4 b) { Float4::Mask m = { _mm_cmple_ps(a.value, b.value) }; return m; }
+        inline Float4::Mask operator|(Float4::Mask a, Float4::Mask b) { Float4::Mask m = { _mm_or_ps(a.value, b.value) }; return m; }
+        inline Float4::Mask operator&(Float4::Mask a, Float4::Mask b) { Float4::Mask m = { _mm_and_ps(a.value, b.value) }; return m; }
+        inline Float4 Select(Float4::Mask mask, Float4 a, Float4 b) {
+            return _mm_or_ps(_mm_and_ps(mask.value, a.value), _mm_andnot_ps(mask.value, b.value));
+        }
+        inline int Bits(Float4::Mask mask) { return _mm_movemask_ps(mask.value); }
+        inline void Store(float* p, Float4 a) { _mm_storeu_ps(p, a.value); }
+#endif
+
+        //lanes of the block holding triangles
+        inline uint8_t LaneMask(const TriangleBlocks& triangles, size_t block) {
+            size_t remaining = triangles.getTriangleCount() - block * TriangleBlocks::WIDTH;
+            return remaining >= (size_t)TriangleBlocks::WIDTH ? 0xFF : (uint8_t)((1u << remaining) - 1);
+        }
+
+        const KernelTable* GetTable(TriangleKernelLevel level) {
+            static const KernelTable scalarTable = { &OverlapBoxBlocks<Float1>, &OverlapSphereBlocks<Float1>, &IntersectSegmentBlocks<Float1> };
+#ifdef GPS_KERNELS_SSE
+            static const KernelTable sseTable = { &OverlapBoxBlocks<Float4>, &OverlapSphereBlocks<Float4>, &IntersectSegmentBlocks<Float4> };
+            if (level == KERNEL_SSE) {
+                return &sseTable;
+            }
+#endif
+            if (level == KERNEL_AVX2 && GetAvx2KernelTable()) {
+                return GetAvx2KernelTable();
+            }
+            return &scalarTable;
+        }
+
+        TriangleKernelLevel activeLevel = TriangleKernels::GetBestLevel();
+
+        //masks are produced for this many blocks at a time, so queries need no heap memory
+        const size_t MASK_CHUNK = 64;
+
+        template <class Query>
+        void CollectHits(const TriangleBlocks& triangles, const Query& query,
+            void (*kernel)(const TriangleBlock*, size_t, const Query&, uint8_t*), std::vector<uint32_t>& hits) {
+            hits.clear();
+            uint8_t masks[MASK_CHUNK];
+            for (size_t first = 0; first < triangles.getBlockCount(); first += MASK_CHUNK) {
+                size_t count = std::min(MASK_CHUNK, triangles.getBlockCount() - first);
+                kernel(triangles.getBlocks() + first, count, query, masks);
+                for (size_t b = 0; b < count; b++) {
+                    int mask = masks[b] & LaneMask(triangles, first + b);
+                    for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+                        if (mask & 1) {
+                            hits.push_back((uint32_t)((first + b) * TriangleBlocks::WIDTH + lane));
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    TriangleBlocks::TriangleBlocks() {
+        triangleCount = 0;
+    }
+
+    void TriangleBlocks::Assign(const std::vector<glm::vec3>& triangles) {
+        triangleCount = triangles.size() / 3;
+        //resize keeps the capacity, the per-frame candidate lists reuse it
+        blocks.resize((triangleCount + WIDTH - 1) / WIDTH);
+        if (!blocks.empty()) {
+            memset(&blocks.back(), 0, sizeof(TriangleBlock));
+        }
+        for (size_t i = 0; i < triangleCount; i++) {
+            TriangleBlock& block = blocks[i / WIDTH];
+            size_t lane = i % WIDTH;
+            for (int corner = 0; corner < 3; corner++) {
+                const glm::vec3& vertex = triangles[i * 3 + corner];
+                block.corners[corner * 3][lane] = vertex.x;
+                block.corners[corner * 3 + 1][lane] = vertex.y;
+                block.corners[corner * 3 + 2][lane] = vertex.z;
+            }
+        }
+    }
+
+    void TriangleBlocks::Clear() {
+        std::vector<TriangleBlock>().swap(blocks);
+        triangleCount = 0;
+    }
+
+    size_t TriangleBlocks::getTriangleCount() const {
+        return triangleCount;
+    }
+
+    size_t TriangleBlocks::getBlockCount() const {
+        return blocks.size();
+    }
+
+    const TriangleBlock* TriangleBlocks::getBlocks() const {
+        return blocks.data();
+    }
+
+    glm::vec3 TriangleBlocks::getVertex(size_t triangle, int corner) const {
+        const TriangleBlock& block = blocks[triangle / WIDTH];
+        size_t lane = triangle % WIDTH;
+        return glm::vec3(block.corners[corner * 3][lane], block.corners[corner * 3 + 1][lane], block.corners[corner * 3 + 2][lane]);
+    }
+
+    size_t TriangleBlocks::getMemoryBytes() const {
+        return blocks.capacity() * sizeof(TriangleBlock);
+    }
+
+    TriangleKernelLevel TriangleKernels::GetBestLevel() {
+        bool avx2 = false;
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] >= 7) {
+            __cpuid(info, 1);
+            //the OS must also save the ymm registers
+            bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+            __cpuidex(info, 7, 0);
+            avx2 = osSavesAvx && (info[1] & (1 << 5));
+        }
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+        if (avx2 && GetAvx2KernelTable()) {
+            return KERNEL_AVX2;
+        }
+#ifdef GPS_KERNELS_SSE
+        return KERNEL_SSE;
+#else
+        return KERNEL_SCALAR;
+#endif
+    }
+
+    TriangleKernelLevel TriangleKernels::getLevel() {
+        return activeLevel;
+    }
+
+    void TriangleKernels::setLevel(TriangleKernelLevel level) {
+        activeLevel = std::min(level, GetBestLevel());
+    }
+
+    const char* TriangleKernels::GetLevelName(TriangleKernelLevel level) {
+        const char* names[] = { "scalar", "SSE", "AVX2" };
+        return names[level];
+    }
+
+    void TriangleKernels::OverlapBox(const TriangleBlocks& triangles, glm::vec3 boxMin, glm::vec3 boxMax, std::vector<uint32_t>& hits) {
+        glm::vec3 center = (boxMin + boxMax) * 0.5f;
+        glm::vec3 half = (boxMax - boxMin) * 0.5f;
+        BoxQuery query = { { center.x, center.y, center.z }, { half.x, half.y, half.z } };
+        CollectHits(triangles, query, GetTable(activeLevel)->overlapBox, hits);
+    }
+
+    void TriangleKernels::OverlapSphere(const TriangleBlocks& triangles, glm::vec3 center, float radius, std::vector<uint32_t>& hits) {
+        SphereQuery query = { { center.x, center.y, center.z }, radius * radius };
+        CollectHits(triangles, query, GetTable(activeLevel)->overlapSphere, hits);
+    }
+
+    bool TriangleKernels::IntersectSegment(const TriangleBlocks& triangles, glm::vec3 a, glm::vec3 b, float& t, uint32_t& triangle) {
+        glm::vec3 direction = b - a;
+        SegmentQuery query = { { a.x, a.y, a.z }, { direction.x, direction.y, direction.z } };
+        float tBest = 1.0f;
+        uint32_t hit = GetTable(activeLevel)->intersectSegment(triangles.getBlocks(), triangles.getBlockCount(), query, tBest);
+        if (hit == NO_TRIANGLE || hit >= triangles.getTriangleCount()) {
+            return false;
+        }
+        t = tBest;
+        triangle = hit;
+        return true;
+    }
+
+    void TriangleKernels::Benchmark(size_t triangleCount) {
+        //block sized triangles scattered through a 64 block cube, deterministic so runs can be compared
+        std::vector<glm::vec3> source(triangleCount * 3);
+        uint32_t state = 12345;
+        auto next = [&state]() {
+            state = state * 1664525u + 1013904223u;
+            return (state >> 8) / 16777215.0f;
+        };
+        for (size_t i = 0; i < triangleCount; i++) {
+            glm::vec3 centre(next() * 64.0f, next() * 64.0f, next() * 64.0f);
+            for (int corner = 0; corner < 3; corner++) {
+                source[i * 3 + corner] = centre + glm::vec3(next() - 0.5f, next() - 0.5f, next() - 0.5f);
+            }
+        }
+        TriangleBlocks triangles;
+        triangles.Assign(source);
+
+        const int queryCount = 16;
+        std::vector<glm::vec3> points(queryCount * 2);
+        for (size_t i = 0; i < points.size(); i++) {
+            points[i] = glm::vec3(next() * 64.0f, next() * 64.0f, next() * 64.0f);
+        }
+        const float reach = 1.4f;
+
+        TriangleKernelLevel previous = activeLevel;
+        std::vector<std::vector<uint32_t> > expected(queryCount * 3);
+        std::vector<uint32_t> hits;
+        printf("%zu triangles, %d queries per kernel\n", triangleCount, queryCount);
+        printf("kernel    level    Mtriangles/s   hits/query   mismatches\n");
+        const char* kernelNames[] = { "box", "sphere", "segment" };
+        for (int kernel = 0; kernel < 3; kernel++) {
+            for (int level = KERNEL_SCALAR; level <= GetBestLevel(); level++) {
+#ifndef GPS_KERNELS_SSE
+                if (level == KERNEL_SSE) {
+                    continue;
+                }
+#endif
+                activeLevel = (TriangleKernelLevel)level;
+                size_t hitTotal = 0;
+                size_t mismatches = 0;
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int q = 0; q < queryCount; q++) {
+                    glm::vec3 p = points[q * 2];
+                    if (kernel == 0) {
+                        OverlapBox(triangles, p - glm::vec3(reach), p + glm::vec3(reach), hits);
+                    }
+                    else if (kernel == 1) {
+                        OverlapSphere(triangles, p, reach, hits);
+                    }
+                    else {
+                        float t;
+                        uint32_t triangle;
+                        hits.clear();
+                        if (IntersectSegment(triangles, p, points[q * 2 + 1], t, triangle)) {
+                            hits.push_back(triangle);
+                        }
+                    }
+                    hitTotal += hits.size();
+                    std::vector<uint32_t>& reference = expected[kernel * queryCount + q];
+                    if (level == KERNEL_SCALAR) {
+                        reference = hits;
+                    }
+                    else if (reference != hits) {
+                        mismatches++;
+                    }
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+                printf("%-8s  %-6s   %12.1f   %10.1f   %10zu\n", kernelNames[kernel], GetLevelName(activeLevel),
+                    (double)triangleCount * queryCount / seconds / 1e6, (double)hitTotal / queryCount, mismatches);
+            }
+        }
+        activeLevel = previous;
+    }
+}
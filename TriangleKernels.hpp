@@ -0,0 +1,73 @@
+#ifndef TriangleKernels_hpp
+#define TriangleKernels_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    enum TriangleKernelLevel {
+        KERNEL_SCALAR,
+        KERNEL_SSE,
+        KERNEL_AVX2
+    };
+
+    //8 triangles in structure of arrays form: row corner * 3 + axis holds that coordinate of
+    //every triangle, so a kernel loads one coordinate of 4 or 8 triangles at once
+    struct TriangleBlock {
+        float corners[9][8];
+    };
+
+    //collision triangles packed into TriangleBlocks, the last block padded with empty lanes
+    class TriangleBlocks {
+
+    public:
+        static const int WIDTH = 8;
+
+        TriangleBlocks();
+        //triangles are consecutive vertex triples, as returned by Model3D::GetTriangles
+        void Assign(const std::vector<glm::vec3>& triangles);
+        void Clear();
+
+        size_t getTriangleCount() const;
+        size_t getBlockCount() const;
+        const TriangleBlock* getBlocks() const;
+        glm::vec3 getVertex(size_t triangle, int corner) const;
+        size_t getMemoryBytes() const;
+
+    private:
+        std::vector<TriangleBlock> blocks;
+        size_t triangleCount;
+    };
+
+    //intersection tests over TriangleBlocks with a scalar, an SSE (4 lanes) and an AVX2
+    //(8 lanes) version of each kernel. The best one the CPU supports is picked on first use;
+    //all of them give the same results.
+    class TriangleKernels {
+
+    public:
+        static TriangleKernelLevel GetBestLevel();
+        static TriangleKernelLevel getLevel();
+        //levels above GetBestLevel fall back to it
+        static void setLevel(TriangleKernelLevel level);
+        static const char* GetLevelName(TriangleKernelLevel level);
+
+        //indices of the triangles touching the box, in ascending order
+        static void OverlapBox(const TriangleBlocks& triangles, glm::vec3 boxMin, glm::vec3 boxMax, std::vector<uint32_t>& hits);
+        //indices of the triangles within radius of center, in ascending order
+        static void OverlapSphere(const TriangleBlocks& triangles, glm::vec3 center, float radius, std::vector<uint32_t>& hits);
+        //first triangle crossed going from a to b (Moller-Trumbore, both faces), t is the
+        //fraction of a-b travelled. Ties go to the lower triangle index
+        static bool IntersectSegment(const TriangleBlocks& triangles, glm::vec3 a, glm::vec3 b, float& t, uint32_t& triangle);
+
+        //triangles tested per second by each kernel at each supported level, and the number of
+        //queries whose result differs from the scalar kernel
+        static void Benchmark(size_t triangleCount);
+    };
+
+}
+
+#endif
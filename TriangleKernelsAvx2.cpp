@@ -0,0 +1,83 @@
+//the AVX2 kernels, in their own file so only this code is compiled for AVX2. They are only
+//called after TriangleKernels::GetBestLevel has checked the CPU.
+
+#include "TriangleKernels.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define GPS_KERNELS_AVX2
+    #include <immintrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define GPS_KERNELS_AVX2
+    #include <immintrin.h>
+    //everything declared below is compiled for AVX2, the standard headers above are not
+    #if defined(__clang__)
+        #pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+    #else
+        #pragma GCC push_options
+        #pragma GCC target("avx2")
+    #endif
+#endif
+
+#include "TriangleKernelsImpl.hpp"
+
+namespace gps {
+
+#ifdef GPS_KERNELS_AVX2
+    namespace {
+
+        struct Float8 {
+            struct Mask {
+                __m256 value;
+            };
+            static const int WIDTH = 8;
+            __m256 value;
+
+            Float8() {}
+            Float8(__m256 value) : value(value) {}
+            explicit Float8(float value) : value(_mm256_set1_ps(value)) {}
+            static Float8 Load(const float* p) { return _mm256_loadu_ps(p); }
+        };
+
+        inline Float8 operator+(Float8 a, Float8 b) { return _mm256_add_ps(a.value, b.value); }
+        inline Float8 operator-(Float8 a, Float8 b) { return _mm256_sub_ps(a.value, b.value); }
+        inline Float8 operator*(Float8 a, Float8 b) { return _mm256_mul_ps(a.value, b.value); }
+        inline Float8 operator/(Float8 a, Float8 b) { return _mm256_div_ps(a.value, b.value); }
+        inline Float8 Min(Float8 a, Float8 b) { return _mm256_min_ps(a.value, b.value); }
+        inline Float8 Max(Float8 a, Float8 b) { return _mm256_max_ps(a.value, b.value); }
+        inline Float8 Abs(Float8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.value); }
+        inline Float8::Mask Greater(Float8 a, Float8 b) { Float8::Mask m = { _mm256_cmp_ps(a.value, b.value, _CMP_GT_OQ) }; return m; }
+        inline Float8::Mask GreaterEqual(Float8 a, Float8 b) { Float8::Mask m = { _mm256_cmp_ps(a.value, b.value, _CMP_GE_OQ) }; return m; }
+        inline Float8::Mask Less(Float8 a, Float8 b) { Float8::Mask m = { _mm256_cmp_ps(a.value, b.value, _CMP_LT_OQ) }; return m; }
+        inline Float8::Mask LessEqual(Float8 a, Float8 b) { Float8::Mask m = { _mm256_cmp_ps(a.value, b.value, _CMP_LE_OQ) }; return m; }
+        inline Float8::Mask operator|(Float8::Mask a, Float8::Mask b) { Float8::Mask m = { _mm256_or_ps(a.value, b.value) }; return m; }
+        inline Float8::Mask operator&(Float8::Mask a, Float8::Mask b) { Float8::Mask m = { _mm256_and_ps(a.value, b.value) }; return m; }
+        inline Float8 Select(Float8::Mask mask, Float8 a, Float8 b) { return _mm256_blendv_ps(b.value, a.value, mask.value); }
+        inline int Bits(Float8::Mask mask) { return _mm256_movemask_ps(mask.value); }
+        inline void Store(float* p, Float8 a) { _mm256_storeu_ps(p, a.value); }
+    }
+#endif
+}
+
+#if defined(GPS_KERNELS_AVX2) && !defined(_MSC_VER)
+    #if defined(__clang__)
+        #pragma clang attribute pop
+    #else
+        #pragma GCC pop_options
+    #endif
+#endif
+
+namespace gps {
+
+    //only takes the kernels' addresses, so nothing here runs AVX2 code
+    const KernelTable* GetAvx2KernelTable() {
+#ifdef GPS_KERNELS_AVX2
+        static const KernelTable table = { &OverlapBoxBlocks<Float8>, &OverlapSphereBlocks<Float8>, &IntersectSegmentBlocks<Float8> };
+        return &table;
+#else
+        return nullptr;
+#endif
+    }
+}
@@ -0,0 +1,250 @@
+#ifndef TriangleKernelsImpl_hpp
+#define TriangleKernelsImpl_hpp
+
+//kernel bodies shared by TriangleKernels.cpp (scalar, SSE) and TriangleKernelsAvx2.cpp. They
+//are written once against a lane type F (Float1, Float4, Float8) of WIDTH floats with the usual
+//arithmetic plus Min, Max, Abs, comparisons returning F::Mask, Select and Bits. Every lane type
+//does the same IEEE operations in the same order, so all levels agree bit for bit.
+//everything but KernelTable has internal linkage: the AVX2 file compiles these for AVX2 and
+//its copies must not be merged with the ones other files use.
+
+#include "TriangleKernels.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+namespace gps {
+
+    const uint32_t NO_TRIANGLE = 0xFFFFFFFFu;
+
+    struct BoxQuery {
+        float center[3];
+        float half[3];
+    };
+
+    struct SphereQuery {
+        float center[3];
+        float radiusSquared;
+    };
+
+    struct SegmentQuery {
+        float origin[3];
+        float direction[3];
+    };
+
+    //one set of whole-array kernels. Masks get one byte per block, bit i for lane i
+    struct KernelTable {
+        void (*overlapBox)(const TriangleBlock* blocks, size_t blockCount, const BoxQuery& query, uint8_t* masks);
+        void (*overlapSphere)(const TriangleBlock* blocks, size_t blockCount, const SphereQuery& query, uint8_t* masks);
+        //index of the nearest hit with t <= tBest (tBest is updated), NO_TRIANGLE for none
+        uint32_t (*intersectSegment)(const TriangleBlock* blocks, size_t blockCount, const SegmentQuery& query, float& tBest);
+    };
+
+    namespace {
+
+        template <class F>
+        struct Lanes3 {
+            F x, y, z;
+        };
+
+        template <class F>
+        inline Lanes3<F> Splat(const float* v) {
+            Lanes3<F> result = { F(v[0]), F(v[1]), F(v[2]) };
+            return result;
+        }
+
+        template <class F>
+        inline Lanes3<F> LoadCorner(const TriangleBlock& block, int corner, int lane) {
+            Lanes3<F> result = { F::Load(&block.corners[corner * 3][lane]), F::Load(&block.corners[corner * 3 + 1][lane]),
+                F::Load(&block.corners[corner * 3 + 2][lane]) };
+            return result;
+        }
+
+        template <class F>
+        inline Lanes3<F> operator+(const Lanes3<F>& a, const Lanes3<F>& b) {
+            Lanes3<F> result = { a.x + b.x, a.y + b.y, a.z + b.z };
+            return result;
+        }
+
+        template <class F>
+        inline Lanes3<F> operator-(const Lanes3<F>& a, const Lanes3<F>& b) {
+            Lanes3<F> result = { a.x - b.x, a.y - b.y, a.z - b.z };
+            return result;
+        }
+
+        template <class F>
+        inline Lanes3<F> operator*(const Lanes3<F>& a, F s) {
+            Lanes3<F> result = { a.x * s, a.y * s, a.z * s };
+            return result;
+        }
+
+        template <class F>
+        inline F Dot(const Lanes3<F>& a, const Lanes3<F>& b) {
+            return a.x * b.x + a.y * b.y + a.z * b.z;
+        }
+
+        template <class F>
+        inline Lanes3<F> Cross(const Lanes3<F>& a, const Lanes3<F>& b) {
+            Lanes3<F> result = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+            return result;
+        }
+
+        template <class F>
+        inline Lanes3<F> Select(typename F::Mask mask, const Lanes3<F>& a, const Lanes3<F>& b) {
+            Lanes3<F> result = { Select(mask, a.x, b.x), Select(mask, a.y, b.y), Select(mask, a.z, b.z) };
+            return result;
+        }
+
+        //true where the projection interval [minimum, maximum] misses [-radius, radius]
+        template <class F>
+        inline typename F::Mask Separated(F minimum, F maximum, F radius) {
+            return Greater(minimum, radius) | Less(maximum, F(0.0f) - radius);
+        }
+
+        template <class F>
+        inline typename F::Mask SeparatedProjection(F p0, F p1, F p2, F radius) {
+            return Separated(Min(p0, Min(p1, p2)), Max(p0, Max(p1, p2)), radius);
+        }
+
+        //the 3 axes crossing edge e with the box axes
+        template <class F>
+        inline typename F::Mask SeparatedByEdge(const Lanes3<F>& e, const Lanes3<F>& v0, const Lanes3<F>& v1, const Lanes3<F>& v2, const Lanes3<F>& half) {
+            F ax = Abs(e.x), ay = Abs(e.y), az = Abs(e.z);
+            typename F::Mask separated = SeparatedProjection(v0.z * e.y - v0.y * e.z, v1.z * e.y - v1.y * e.z, v2.z * e.y - v2.y * e.z,
+                half.y * az + half.z * ay);
+            separated = separated | SeparatedProjection(v0.x * e.z - v0.z * e.x, v1.x * e.z - v1.z * e.x, v2.x * e.z - v2.z * e.x,
+                half.x * az + half.z * ax);
+            separated = separated | SeparatedProjection(v0.y * e.x - v0.x * e.y, v1.y * e.x - v1.x * e.y, v2.y * e.x - v2.x * e.y,
+                half.x * ay + half.y * ax);
+            return separated;
+        }
+
+        //separating axis test of the box against WIDTH triangles (Akenine-Moller): box faces,
+        //triangle plane and the 9 edge cross products. Touching counts as overlapping
+        template <class F>
+        inline int BoxLanes(const TriangleBlock& block, int lane, const BoxQuery& query) {
+            Lanes3<F> center = Splat<F>(query.center);
+            Lanes3<F> half = Splat<F>(query.half);
+            Lanes3<F> v0 = LoadCorner<F>(block, 0, lane) - center;
+            Lanes3<F> v1 = LoadCorner<F>(block, 1, lane) - center;
+            Lanes3<F> v2 = LoadCorner<F>(block, 2, lane) - center;
+
+            typename F::Mask separated = SeparatedProjection(v0.x, v1.x, v2.x, half.x);
+            separated = separated | SeparatedProjection(v0.y, v1.y, v2.y, half.y);
+            separated = separated | SeparatedProjection(v0.z, v1.z, v2.z, half.z);
+
+            Lanes3<F> e0 = v1 - v0;
+            Lanes3<F> e1 = v2 - v1;
+            Lanes3<F> e2 = v0 - v2;
+            separated = separated | SeparatedByEdge(e0, v0, v1, v2, half);
+            separated = separated | SeparatedByEdge(e1, v0, v1, v2, half);
+            separated = separated | SeparatedByEdge(e2, v0, v1, v2, half);
+
+            Lanes3<F> normal = Cross(e0, e1);
+            F radius = half.x * Abs(normal.x) + half.y * Abs(normal.y) + half.z * Abs(normal.z);
+            separated = separated | Greater(Abs(Dot(normal, v0)), radius);
+            return ~Bits(separated) & ((1 << F::WIDTH) - 1);
+        }
+
+        //closest point on each triangle (Ericson, Real-Time Collision Detection 5.1.5): every
+        //Voronoi region's point is computed and the regions are applied from last to first
+        template <class F>
+        inline int SphereLanes(const TriangleBlock& block, int lane, const SphereQuery& query) {
+            const F zero(0.0f);
+            Lanes3<F> p = Splat<F>(query.center);
+            Lanes3<F> a = LoadCorner<F>(block, 0, lane);
+            Lanes3<F> b = LoadCorner<F>(block, 1, lane);
+            Lanes3<F> c = LoadCorner<F>(block, 2, lane);
+
+            Lanes3<F> ab = b - a, ac = c - a;
+            Lanes3<F> ap = p - a, bp = p - b, cp = p - c;
+            F d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+            F d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+            F d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+            F vc = d1 * d4 - d3 * d2;
+            F vb = d5 * d2 - d1 * d6;
+            F va = d3 * d6 - d5 * d4;
+
+            F denominator = F(1.0f) / (va + vb + vc);
+            Lanes3<F> closest = a + ab * (vb * denominator) + ac * (vc * denominator);
+            F d43 = d4 - d3, d56 = d5 - d6;
+            closest = Select(LessEqual(va, zero) & GreaterEqual(d43, zero) & GreaterEqual(d56, zero), b + (c - b) * (d43 / (d43 + d56)), closest);
+            closest = Select(LessEqual(vb, zero) & GreaterEqual(d2, zero) & LessEqual(d6, zero), a + ac * (d2 / (d2 - d6)), closest);
+            closest = Select(GreaterEqual(d6, zero) & LessEqual(d5, d6), c, closest);
+            closest = Select(LessEqual(vc, zero) & GreaterEqual(d1, zero) & LessEqual(d3, zero), a + ab * (d1 / (d1 - d3)), closest);
+            closest = Select(GreaterEqual(d3, zero) & LessEqual(d4, d3), b, closest);
+            closest = Select(LessEqual(d1, zero) & LessEqual(d2, zero), a, closest);
+
+            Lanes3<F> offset = p - closest;
+            return Bits(LessEqual(Dot(offset, offset), F(query.radiusSquared)));
+        }
+
+        //Moller-Trumbore for WIDTH triangles, t of each lane goes to t
+        template <class F>
+        inline int SegmentLanes(const TriangleBlock& block, int lane, const SegmentQuery& query, float tMax, float* t) {
+            const F zero(0.0f);
+            Lanes3<F> origin = Splat<F>(query.origin);
+            Lanes3<F> direction = Splat<F>(query.direction);
+            Lanes3<F> v0 = LoadCorner<F>(block, 0, lane);
+            Lanes3<F> e1 = LoadCorner<F>(block, 1, lane) - v0;
+            Lanes3<F> e2 = LoadCorner<F>(block, 2, lane) - v0;
+
+            Lanes3<F> h = Cross(direction, e2);
+            F determinant = Dot(e1, h);
+            F inverse = F(1.0f) / determinant;
+            Lanes3<F> s = origin - v0;
+            F u = inverse * Dot(s, h);
+            Lanes3<F> q = Cross(s, e1);
+            F v = inverse * Dot(direction, q);
+            F distance = inverse * Dot(e2, q);
+
+            typename F::Mask hit = Greater(Abs(determinant), zero) & GreaterEqual(u, zero) & GreaterEqual(v, zero) &
+                LessEqual(u + v, F(1.0f)) & GreaterEqual(distance, zero) & LessEqual(distance, F(tMax));
+            Store(t, distance);
+            return Bits(hit);
+        }
+
+        template <class F>
+        void OverlapBoxBlocks(const TriangleBlock* blocks, size_t blockCount, const BoxQuery& query, uint8_t* masks) {
+            for (size_t b = 0; b < blockCount; b++) {
+                int mask = 0;
+                for (int lane = 0; lane < TriangleBlocks::WIDTH; lane += F::WIDTH) {
+                    mask |= BoxLanes<F>(blocks[b], lane, query) << lane;
+                }
+                masks[b] = (uint8_t)mask;
+            }
+        }
+
+        template <class F>
+        void OverlapSphereBlocks(const TriangleBlock* blocks, size_t blockCount, const SphereQuery& query, uint8_t* masks) {
+            for (size_t b = 0; b < blockCount; b++) {
+                int mask = 0;
+                for (int lane = 0; lane < TriangleBlocks::WIDTH; lane += F::WIDTH) {
+                    mask |= SphereLanes<F>(blocks[b], lane, query) << lane;
+                }
+                masks[b] = (uint8_t)mask;
+            }
+        }
+
+        template <class F>
+        uint32_t IntersectSegmentBlocks(const TriangleBlock* blocks, size_t blockCount, const SegmentQuery& query, float& tBest) {
+            uint32_t best = NO_TRIANGLE;
+            float t[F::WIDTH];
+            for (size_t b = 0; b < blockCount; b++) {
+                for (int lane = 0; lane < TriangleBlocks::WIDTH; lane += F::WIDTH) {
+                    int mask = SegmentLanes<F>(blocks[b], lane, query, tBest, t);
+                    //lanes in index order, so the scalar and wide kernels break ties the same way
+                    for (int i = 0; mask != 0; i++, mask >>= 1) {
+                        if ((mask & 1) && (t[i] < tBest || best == NO_TRIANGLE)) {
+                            tBest = t[i];
+                            best = (uint32_t)(b * TriangleBlocks::WIDTH + lane + i);
+                        }
+                    }
+                }
+            }
+            return best;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,241 @@
+#include "VertexFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    namespace {
+
+        void ExpandBounds(const std::vector<Vertex>& vertices, bool& empty, glm::vec3& minPoint, glm::vec3& maxPoint) {
+            for (size_t i = 0; i < vertices.size(); i++) {
+                if (empty) {
+                    minPoint = vertices[i].Position;
+                    maxPoint = vertices[i].Position;
+                    empty = false;
+                }
+                minPoint = glm::min(minPoint, vertices[i].Position);
+                maxPoint = glm::max(maxPoint, vertices[i].Position);
+            }
+        }
+
+        void FinishBounds(bool empty, glm::vec3& minPoint, glm::vec3 maxPoint, glm::vec3& extent) {
+            if (empty) {
+                minPoint = glm::vec3(0.0f);
+                extent = glm::vec3(1.0f);
+                return;
+            }
+            extent = maxPoint - minPoint;
+            //flat meshes still need a non zero scale on the collapsed axis
+            for (int axis = 0; axis < 3; axis++) {
+                if (extent[axis] <= 0.0f) {
+                    extent[axis] = 1.0f;
+                }
+            }
+        }
+    }
+
+    void VertexFormat::GetQuantizationBounds(const std::vector<Vertex>& vertices, glm::vec3& minPoint, glm::vec3& extent) {
+        bool empty = true;
+        glm::vec3 maxPoint;
+        ExpandBounds(vertices, empty, minPoint, maxPoint);
+        FinishBounds(empty, minPoint, maxPoint, extent);
+    }
+
+    void VertexFormat::GetQuantizationBounds(const std::vector<MeshData>& meshes, glm::vec3& minPoint, glm::vec3& extent) {
+        bool empty = true;
+        glm::vec3 maxPoint;
+        for (size_t m = 0; m < meshes.size(); m++) {
+            ExpandBounds(meshes[m].vertices, empty, minPoint, maxPoint);
+        }
+        FinishBounds(empty, minPoint, maxPoint, extent);
+    }
+
+    void VertexFormat::PackVertex(const Vertex& vertex, glm::vec3 minPoint, glm::vec3 extent, CompactVertex& packed) {
+        glm::vec3 position = glm::clamp((vertex.Position - minPoint) / extent, 0.0f, 1.0f);
+        for (int axis = 0; axis < 3; axis++) {
+            packed.Position[axis] = (uint16_t)std::lround(position[axis] * 65535.0f);
+        }
+        packed.Position[3] = 0;
+        EncodeOctahedral(vertex.Normal, packed.Normal);
+        packed.TexCoords[0] = FloatToHalf(vertex.TexCoords.x);
+        packed.TexCoords[1] = FloatToHalf(vertex.TexCoords.y);
+    }
+
+    void VertexFormat::PackVertices(const std::vector<Vertex>& vertices, glm::vec3 minPoint, glm::vec3 extent, std::vector<CompactVertex>& packed) {
+        packed.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            PackVertex(vertices[i], minPoint, extent, packed[i]);
+        }
+    }
+
+    Vertex VertexFormat::UnpackVertex(const CompactVertex& packed, glm::vec3 minPoint, glm::vec3 extent) {
+        Vertex vertex;
+        glm::vec3 position(packed.Position[0], packed.Position[1], packed.Position[2]);
+        vertex.Position = minPoint + position / 65535.0f * extent;
+        vertex.Normal = DecodeOctahedral(packed.Normal);
+        vertex.TexCoords = glm::vec2(HalfToFloat(packed.TexCoords[0]), HalfToFloat(packed.TexCoords[1]));
+        return vertex;
+    }
+
+    bool VertexFormat::CanUseShortIndices(size_t vertexCount) {
+        return vertexCount < 65536;
+    }
+
+    void VertexFormat::PackIndices(const std::vector<GLuint>& indices, std::vector<uint16_t>& packed) {
+        packed.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+            packed[i] = (uint16_t)indices[i];
+        }
+    }
+
+    uint16_t VertexFormat::FloatToHalf(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+        int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFF;
+
+        if (((bits >> 23) & 0xFF) == 0xFF) {
+            //inf stays inf, nan keeps a mantissa bit
+            return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+        }
+        if (exponent >= 31) {
+            return (uint16_t)(sign | 0x7C00);
+        }
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return sign;
+            }
+            //denormal half, round to nearest
+            mantissa |= 0x800000;
+            uint32_t shift = (uint32_t)(14 - exponent);
+            uint32_t half = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1) {
+                half++;
+            }
+            return (uint16_t)(sign | half);
+        }
+        uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        //round to nearest, a carry into the exponent is still the correct result
+        if (mantissa & 0x1000) {
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+
+    float VertexFormat::HalfToFloat(uint16_t value) {
+        uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+        uint32_t exponent = (value >> 10) & 0x1F;
+        uint32_t mantissa = value & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0) {
+            if (mantissa == 0) {
+                bits = sign;
+            }
+            else {
+                //normalize the denormal
+                exponent = 127 - 15 + 1;
+                while ((mantissa & 0x400) == 0) {
+                    mantissa <<= 1;
+                    exponent--;
+                }
+                bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+            }
+        }
+        else if (exponent == 31) {
+            bits = sign | 0x7F800000 | (mantissa << 13);
+        }
+        else {
+            bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    void VertexFormat::EncodeOctahedral(glm::vec3 normal, int16_t encoded[2]) {
+        float length = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        if (length == 0.0f) {
+            //missing normals (see ReadOBJ) stay at zero
+            encoded[0] = 0;
+            encoded[1] = 0;
+            return;
+        }
+        glm::vec2 projected(normal.x / length, normal.y / length);
+        if (normal.z < 0.0f) {
+            glm::vec2 folded((1.0f - std::fabs(projected.y)) * (projected.x >= 0.0f ? 1.0f : -1.0f),
+                (1.0f - std::fabs(projected.x)) * (projected.y >= 0.0f ? 1.0f : -1.0f));
+            projected = folded;
+        }
+        encoded[0] = (int16_t)std::lround(glm::clamp(projected.x, -1.0f, 1.0f) * 32767.0f);
+        encoded[1] = (int16_t)std::lround(glm::clamp(projected.y, -1.0f, 1.0f) * 32767.0f);
+    }
+
+    glm::vec3 VertexFormat::DecodeOctahedral(const int16_t encoded[2]) {
+        //same mapping as octahedralDecode in the vertex shaders
+        glm::vec2 projected(std::max(encoded[0] / 32767.0f, -1.0f), std::max(encoded[1] / 32767.0f, -1.0f));
+        glm::vec3 normal(projected.x, projected.y, 1.0f - std::fabs(projected.x) - std::fabs(projected.y));
+        if (normal.z < 0.0f) {
+            float x = (1.0f - std::fabs(projected.y)) * (projected.x >= 0.0f ? 1.0f : -1.0f);
+            float y = (1.0f - std::fabs(projected.x)) * (projected.y >= 0.0f ? 1.0f : -1.0f);
+            normal.x = x;
+            normal.y = y;
+        }
+        float length = glm::length(normal);
+        return length > 0.0f ? normal / length : normal;
+    }
+
+    void VertexFormat::PrintReport(const std::vector<MeshData>& meshes) {
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        size_t floatBytes = 0;
+        size_t compactBytes = 0;
+        size_t shortIndexMeshes = 0;
+        float maxPositionError = 0.0f;
+        float maxNormalError = 0.0f;
+        float maxTexCoordError = 0.0f;
+        //the same shared grid Model3D uploads with
+        glm::vec3 minPoint;
+        glm::vec3 extent;
+        GetQuantizationBounds(meshes, minPoint, extent);
+
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const MeshData& mesh = meshes[m];
+            vertexCount += mesh.vertices.size();
+            indexCount += mesh.indices.size();
+            floatBytes += mesh.vertices.size() * sizeof(Vertex) + mesh.indices.size() * sizeof(GLuint);
+            bool shortIndices = CanUseShortIndices(mesh.vertices.size());
+            compactBytes += mesh.vertices.size() * sizeof(CompactVertex) + mesh.indices.size() * (shortIndices ? sizeof(uint16_t) : sizeof(GLuint));
+            if (shortIndices) {
+                shortIndexMeshes++;
+            }
+
+            std::vector<CompactVertex> packed;
+            PackVertices(mesh.vertices, minPoint, extent, packed);
+            for (size_t i = 0; i < packed.size(); i++) {
+                Vertex decoded = UnpackVertex(packed[i], minPoint, extent);
+                const Vertex& original = mesh.vertices[i];
+                maxPositionError = std::max(maxPositionError, glm::length(decoded.Position - original.Position));
+                maxTexCoordError = std::max(maxTexCoordError, glm::length(decoded.TexCoords - original.TexCoords));
+                float normalLength = glm::length(original.Normal);
+                if (normalLength > 0.0f) {
+                    float cosine = glm::clamp(glm::dot(decoded.Normal, original.Normal / normalLength), -1.0f, 1.0f);
+                    maxNormalError = std::max(maxNormalError, std::acos(cosine) * 57.29578f);
+                }
+            }
+        }
+
+        std::cout << "meshes         : " << meshes.size() << " (" << shortIndexMeshes << " with 16-bit indices)" << std::endl;
+        std::cout << "vertices       : " << vertexCount << ", indices: " << indexCount << std::endl;
+        std::cout << "vertex size    : " << sizeof(Vertex) << " B -> " << sizeof(CompactVertex) << " B" << std::endl;
+        std::cout << "GPU memory     : " << floatBytes / 1024 << " KB -> " << compactBytes / 1024 << " KB" << std::endl;
+        //every draw pass (shadow map and main pass) fetches the whole vertex and index buffers once
+        std::cout << "fetch per pass : " << floatBytes / 1024 << " KB -> " << compactBytes / 1024 << " KB, "
+            << 2 * floatBytes / 1024 << " KB -> " << 2 * compactBytes / 1024 << " KB per frame" << std::endl;
+        std::cout << "max error      : position " << maxPositionError << ", normal " << maxNormalError
+            << " deg, uv " << maxTexCoordError << std::endl;
+    }
+}
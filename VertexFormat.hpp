@@ -0,0 +1,46 @@
+#ifndef VertexFormat_hpp
+#define VertexFormat_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    //16 byte GPU vertex: unorm16 position inside the model's bounds (w is padding),
+    //octahedral snorm16 normal and half float texture coordinates
+    struct CompactVertex {
+
+        uint16_t Position[4];
+        int16_t Normal[2];
+        uint16_t TexCoords[2];
+    };
+
+    //conversion between gps::Vertex and the compact layout. The shaders decode positions
+    //with the positionMin/positionExtent uniforms and normals with the octahedral mapping.
+    class VertexFormat {
+
+    public:
+        static void GetQuantizationBounds(const std::vector<Vertex>& vertices, glm::vec3& minPoint, glm::vec3& extent);
+        //one grid for all meshes of a model, so positions shared by two meshes quantize to the same
+        //value and neighbouring blocks of different materials don't crack apart
+        static void GetQuantizationBounds(const std::vector<MeshData>& meshes, glm::vec3& minPoint, glm::vec3& extent);
+        static void PackVertex(const Vertex& vertex, glm::vec3 minPoint, glm::vec3 extent, CompactVertex& packed);
+        static void PackVertices(const std::vector<Vertex>& vertices, glm::vec3 minPoint, glm::vec3 extent, std::vector<CompactVertex>& packed);
+        static Vertex UnpackVertex(const CompactVertex& packed, glm::vec3 minPoint, glm::vec3 extent);
+        static bool CanUseShortIndices(size_t vertexCount);
+        static void PackIndices(const std::vector<GLuint>& indices, std::vector<uint16_t>& packed);
+
+        static uint16_t FloatToHalf(float value);
+        static float HalfToFloat(uint16_t value);
+        static void EncodeOctahedral(glm::vec3 normal, int16_t encoded[2]);
+        static glm::vec3 DecodeOctahedral(const int16_t encoded[2]);
+
+        //prints memory, per-pass fetch bandwidth and worst quantization error of both layouts
+        static void PrintReport(const std::vector<MeshData>& meshes);
+    };
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include "VirtualFile.hpp"
+#include "AssetPack.hpp"
+
+#include <sys/stat.h>
+
+namespace gps {
+
+    VirtualFile::VirtualFile() {
+        data = nullptr;
+        size = 0;
+        packedHash = 0;
+        packed = false;
+    }
+
+    bool VirtualFile::Open(std::string path) {
+        Close();
+        const gps::PackEntry* entry = gps::AssetPack::Get().Find(path);
+        if (entry) {
+            if (!gps::AssetPack::Get().Read(*entry, buffer, data)) {
+                return false;
+            }
+            size = (size_t)entry->size;
+            packedHash = entry->contentHash;
+            packed = true;
+            return true;
+        }
+        if (!file.Open(path)) {
+            return false;
+        }
+        data = file.getData();
+        size = file.getSize();
+        return true;
+    }
+
+    void VirtualFile::Close() {
+        file.Close();
+        std::vector<unsigned char>().swap(buffer);
+        data = nullptr;
+        size = 0;
+        packedHash = 0;
+        packed = false;
+    }
+
+    const unsigned char* VirtualFile::getData() const {
+        return data;
+    }
+
+    size_t VirtualFile::getSize() const {
+        return size;
+    }
+
+    uint64_t VirtualFile::Hash() const {
+        return packed ? packedHash : gps::MappedFile::HashBytes(data, size);
+    }
+
+    bool VirtualFile::isPacked() const {
+        return packed;
+    }
+
+    bool VirtualFile::Exists(std::string path) {
+        uint64_t size;
+        int64_t time;
+        return GetStamp(path, size, time);
+    }
+
+    bool VirtualFile::GetStamp(std::string path, uint64_t& size, int64_t& time) {
+        const gps::PackEntry* entry = gps::AssetPack::Get().Find(path);
+        if (entry) {
+            size = entry->size;
+            time = entry->sourceTime;
+            return true;
+        }
+        return GetDiskStamp(path, size, time);
+    }
+
+    bool VirtualFile::GetHash(std::string path, uint64_t& hash) {
+        const gps::PackEntry* entry = gps::AssetPack::Get().Find(path);
+        if (entry) {
+            hash = entry->contentHash;
+            return true;
+        }
+        gps::MappedFile looseFile;
+        if (!looseFile.Open(path)) {
+            return false;
+        }
+        hash = looseFile.Hash();
+        return true;
+    }
+
+    bool VirtualFile::GetDiskStamp(std::string path, uint64_t& size, int64_t& time) {
+#if defined (_WIN32)
+        struct _stat64 info;
+        if (_stat64(path.c_str(), &info) != 0) {
+            return false;
+        }
+#else
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            return false;
+        }
+#endif
+        size = (uint64_t)info.st_size;
+        time = (int64_t)info.st_mtime;
+        return true;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef VirtualFile_hpp
+#define VirtualFile_hpp
+
+#include "MappedFile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    //read-only view of an asset: the entry of the mounted AssetPack when it holds the path,
+    //otherwise the loose file mapped from disk. Loaders go through this instead of opening files.
+    class VirtualFile {
+
+    public:
+        VirtualFile();
+
+        bool Open(std::string path);
+        void Close();
+
+        const unsigned char* getData() const;
+        size_t getSize() const;
+        //FNV-1a 64 of the contents, taken from the pack's table of contents for packed files
+        uint64_t Hash() const;
+        bool isPacked() const;
+
+        static bool Exists(std::string path);
+        //size and modification time, as recorded at packing time for packed files
+        static bool GetStamp(std::string path, uint64_t& size, int64_t& time);
+        static bool GetDiskStamp(std::string path, uint64_t& size, int64_t& time);
+        //same value as Hash after Open, but packed files are not read: the hash comes from the
+        //table of contents, so no LZ4 entry is decompressed just to be hashed
+        static bool GetHash(std::string path, uint64_t& hash);
+
+    private:
+        gps::MappedFile file;
+        std::vector<unsigned char> buffer;
+        const unsigned char* data;
+        size_t size;
+        uint64_t packedHash;
+        bool packed;
+
+        VirtualFile(const VirtualFile&);
+        VirtualFile& operator=(const VirtualFile&);
+    };
+
+}
+
+#endif
@@ -0,0 +1,422 @@
+#include "VoxelGrid.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace gps {
+
+    namespace {
+
+        const uint32_t EMPTY_BRICK = 0xffffffffu;
+        const int BRICK_WORDS = VOXEL_BRICK_SIZE * VOXEL_BRICK_SIZE * VOXEL_BRICK_SIZE / 64;
+        //a face is axis aligned when its normal leans less than this off the axis
+        const float AXIS_TOLERANCE = 1e-4f;
+        //in blocks, how far a corner may be from the lattice and still be on it
+        const float LATTICE_TOLERANCE = 0.01f;
+        //in blocks, boxes closer than this to a block only touch it
+        const float TOUCH_EPSILON = 1e-4f;
+        const int OFFSET_BINS = 64;
+
+        //the blocks whose inside a span in lattice units overlaps, empty when from > to
+        inline void BlockRange(float low, float high, int& from, int& to) {
+            from = (int)std::floor(low + TOUCH_EPSILON);
+            to = (int)std::ceil(high - TOUCH_EPSILON) - 1;
+        }
+
+        inline int64_t Edge(int64_t ax, int64_t ay, int64_t bx, int64_t by, int64_t px, int64_t py) {
+            return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+        }
+    }
+
+    VoxelGrid::VoxelGrid() {
+        setBlockSize(1.0f);
+        Clear();
+    }
+
+    void VoxelGrid::setBlockSize(float blockSize) {
+        this->blockSize = blockSize;
+        this->inverseBlockSize = 1.0f / blockSize;
+    }
+
+    void VoxelGrid::Clear() {
+        latticeOffset = glm::vec3(0.0f);
+        gridMin = glm::ivec3(0);
+        brickCounts = glm::ivec3(0);
+        brickIndex.clear();
+        brickWords.clear();
+        solidCount = 0;
+        voxelizedTriangleCount = 0;
+        fallbackTriangles.clear();
+    }
+
+    float VoxelGrid::ToLattice(float coordinate, int axis) const {
+        return (coordinate - latticeOffset[axis]) * inverseBlockSize;
+    }
+
+    void VoxelGrid::Build(const std::vector<glm::vec3>& triangles) {
+        Clear();
+        size_t triangleCount = triangles.size() / 3;
+
+        //first pass: which triangles are axis aligned (+-(axis + 1), 0 for the others), and the
+        //lattice offset of each axis as the most common fractional position of the faces on it
+        std::vector<int8_t> faceAxis(triangleCount, 0);
+        std::vector<int> binCounts(3 * OFFSET_BINS, 0);
+        std::vector<double> binSums(3 * OFFSET_BINS, 0.0);
+        for (size_t i = 0; i < triangleCount; i++) {
+            const glm::vec3* v = &triangles[i * 3];
+            glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+            float length = glm::length(normal);
+            if (!(length > 0.0f)) {
+                continue;
+            }
+            int axis = 0;
+            for (int k = 1; k < 3; k++) {
+                if (std::fabs(normal[k]) > std::fabs(normal[axis])) {
+                    axis = k;
+                }
+            }
+            if (std::fabs(normal[(axis + 1) % 3]) > AXIS_TOLERANCE * length || std::fabs(normal[(axis + 2) % 3]) > AXIS_TOLERANCE * length) {
+                continue;
+            }
+            faceAxis[i] = (int8_t)(normal[axis] > 0.0f ? axis + 1 : -(axis + 1));
+
+            //fractions just below 1 go with those just above 0
+            float position = v[0][axis] * inverseBlockSize;
+            float fraction = position - std::floor(position);
+            if (fraction >= 1.0f - 0.5f / OFFSET_BINS) {
+                fraction -= 1.0f;
+            }
+            int bin = std::min(OFFSET_BINS - 1, (int)((fraction + 0.5f / OFFSET_BINS) * OFFSET_BINS));
+            binCounts[axis * OFFSET_BINS + bin]++;
+            binSums[axis * OFFSET_BINS + bin] += fraction;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            int best = 0;
+            for (int bin = 1; bin < OFFSET_BINS; bin++) {
+                if (binCounts[axis * OFFSET_BINS + bin] > binCounts[axis * OFFSET_BINS + best]) {
+                    best = bin;
+                }
+            }
+            int count = binCounts[axis * OFFSET_BINS + best];
+            latticeOffset[axis] = count > 0 ? (float)(binSums[axis * OFFSET_BINS + best] / count) * blockSize : 0.0f;
+        }
+
+        //second pass: aligned faces with their corners on the lattice set the blocks behind them
+        //whose centre they cover, so the two halves of a quad and greedy meshed quads both work
+        std::vector<glm::ivec3> solids;
+        for (size_t i = 0; i < triangleCount; i++) {
+            const glm::vec3* v = &triangles[i * 3];
+            bool claimed = false;
+            bool onLattice = faceAxis[i] != 0;
+            glm::ivec3 corners[3];
+            for (int c = 0; c < 3 && onLattice; c++) {
+                for (int k = 0; k < 3; k++) {
+                    float position = ToLattice(v[c][k], k);
+                    float rounded = std::floor(position + 0.5f);
+                    if (std::fabs(position - rounded) > LATTICE_TOLERANCE) {
+                        onLattice = false;
+                        break;
+                    }
+                    corners[c][k] = (int)rounded;
+                }
+            }
+            if (onLattice) {
+                int axis = std::abs(faceAxis[i]) - 1;
+                int u = (axis + 1) % 3;
+                int w = (axis + 2) % 3;
+                int layer = faceAxis[i] > 0 ? corners[0][axis] - 1 : corners[0][axis];
+                int minU = std::min(corners[0][u], std::min(corners[1][u], corners[2][u]));
+                int maxU = std::max(corners[0][u], std::max(corners[1][u], corners[2][u]));
+                int minW = std::min(corners[0][w], std::min(corners[1][w], corners[2][w]));
+                int maxW = std::max(corners[0][w], std::max(corners[1][w], corners[2][w]));
+                //doubled lattice units keep the cell centres on integers, the test is exact
+                int64_t x[3], y[3];
+                for (int c = 0; c < 3; c++) {
+                    x[c] = 2 * (int64_t)corners[c][u];
+                    y[c] = 2 * (int64_t)corners[c][w];
+                }
+                for (int cu = minU; cu < maxU; cu++) {
+                    for (int cw = minW; cw < maxW; cw++) {
+                        int64_t px = 2 * (int64_t)cu + 1;
+                        int64_t py = 2 * (int64_t)cw + 1;
+                        int64_t e0 = Edge(x[0], y[0], x[1], y[1], px, py);
+                        int64_t e1 = Edge(x[1], y[1], x[2], y[2], px, py);
+                        int64_t e2 = Edge(x[2], y[2], x[0], y[0], px, py);
+                        if ((e0 >= 0 && e1 >= 0 && e2 >= 0) || (e0 <= 0 && e1 <= 0 && e2 <= 0)) {
+                            glm::ivec3 block;
+                            block[axis] = layer;
+                            block[u] = cu;
+                            block[w] = cw;
+                            solids.push_back(block);
+                            claimed = true;
+                        }
+                    }
+                }
+            }
+            if (claimed) {
+                voxelizedTriangleCount++;
+            }
+            else {
+                fallbackTriangles.insert(fallbackTriangles.end(), v, v + 3);
+            }
+        }
+        if (solids.empty()) {
+            return;
+        }
+
+        glm::ivec3 low = solids[0];
+        glm::ivec3 high = solids[0];
+        for (size_t i = 1; i < solids.size(); i++) {
+            low = glm::min(low, solids[i]);
+            high = glm::max(high, solids[i]);
+        }
+        gridMin = low;
+        brickCounts = (high - low) / VOXEL_BRICK_SIZE + glm::ivec3(1);
+        brickIndex.assign((size_t)brickCounts.x * brickCounts.y * brickCounts.z, EMPTY_BRICK);
+        for (size_t i = 0; i < solids.size(); i++) {
+            SetSolid(solids[i]);
+        }
+    }
+
+    void VoxelGrid::SetSolid(glm::ivec3 block) {
+        glm::ivec3 local = block - gridMin;
+        glm::ivec3 brick = local / VOXEL_BRICK_SIZE;
+        uint32_t& slot = brickIndex[((size_t)brick.z * brickCounts.y + brick.y) * brickCounts.x + brick.x];
+        if (slot == EMPTY_BRICK) {
+            slot = (uint32_t)(brickWords.size() / BRICK_WORDS);
+            brickWords.resize(brickWords.size() + BRICK_WORDS, 0);
+        }
+        int bit = ((local.z % VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE + local.y % VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE + local.x % VOXEL_BRICK_SIZE;
+        uint64_t& word = brickWords[(size_t)slot * BRICK_WORDS + bit / 64];
+        uint64_t mask = (uint64_t)1 << (bit % 64);
+        if ((word & mask) == 0) {
+            word |= mask;
+            solidCount++;
+        }
+    }
+
+    glm::ivec3 VoxelGrid::GetBlock(glm::vec3 point) const {
+        return glm::ivec3((int)std::floor(ToLattice(point.x, 0)), (int)std::floor(ToLattice(point.y, 1)), (int)std::floor(ToLattice(point.z, 2)));
+    }
+
+    bool VoxelGrid::isSolid(glm::ivec3 block) const {
+        glm::ivec3 local = block - gridMin;
+        if (local.x < 0 || local.y < 0 || local.z < 0) {
+            return false;
+        }
+        glm::ivec3 brick = local / VOXEL_BRICK_SIZE;
+        if (brick.x >= brickCounts.x || brick.y >= brickCounts.y || brick.z >= brickCounts.z) {
+            return false;
+        }
+        uint32_t slot = brickIndex[((size_t)brick.z * brickCounts.y + brick.y) * brickCounts.x + brick.x];
+        if (slot == EMPTY_BRICK) {
+            return false;
+        }
+        int bit = ((local.z % VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE + local.y % VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE + local.x % VOXEL_BRICK_SIZE;
+        return (brickWords[(size_t)slot * BRICK_WORDS + bit / 64] >> (bit % 64) & 1) != 0;
+    }
+
+    bool VoxelGrid::RectangleSolid(int axis, int layer, glm::ivec2 from, glm::ivec2 to) const {
+        int u = (axis + 1) % 3;
+        int w = (axis + 2) % 3;
+        glm::ivec3 block;
+        block[axis] = layer;
+        for (int cu = from.x; cu <= to.x; cu++) {
+            for (int cw = from.y; cw <= to.y; cw++) {
+                block[u] = cu;
+                block[w] = cw;
+                if (isSolid(block)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    bool VoxelGrid::OverlapsBox(glm::vec3 boxMin, glm::vec3 boxMax) const {
+        if (isEmpty()) {
+            return false;
+        }
+        int from[3], to[3];
+        for (int axis = 0; axis < 3; axis++) {
+            BlockRange(ToLattice(boxMin[axis], axis), ToLattice(boxMax[axis], axis), from[axis], to[axis]);
+        }
+        for (int layer = from[0]; layer <= to[0]; layer++) {
+            if (RectangleSolid(0, layer, glm::ivec2(from[1], from[2]), glm::ivec2(to[1], to[2]))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    glm::vec3 VoxelGrid::MoveBox(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 motion) const {
+        if (isEmpty()) {
+            return motion;
+        }
+        glm::vec3 moved(0.0f);
+        const int order[3] = { 1, 0, 2 };
+        for (int k = 0; k < 3; k++) {
+            int axis = order[k];
+            if (motion[axis] == 0.0f) {
+                continue;
+            }
+            int u = (axis + 1) % 3;
+            int w = (axis + 2) % 3;
+            glm::ivec2 from, to;
+            BlockRange(ToLattice(boxMin[u], u), ToLattice(boxMax[u], u), from.x, to.x);
+            BlockRange(ToLattice(boxMin[w], w), ToLattice(boxMax[w], w), from.y, to.y);
+
+            //walk the layers of blocks the leading face enters, the first solid one stops the box
+            float allowed = motion[axis];
+            if (motion[axis] > 0.0f) {
+                float start = ToLattice(boxMax[axis], axis);
+                int first = (int)std::ceil(start - TOUCH_EPSILON);
+                int last = (int)std::ceil(start + motion[axis] * inverseBlockSize - TOUCH_EPSILON) - 1;
+                for (int layer = first; layer <= last; layer++) {
+                    if (RectangleSolid(axis, layer, from, to)) {
+                        allowed = layer * blockSize + latticeOffset[axis] - boxMax[axis];
+                        break;
+                    }
+                }
+            }
+            else {
+                float start = ToLattice(boxMin[axis], axis);
+                int first = (int)std::floor(start + TOUCH_EPSILON) - 1;
+                int last = (int)std::floor(start + motion[axis] * inverseBlockSize + TOUCH_EPSILON);
+                for (int layer = first; layer >= last; layer--) {
+                    if (RectangleSolid(axis, layer, from, to)) {
+                        allowed = (layer + 1) * blockSize + latticeOffset[axis] - boxMin[axis];
+                        break;
+                    }
+                }
+            }
+            boxMin[axis] += allowed;
+            boxMax[axis] += allowed;
+            moved[axis] = allowed;
+        }
+        return moved;
+    }
+
+    bool VoxelGrid::RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) const {
+        if (isEmpty()) {
+            return false;
+        }
+        //clip to the grid bounds, a ray from outside starts at the block it enters
+        float enter = 0.0f;
+        float exit = maxDistance;
+        int enterAxis = -1;
+        for (int axis = 0; axis < 3; axis++) {
+            float low = gridMin[axis] * blockSize + latticeOffset[axis];
+            float high = (gridMin[axis] + brickCounts[axis] * VOXEL_BRICK_SIZE) * blockSize + latticeOffset[axis];
+            if (direction[axis] == 0.0f) {
+                if (origin[axis] < low || origin[axis] > high) {
+                    return false;
+                }
+                continue;
+            }
+            float inverse = 1.0f / direction[axis];
+            float nearest = (low - origin[axis]) * inverse;
+            float farthest = (high - origin[axis]) * inverse;
+            if (nearest > farthest) {
+                std::swap(nearest, farthest);
+            }
+            if (nearest > enter) {
+                enter = nearest;
+                enterAxis = axis;
+            }
+            exit = std::min(exit, farthest);
+        }
+        if (enter > exit) {
+            return false;
+        }
+
+        glm::ivec3 block;
+        glm::ivec3 step;
+        glm::vec3 next;
+        glm::vec3 delta;
+        glm::vec3 start = origin + direction * enter;
+        for (int axis = 0; axis < 3; axis++) {
+            float position = ToLattice(start[axis], axis);
+            block[axis] = (int)std::floor(position);
+            if (axis == enterAxis) {
+                //on the boundary, take the block inside
+                block[axis] = direction[axis] > 0.0f ? (int)std::floor(position + 0.5f) : (int)std::floor(position + 0.5f) - 1;
+            }
+            if (direction[axis] > 0.0f) {
+                step[axis] = 1;
+                delta[axis] = blockSize / direction[axis];
+                next[axis] = enter + ((block[axis] + 1) * blockSize + latticeOffset[axis] - start[axis]) / direction[axis];
+            }
+            else if (direction[axis] < 0.0f) {
+                step[axis] = -1;
+                delta[axis] = -blockSize / direction[axis];
+                next[axis] = enter + (block[axis] * blockSize + latticeOffset[axis] - start[axis]) / direction[axis];
+            }
+            else {
+                step[axis] = 0;
+                delta[axis] = FLT_MAX;
+                next[axis] = FLT_MAX;
+            }
+        }
+
+        float t = enter;
+        int axis = enterAxis;
+        while (true) {
+            if (axis >= 0 && isSolid(block)) {
+                hit.distance = t;
+                hit.triangle = RAY_BLOCK;
+                hit.position = origin + direction * t;
+                hit.normal = glm::vec3(0.0f);
+                hit.normal[axis] = (float)-step[axis];
+                return true;
+            }
+            axis = next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+            t = next[axis];
+            if (t > exit) {
+                return false;
+            }
+            block[axis] += step[axis];
+            next[axis] += delta[axis];
+        }
+    }
+
+    const std::vector<glm::vec3>& VoxelGrid::getFallbackTriangles() const {
+        return fallbackTriangles;
+    }
+
+    bool VoxelGrid::isEmpty() const {
+        return solidCount == 0;
+    }
+
+    size_t VoxelGrid::getSolidCount() const {
+        return solidCount;
+    }
+
+    size_t VoxelGrid::getBrickCount() const {
+        return brickWords.size() / BRICK_WORDS;
+    }
+
+    size_t VoxelGrid::getVoxelizedTriangleCount() const {
+        return voxelizedTriangleCount;
+    }
+
+    glm::vec3 VoxelGrid::getLatticeOffset() const {
+        return latticeOffset;
+    }
+
+    size_t VoxelGrid::getMemoryBytes() const {
+        return brickIndex.size() * sizeof(uint32_t) + brickWords.size() * sizeof(uint64_t);
+    }
+
+    void VoxelGrid::PrintSummary() const {
+        printf("voxel grid: %zu solid blocks in %zu bricks of %d^3 (%dx%dx%d brick index), %.1f KB, lattice offset (%.3f %.3f %.3f)\n",
+            solidCount, getBrickCount(), VOXEL_BRICK_SIZE, brickCounts.x, brickCounts.y, brickCounts.z, getMemoryBytes() / 1024.0,
+            latticeOffset.x, latticeOffset.y, latticeOffset.z);
+        printf("voxel grid: %zu triangles became blocks, %zu fallback triangles (%.1f KB)\n", voxelizedTriangleCount,
+            fallbackTriangles.size() / 3, fallbackTriangles.size() * sizeof(glm::vec3) / 1024.0);
+    }
+
+}
@@ -0,0 +1,81 @@
+#ifndef VoxelGrid_hpp
+#define VoxelGrid_hpp
+
+#include "CollisionRay.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    //blocks per brick along each axis, a brick is 16^3 bits = 64 words
+    const int VOXEL_BRICK_SIZE = 16;
+
+    //bit packed occupancy of the map's blocks. The map is built from block faces on a lattice,
+    //so Build rasterizes every axis aligned triangle whose corners lie on the lattice into the
+    //block behind it (faces are CCW, the block is on their back side). The lattice offset is
+    //found from the most common position of those faces. Everything else (slanted or off
+    //lattice geometry like fences, torches or slabs) is kept as fallback triangles for the
+    //triangle path. Only blocks with a face in the mesh are set, the inside of the terrain
+    //stays empty, so moves are clipped against the grid rather than tested at their end.
+    //occupied bricks are stored once, a dense index over the grid bounds points to them.
+    class VoxelGrid {
+
+    public:
+        VoxelGrid();
+
+        void setBlockSize(float blockSize);
+        //triangles are consecutive vertex triples, as returned by Model3D::GetTriangles
+        void Build(const std::vector<glm::vec3>& triangles);
+        void Clear();
+
+        glm::ivec3 GetBlock(glm::vec3 point) const;
+        bool isSolid(glm::ivec3 block) const;
+        //whether a solid block overlaps the inside of the box, touching faces don't count
+        bool OverlapsBox(glm::vec3 boxMin, glm::vec3 boxMax) const;
+        //the part of motion the box can make, clipped one axis at a time (y, then x, then z)
+        //against the solid blocks ahead of it, the way Minecraft moves entities. Blocks the
+        //box already overlaps don't stop it, so it can't get stuck inside one
+        glm::vec3 MoveBox(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 motion) const;
+        //first solid block face a ray with a normalized direction crosses within maxDistance,
+        //walking the blocks along it (Amanatides-Woo). The block holding the origin is skipped,
+        //like the blocks MoveBox starts in; hit.triangle is RAY_BLOCK
+        bool RayCast(glm::vec3 origin, glm::vec3 direction, float maxDistance, RayHit& hit) const;
+
+        //the triangles that were not turned into blocks, consecutive vertex triples
+        const std::vector<glm::vec3>& getFallbackTriangles() const;
+        bool isEmpty() const;
+        size_t getSolidCount() const;
+        size_t getBrickCount() const;
+        size_t getVoxelizedTriangleCount() const;
+        glm::vec3 getLatticeOffset() const;
+        //brick index and bricks, the fallback triangles are not included
+        size_t getMemoryBytes() const;
+        void PrintSummary() const;
+
+    private:
+        float blockSize;
+        float inverseBlockSize;
+        glm::vec3 latticeOffset;
+        //block at the low corner of brick 0
+        glm::ivec3 gridMin;
+        glm::ivec3 brickCounts;
+        //x fastest, EMPTY_BRICK where no block is set
+        std::vector<uint32_t> brickIndex;
+        std::vector<uint64_t> brickWords;
+        size_t solidCount;
+        size_t voxelizedTriangleCount;
+        std::vector<glm::vec3> fallbackTriangles;
+
+        //position in blocks along the lattice of axis
+        float ToLattice(float coordinate, int axis) const;
+        void SetSolid(glm::ivec3 block);
+        bool RectangleSolid(int axis, int layer, glm::ivec2 from, glm::ivec2 to) const;
+    };
+
+}
+
+#endif
@@ -18,9 +18,22 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
+#include "AllocationCounter.hpp"
+#include "AssetPack.hpp"
+#include "CharacterController.hpp"
+#include "CollisionBenchmark.hpp"
+#include "CollisionWorld.hpp"
+#include "MipGenerator.hpp"
+#include "ObjParser.hpp"
+#include "TextureCooker.hpp"
+#include "TextureLoader.hpp"
+#include "TextureRegistry.hpp"
+#include "VoxelGrid.hpp"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 
 gps::Window myWindow;
@@ -49,11 +62,38 @@ gps::Model3D creeperModel;
 gps::Model3D villagerModel;
 gps::Model3D herobrineModel;
 
-//triangles of the map model for collision detection
-std::vector<glm::vec3> mapTriangles;
+//the map's blocks, bit packed. The camera and the mobs are boxes clipped against them
+gps::VoxelGrid mapVoxels;
+//triangles of the map model the grid could not turn into blocks, only those near the camera
+//are tested. --collision-backend bvh|hash picks the structure that finds them
+gps::CollisionWorld mapCollision;
+bool mapCollisionBuilt = false;
+std::vector<glm::vec3> collisionCandidates;
+//swept capsule below the camera, slides along what it hits
+gps::CharacterController playerController;
+//handed to Camera::move, which then only computes the wanted motion
+std::vector<glm::vec3> noCollision;
+//added to the distance the camera can move in a frame for the benchmark's query box
+const float collisionQueryMargin = 1.0f;
+
+//--stream: show the first frame right away and upload the models over the next frames
+bool streamingLoad = false;
+//mounted at startup when present, see --pack
+const char* assetPackPath = "assets.pack";
+//--alloc-benchmark: count the heap allocations of loading the map, then exit
+bool allocationBenchmark = false;
+const double modelUploadBudgetMs = 4.0;
+std::chrono::high_resolution_clock::time_point startupTime;
+bool firstFrameShown = false;
+bool fullyLoaded = false;
 
 glm::vec3 creeperStartPos(-45.00f, -15.00f, 7.0f);
 glm::vec3 creeperEndPos(-45.00f, -15.00f, 24.0f);
+glm::vec3 creeperPos = creeperStartPos;
+
+//a mob's box around its feet, starting half a block up so ground seams and slabs don't stop it
+const glm::vec3 mobBoxMin(-0.3f, 0.5f, -0.3f);
+const glm::vec3 mobBoxMax(0.3f, 1.8f, 0.3f);
 
 glm::mat4 lightSpaceMatrix;
 
@@ -106,7 +146,7 @@ glm::mat4 lightProjection = glm::ortho(
     nearPlane, farPlane
 );
 
-GLuint shadowMapLoc;
+GLint shadowMapLoc;
 GLint lightSpaceMatrixLoc;
 glm::mat4 lastHerobrineLightLSM;
 
@@ -213,17 +253,32 @@ void processMovement() {
     glm::vec3 boundingBoxMin = glm::vec3(-200.0f, -10.0f, -200.0f);
     glm::vec3 boundingBoxMax = glm::vec3(200.0f, 40.0f, 200.0f);
 
-    if (pressedKeys[GLFW_KEY_W]) {
-        myCamera.move(gps::MOVE_FORWARD, cameraSpeed, boundingBoxMin, boundingBoxMax, mapTriangles);
-    }
-    if (pressedKeys[GLFW_KEY_S]) {
-        myCamera.move(gps::MOVE_BACKWARD, cameraSpeed, boundingBoxMin, boundingBoxMax, mapTriangles);
-    }
-    if (pressedKeys[GLFW_KEY_A]) {
-        myCamera.move(gps::MOVE_LEFT, cameraSpeed, boundingBoxMin, boundingBoxMax, mapTriangles);
-    }
-    if (pressedKeys[GLFW_KEY_D]) {
-        myCamera.move(gps::MOVE_RIGHT, cameraSpeed, boundingBoxMin, boundingBoxMax, mapTriangles);
+    if (pressedKeys[GLFW_KEY_W] || pressedKeys[GLFW_KEY_S] || pressedKeys[GLFW_KEY_A] || pressedKeys[GLFW_KEY_D]) {
+        //the camera's own moves, without triangles, give the wanted motion of this frame
+        glm::vec3 start = myCamera.getPosition();
+        if (pressedKeys[GLFW_KEY_W]) {
+            myCamera.move(gps::MOVE_FORWARD, cameraSpeed, boundingBoxMin, boundingBoxMax, noCollision);
+        }
+        if (pressedKeys[GLFW_KEY_S]) {
+            myCamera.move(gps::MOVE_BACKWARD, cameraSpeed, boundingBoxMin, boundingBoxMax, noCollision);
+        }
+        if (pressedKeys[GLFW_KEY_A]) {
+            myCamera.move(gps::MOVE_LEFT, cameraSpeed, boundingBoxMin, boundingBoxMax, noCollision);
+        }
+        if (pressedKeys[GLFW_KEY_D]) {
+            myCamera.move(gps::MOVE_RIGHT, cameraSpeed, boundingBoxMin, boundingBoxMax, noCollision);
+        }
+        glm::vec3 motion = myCamera.getPosition() - start;
+
+        //the map blocks clip it per axis, then the capsule is swept along what is left against
+        //the map triangles it can reach that are not blocks
+        glm::vec3 boxMin, boxMax;
+        playerController.GetBounds(start, boxMin, boxMax);
+        motion = mapVoxels.MoveBox(boxMin, boxMax, motion);
+        playerController.GetSweptBounds(start, motion, boxMin, boxMax);
+        collisionCandidates.clear();
+        mapCollision.Query(boxMin, boxMax, collisionCandidates);
+        myCamera.setPosition(playerController.Move(start, motion, collisionCandidates));
     }
     float rotationSpeed = 1.0f;
     if (pressedKeys[GLFW_KEY_UP]) {
@@ -261,8 +316,6 @@ void processMovement() {
     model = glm::mat4(1.0f);
     model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
     model = glm::scale(model, glm::vec3(scaleFactor));
-
-    glm::vec3 currentCameraPosition = myCamera.getPosition();
 }
 
 void initOpenGLWindow() {
@@ -289,13 +342,80 @@ void initOpenGLState() {
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
+void buildMapCollision() {
+    mapVoxels.Build(mapModel.GetTriangles());
+    mapVoxels.PrintSummary();
+    mapCollision.Build(mapVoxels.getFallbackTriangles());
+    mapCollision.setBlocks(&mapVoxels);
+    mapCollisionBuilt = true;
+}
+
 void initModels() {
+    //the map keeps its positions for collision, everything else lives only on the GPU
+    mapModel.setResidency(gps::RESIDENCY_POSITIONS);
+    mapModel.setTextureArrays(true);
+
+    if (streamingLoad) {
+        mapModel.LoadModelAsync("models/fullMap/MinecraftMap.obj");
+        creeperModel.LoadModelAsync("models/movingCreeper/creeper.obj");
+        villagerModel.LoadModelAsync("models/movingVillager/villager.obj");
+        herobrineModel.LoadModelAsync("models/herobrine/herobrine.obj");
+        return;
+    }
+
     mapModel.LoadModel("models/fullMap/MinecraftMap.obj");
     creeperModel.LoadModel("models/movingCreeper/creeper.obj");
     villagerModel.LoadModel("models/movingVillager/villager.obj");
     herobrineModel.LoadModel("models/herobrine/herobrine.obj");
 
-    mapTriangles = mapModel.GetTriangles();
+    buildMapCollision();
+}
+
+void benchmarkMapAllocations() {
+    if (!gps::AllocationCounter::isEnabled()) {
+        printf("allocation counting is off, rebuild with GPS_ALLOCATION_COUNTER defined to count the map load\n");
+    }
+    //runs twice so the second pass shows the cost with a warm mesh cache
+    for (int pass = 0; pass < 2; pass++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        gps::AllocationCounter::Start();
+        {
+            gps::Model3D benchmarkModel;
+            benchmarkModel.setResidency(gps::RESIDENCY_POSITIONS);
+            benchmarkModel.LoadModel("models/fullMap/MinecraftMap.obj");
+        }
+        gps::AllocationCounter::Stop();
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        printf("map load pass %d: %zu heap allocations, %.1f MB allocated, %.1f ms\n", pass + 1,
+            gps::AllocationCounter::getAllocationCount(), gps::AllocationCounter::getAllocatedBytes() / (1024.0 * 1024.0), elapsed);
+    }
+}
+
+double millisecondsSinceStartup() {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startupTime).count();
+}
+
+void streamModels() {
+    if (streamingLoad) {
+        //the map comes first, it is what the camera collides with
+        gps::Model3D* models[] = { &mapModel, &creeperModel, &villagerModel, &herobrineModel };
+        double budget = modelUploadBudgetMs;
+        for (int i = 0; i < 4 && budget > 0.0; i++) {
+            budget -= models[i]->StreamUploads(myCamera.getPosition(), budget);
+        }
+        if (!mapCollisionBuilt && mapModel.isLoaded()) {
+            buildMapCollision();
+        }
+    }
+
+    if (!fullyLoaded && mapModel.isLoaded() && creeperModel.isLoaded() && villagerModel.isLoaded() &&
+        herobrineModel.isLoaded() && gps::TextureLoader::Get().getPendingCount() == 0) {
+        fullyLoaded = true;
+        std::cout << "time to fully loaded: " << millisecondsSinceStartup() << " ms, "
+            << gps::TextureRegistry::Get().getTextureCount() << " unique textures" << std::endl;
+        std::cout << "mesh data kept on the CPU: " << (mapModel.getResidentBytes() + creeperModel.getResidentBytes() +
+            villagerModel.getResidentBytes() + herobrineModel.getResidentBytes()) / 1024 << " KB" << std::endl;
+    }
 }
 
 void initShaders() {
@@ -439,6 +559,8 @@ void initUniforms() {
 
     GLint shadowMapLoc = glGetUniformLocation(basicShader.shaderProgram, "shadowMap");
     glUniform1i(shadowMapLoc, 1); 
+
+    gps::TextureArraySet::SetSamplerUnits(basicShader);
 }
 glm::mat4 computeSunLightSpaceMatrix() {
   
@@ -514,6 +636,11 @@ void initShadowMap() {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+//moves a mob standing at position towards target, as far as the map blocks let it
+glm::vec3 walkMob(glm::vec3 position, glm::vec3 target) {
+    return position + mapVoxels.MoveBox(position + mobBoxMin, position + mobBoxMax, target - position);
+}
+
 void updateVillager() {
     villagerAnimProgress += villagerAnimSpeed;
     if (villagerAnimProgress >= 1.0f) {
@@ -531,7 +658,7 @@ void updateVillager() {
     }
     glm::vec3 startPos = villagerWaypoints[villagerCurrentIndex];
     glm::vec3 endPos = villagerWaypoints[villagerNextIndex];
-    villagerPos = lerp(startPos, endPos, villagerAnimProgress);
+    villagerPos = walkMob(villagerPos, lerp(startPos, endPos, villagerAnimProgress));
 }
 
 void updateWorldConfigurations() {
@@ -642,11 +769,15 @@ const float originalCreeperHeight = 2.0f;
 void renderScene() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    //pixels covered by one unit at distance one, used to project simplification error to the screen
+    float lodScale = myWindow.getWindowDimensions().height * 0.5f * projection[1][1];
+
     glm::mat4 mapMatrix = glm::mat4(1.0f);
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(mapMatrix));
     glm::mat3 mapNormalMatrix = glm::mat3(glm::inverseTranspose(view * mapMatrix));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(mapNormalMatrix));
-    mapModel.Draw(basicShader);
+    //the map is culled per cluster, it is identity transformed so world space is object space
+    mapModel.DrawCulled(basicShader, projection * view * mapMatrix, myCamera.getPosition(), lodScale);
 
     if (goingForward) {
         creeperAnimProgress += creeperAnimSpeed;
@@ -669,7 +800,7 @@ void renderScene() {
         glUniform1f(fogDensityLoc, 0.017f);
     }
 
-    glm::vec3 creeperPos = glm::mix(creeperStartPos, creeperEndPos, creeperAnimProgress);
+    creeperPos = walkMob(creeperPos, glm::mix(creeperStartPos, creeperEndPos, creeperAnimProgress));
 
     glm::mat4 creeperMatrix = glm::mat4(1.0f);
 
@@ -687,7 +818,7 @@ void renderScene() {
     glm::mat3 creeperNormalMatrix = glm::mat3(glm::inverseTranspose(view * creeperMatrix));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(creeperNormalMatrix));
 
-    creeperModel.Draw(basicShader);
+    creeperModel.DrawLod(basicShader, creeperMatrix, myCamera.getPosition(), lodScale);
 
     if (fogDensityLoc >= 0) {
         glUniform1f(fogDensityLoc, 0.050f);
@@ -701,7 +832,7 @@ void renderScene() {
     glm::mat3 villagerNormalMatrix = glm::mat3(glm::inverseTranspose(view * villagerMatrix));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(villagerNormalMatrix));
 
-    villagerModel.Draw(basicShader);
+    villagerModel.DrawLod(basicShader, villagerMatrix, myCamera.getPosition(), lodScale);
 
     if (fogDensityLoc >= 0) {
         glUniform1f(fogDensityLoc, 0.012f); 
@@ -710,7 +841,7 @@ void renderScene() {
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(herobrineMatrix));
     glm::mat3 herobrineNormalMatrix = glm::mat3(glm::inverseTranspose(view * herobrineMatrix));
     glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(herobrineNormalMatrix));
-    herobrineModel.Draw(basicShader);
+    herobrineModel.DrawLod(basicShader, herobrineMatrix, myCamera.getPosition(), lodScale);
 
     if (fogDensityLoc >= 0) {
         glUniform1f(fogDensityLoc, 0.050f);
@@ -724,6 +855,117 @@ void cleanup() {
 }
 
 int main(int argc, const char* argv[]) {
+    startupTime = std::chrono::high_resolution_clock::now();
+
+    if (argc > 2 && std::string(argv[1]) == "--pack") {
+        std::vector<std::string> files;
+        for (int i = 3; i < argc; i++) {
+            files.push_back(argv[i]);
+        }
+        if (files.empty()) {
+            //everything the viewer loads; textures and material libraries are found through the OBJ files
+            files = { "models/fullMap/MinecraftMap.obj", "models/movingCreeper/creeper.obj", "models/movingVillager/villager.obj",
+                "models/herobrine/herobrine.obj", "shaders/basic.vert", "shaders/basic.frag", "shaders/depthMap.vert", "shaders/depthMap.frag" };
+        }
+        return gps::AssetPack::Build(argv[2], files) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--pack-benchmark") {
+        gps::AssetPack::Benchmark(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    //loose files are still used for anything the pack does not contain
+    gps::AssetPack::Get().Mount(assetPackPath);
+
+    if (argc > 2 && std::string(argv[1]) == "--benchmark-obj") {
+        std::string fileName = argv[2];
+        gps::ObjParser::Benchmark(fileName, fileName.substr(0, fileName.find_last_of('/')) + "/");
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--vertex-report") {
+        gps::Model3D reportModel;
+        reportModel.PrintVertexFormatReport(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--mesh-stats") {
+        gps::Model3D statisticsModel;
+        statisticsModel.PrintMeshStatistics(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--lod-report") {
+        gps::Model3D lodModel;
+        lodModel.PrintLodReport(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--memory-report") {
+        gps::Model3D memoryModel;
+        memoryModel.PrintMemoryReport(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--texture-array-report") {
+        gps::Model3D arrayModel;
+        arrayModel.PrintTextureArrayReport(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--cook-textures") {
+        bool cooked = true;
+        for (int i = 2; i < argc; i++) {
+            cooked = gps::TextureCooker::Cook(argv[i]) && cooked;
+        }
+        return cooked ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc > 2 && std::string(argv[1]) == "--collision-benchmark") {
+        gps::Model3D collisionModel;
+        std::vector<glm::vec3> triangles = collisionModel.ReadTriangles(argv[2]);
+        gps::CollisionBenchmark::Run(triangles, 4.0f * cameraSpeed + collisionQueryMargin);
+        gps::CollisionBenchmark::RunController(triangles, 4.0f * cameraSpeed);
+        gps::CollisionBenchmark::RunRays(triangles);
+        gps::CollisionBenchmark::RunVoxels(triangles, 4.0f * cameraSpeed);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--kernel-benchmark") {
+        gps::TriangleKernels::Benchmark(argc > 2 ? (size_t)atol(argv[2]) : (size_t)1 << 20);
+        return EXIT_SUCCESS;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--mip-test") {
+        return gps::MipGenerator::SelfTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--mip-benchmark") {
+        gps::MipGenerator::Benchmark(argc > 2 ? atoi(argv[2]) : 2048);
+        return EXIT_SUCCESS;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--stream") {
+            streamingLoad = true;
+        }
+        else if (std::string(argv[i]) == "--compact-vertices") {
+            gps::Mesh::useCompactLayout = true;
+        }
+        else if (std::string(argv[i]) == "--alloc-benchmark") {
+            allocationBenchmark = true;
+        }
+        else if (std::string(argv[i]) == "--collision-backend" && i + 1 < argc) {
+            gps::CollisionBackend backend;
+            if (!gps::CollisionWorld::ParseBackend(argv[++i], backend)) {
+                fprintf(stderr, "unknown collision backend %s, expected bvh or hash\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+            mapCollision.setBackend(backend);
+        }
+    }
+
     try {
         initOpenGLWindow();
     }
@@ -733,6 +975,11 @@ int main(int argc, const char* argv[]) {
     }
 
     initOpenGLState();
+    if (allocationBenchmark) {
+        benchmarkMapAllocations();
+        cleanup();
+        return EXIT_SUCCESS;
+    }
     initShadowMap();
     initModels();
     initShaders();
@@ -745,6 +992,8 @@ int main(int argc, const char* argv[]) {
     while (!glfwWindowShouldClose(myWindow.getWindow())) {
         glfwPollEvents();
         processMovement();
+        gps::TextureLoader::Get().ProcessUploads(4.0);
+        streamModels();
 
         basicShader.useShaderProgram();
         view = myCamera.getViewMatrix();
@@ -764,6 +1013,11 @@ int main(int argc, const char* argv[]) {
            
         glfwSwapBuffers(myWindow.getWindow());
         glCheckError();
+
+        if (!firstFrameShown) {
+            firstFrameShown = true;
+            std::cout << "time to first frame: " << millisecondsSinceStartup() << " ms" << std::endl;
+        }
     }
     cleanup();
     return EXIT_SUCCESS;
@@ -35,6 +35,11 @@ uniform vec3 mainSunLightColor;
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
 
+//textures packed by TextureArraySet: x is the array, y the layer, x < 0 samples the 2D texture
+uniform sampler2DArray textureArrays[4];
+uniform ivec2 diffuseTextureLayer;
+uniform ivec2 specularTextureLayer;
+
 uniform vec3 fogColor; 
 uniform float fogDensity;
 
@@ -166,6 +171,13 @@ float computeShadow(in vec4 fragPosLS) {
 }
 
 
+vec3 sampleTexture(sampler2D texture2D, ivec2 layer) {
+    if (layer.x < 0) {
+        return texture(texture2D, fTexCoords).rgb;
+    }
+    return texture(textureArrays[layer.x], vec3(fTexCoords, float(layer.y))).rgb;
+}
+
 float computeFogFactor(float distance) {
     float fogFactor = exp(-pow(distance * fogDensity, 2.0));
     return clamp(fogFactor, 0.0, 1.0);
@@ -210,8 +222,8 @@ void main() {
     computePointLight3();
     computeSunLight();
 
-    vec3 texDiff = texture(diffuseTexture, fTexCoords).rgb;
-    vec3 texSpec = texture(specularTexture, fTexCoords).rgb;
+    vec3 texDiff = sampleTexture(diffuseTexture, diffuseTextureLayer);
+    vec3 texSpec = sampleTexture(specularTexture, specularTextureLayer);
 
     vec3 lightSum = (ambient + diffuse + specular) * texDiff
                   + (specular * texSpec)
@@ -3,6 +3,7 @@
 layout(location = 0) in vec3 vPosition;
 layout(location = 1) in vec3 vNormal;
 layout(location = 2) in vec2 vTexCoords;
+layout(location = 3) in mat4 instanceMatrix;
 
 out vec3 fPosition; 
 out vec3 fNormal;
@@ -17,14 +18,35 @@ uniform mat4 view;
 uniform mat4 projection;
 uniform mat4 lightSpaceMatrix; 
 
+//set by Mesh::Draw for meshes using the compact vertex layout
+uniform bool compactVertices;
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
+//set by Mesh::Draw for meshes shared by several FBX nodes
+uniform bool instanced;
+
+vec3 octahedralDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
 void main() 
 {
-    vec4 worldPos = model * vec4(vPosition, 1.0);
+    vec3 position = compactVertices ? positionMin + vPosition * positionExtent : vPosition;
+    vec3 normal = compactVertices ? octahedralDecode(vNormal.xy) : vNormal;
+
+    mat4 world = instanced ? model * instanceMatrix : model;
+
+    vec4 worldPos = world * vec4(position, 1.0);
     fPosition = worldPos.xyz;
 
     fPosEye = view * worldPos;
 
-    fNormal = normalize(mat3(transpose(inverse(model))) * vNormal);
+    fNormal = normalize(mat3(transpose(inverse(world))) * normal);
     
     fTexCoords = vTexCoords;
     
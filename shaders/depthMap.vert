@@ -1,11 +1,18 @@
 // depthMap.vert
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 instanceMatrix;
 
 uniform mat4 model;
 uniform mat4 lightSpaceMatrix;
+uniform bool compactVertices;
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
+uniform bool instanced;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    vec3 position = compactVertices ? positionMin + aPos * positionExtent : aPos;
+    mat4 world = instanced ? model * instanceMatrix : model;
+    gl_Position = lightSpaceMatrix * world * vec4(position, 1.0);
 }